@@ -0,0 +1,66 @@
+// Per-call cost of the clocks a log record could be stamped with.
+//
+//   bench_clock [calls]
+//
+// tc ticks:       tc::detail::clock_ticks(), what every record and trace event pays
+// tc convert:     tc::log::timestamp_to_unix_ns(), paid once per record at formatting time
+// clock_gettime:  CLOCK_REALTIME, CLOCK_MONOTONIC and CLOCK_MONOTONIC_COARSE (vDSO)
+// std::chrono:    steady_clock::now() and system_clock::now()
+//
+// Every loop feeds its results into a checksum so the calls cannot be optimized away.
+#include "../include/tc/try_catch.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+namespace {
+
+template <class F> double ns_per_call(long calls, F&& f, std::uint64_t& sink) {
+    const auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < calls; ++i)
+        sink += f();
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    return static_cast<double>(ns.count()) / static_cast<double>(calls);
+}
+
+std::uint64_t posix_clock(clockid_t id) {
+    timespec ts;
+    ::clock_gettime(id, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u + static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const long calls = argc > 1 ? std::atol(argv[1]) : 20000000;
+    std::uint64_t sink = 0;
+    const std::uint64_t ts = tc::detail::clock_ticks();
+    sink += tc::log::timestamp_to_unix_ns(ts); // calibrate outside the timed loops
+
+    const auto info = tc::log::get_clock_info();
+    std::printf("tc clock source: %s (%.4f ns/tick)\n\n", info.source, info.ns_per_tick);
+    std::printf("%-26s %10s\n", "clock", "ns/call");
+    std::printf("%-26s %10.2f\n", "tc ticks", ns_per_call(calls, [] { return tc::detail::clock_ticks(); }, sink));
+    std::printf("%-26s %10.2f\n", "tc convert",
+                ns_per_call(calls, [&] { return tc::log::timestamp_to_unix_ns(ts + (sink & 1023)); }, sink));
+    std::printf("%-26s %10.2f\n", "CLOCK_REALTIME",
+                ns_per_call(calls, [] { return posix_clock(CLOCK_REALTIME); }, sink));
+    std::printf("%-26s %10.2f\n", "CLOCK_MONOTONIC",
+                ns_per_call(calls, [] { return posix_clock(CLOCK_MONOTONIC); }, sink));
+#if defined(CLOCK_MONOTONIC_COARSE)
+    std::printf("%-26s %10.2f\n", "CLOCK_MONOTONIC_COARSE",
+                ns_per_call(calls, [] { return posix_clock(CLOCK_MONOTONIC_COARSE); }, sink));
+#endif
+    std::printf("%-26s %10.2f\n", "steady_clock::now",
+                ns_per_call(
+                    calls, [] { return std::uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()); },
+                    sink));
+    std::printf("%-26s %10.2f\n", "system_clock::now",
+                ns_per_call(
+                    calls, [] { return std::uint64_t(std::chrono::system_clock::now().time_since_epoch().count()); },
+                    sink));
+    std::printf("\n(checksum %llu)\n", static_cast<unsigned long long>(sink & 0xff));
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Throughput and tail latency of TC_LOG_INFO with different file sinks.
+//
+//   bench_log_sinks [threads] [records_per_thread] [dir]
+//
+// stderr:   the default legacy sink, with stderr redirected to a file
+// uring:    tc::uring::file_sink with io_uring (batch of 64 records per sink call)
+// pwritev:  tc::uring::file_sink with the pwritev fallback
+//
+// Latency is sampled on every 16th call with steady_clock and reported per call in nanoseconds.
+#include "../include/tc/io_uring_sink.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+struct result {
+    double seconds;
+    std::vector<std::uint64_t> samples;
+};
+
+result run(int threads, int per_thread) {
+    std::vector<std::vector<std::uint64_t>> per(threads);
+    std::vector<std::thread> workers;
+    const auto start = clock_type::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            auto& samples = per[t];
+            samples.reserve(per_thread / 16 + 1);
+            for (int i = 0; i < per_thread; ++i) {
+                if ((i & 15) == 0) {
+                    const auto a = clock_type::now();
+                    TC_LOG_INFO("request %d on worker %d done in %d us", i, t, i % 997);
+                    const auto b = clock_type::now();
+                    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count();
+                    samples.push_back(static_cast<std::uint64_t>(ns));
+                } else {
+                    TC_LOG_INFO("request %d on worker %d done in %d us", i, t, i % 997);
+                }
+            }
+            tc::log::flush();
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    result r;
+    r.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    for (auto& s : per)
+        r.samples.insert(r.samples.end(), s.begin(), s.end());
+    std::sort(r.samples.begin(), r.samples.end());
+    return r;
+}
+
+std::uint64_t pct(const std::vector<std::uint64_t>& v, double p) {
+    if (v.empty())
+        return 0;
+    return v[std::min(v.size() - 1, static_cast<std::size_t>(p * static_cast<double>(v.size())))];
+}
+
+void report(const char* name, const result& r, long total) {
+    std::printf("%-8s %10.0f rec/s   p50 %7llu   p99 %8llu   p99.9 %9llu   max %10llu ns\n", name,
+                static_cast<double>(total) / r.seconds, static_cast<unsigned long long>(pct(r.samples, 0.50)),
+                static_cast<unsigned long long>(pct(r.samples, 0.99)),
+                static_cast<unsigned long long>(pct(r.samples, 0.999)),
+                static_cast<unsigned long long>(r.samples.empty() ? 0 : r.samples.back()));
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    const int threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int per_thread = argc > 2 ? std::atoi(argv[2]) : 200000;
+    const std::string dir = argc > 3 ? argv[3] : "/tmp";
+    const long total = static_cast<long>(threads) * per_thread;
+    tc::log::set_level(tc::log::level::info);
+    std::printf("%d threads x %d records\n", threads, per_thread);
+
+    {
+        const std::string path = dir + "/tc_bench_stderr.log";
+        const int saved = ::dup(2);
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        ::dup2(fd, 2);
+        ::close(fd);
+        const result r = run(threads, per_thread);
+        ::dup2(saved, 2);
+        ::close(saved);
+        report("stderr", r, total);
+        std::remove(path.c_str());
+    }
+
+    for (const bool uring : {true, false}) {
+        const std::string path = dir + (uring ? "/tc_bench_uring.log" : "/tc_bench_pwritev.log");
+        tc::uring::options opt;
+        opt.truncate = true;
+        opt.use_io_uring = uring;
+        result r;
+        {
+            tc::uring::file_sink file(path.c_str(), opt);
+            if (uring && !file.using_io_uring())
+                std::printf("io_uring unavailable, uring row uses the fallback\n");
+            tc::log::set_record_sink(&tc::uring::file_sink::sink, &file, 64);
+            r = run(threads, per_thread);
+            tc::log::set_sink(nullptr);
+        }
+        report(uring ? "uring" : "pwritev", r, total);
+        std::remove(path.c_str());
+    }
+    return 0;
+}
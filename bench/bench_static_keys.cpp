@@ -0,0 +1,64 @@
+// Per-call cost of a disabled TC_LOG_DEBUG site with TC_LOG_STATIC_KEYS=1.
+//
+//   bench_static_keys [calls]
+//
+// empty loop:     the loop alone
+// key off:        the site's nop, what a disabled site costs with static keys
+// key on:         the same site patched in but filtered by the level check, what every disabled site costs
+//                 without static keys (and on platforms where they are not supported)
+//
+// "key on" is reached by giving another thread a debug override: that lowers the level static keys are patched
+// for, while this thread still filters debug records.
+#define TC_LOG_STATIC_KEYS 1
+#include "../include/tc/try_catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+volatile std::uint64_t counter = 0;
+
+__attribute__((noinline)) void empty_body(long i) {
+    counter = counter + static_cast<std::uint64_t>(i);
+}
+
+__attribute__((noinline)) void debug_site(long i) {
+    TC_LOG_DEBUG("value %ld", i);
+    counter = counter + static_cast<std::uint64_t>(i);
+}
+
+template <class F> double ns_per_call(long calls, F f) {
+    const auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < calls; ++i)
+        f(i);
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    return static_cast<double>(ns.count()) / static_cast<double>(calls);
+}
+
+void report(const char* name, long calls, void (*f)(long)) {
+    double best = ns_per_call(calls, f);
+    for (int run = 0; run < 4; ++run)
+        best = std::min(best, ns_per_call(calls, f));
+    const auto keys = tc::log::get_static_key_stats();
+    std::printf("%-12s %10.3f %8zu/%zu\n", name, best, keys.on, keys.entries);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const long calls = argc > 1 ? std::atol(argv[1]) : 100000000;
+    tc::log::set_level(tc::log::level::info);
+#if !TC_LOG_STATIC_KEYS_SUPPORTED
+    std::printf("static keys are not supported on this platform; both sites use the atomic check\n\n");
+#endif
+    std::printf("%-12s %10s %10s\n", "site", "ns/call", "keys on");
+    report("empty loop", calls, &empty_body);
+    report("key off", calls, &debug_site);
+    std::thread([] { tc::log::scoped_thread_level debug(tc::log::level::debug); }).join();
+    report("key on", calls, &debug_site);
+    return 0;
+}
@@ -0,0 +1,607 @@
+// tc/async_sink.hpp
+// Buffered v2 record sink: logging threads copy records into a bounded queue, a drain thread hands them to the
+// wrapped sink in batches, so a slow sink (a file, a socket) is kept off the logging path.
+// - The queue is lock-free: one CAS on the enqueue cursor per record, per-slot sequence numbers publish it
+// - What a producer does when the queue is full is chosen per sink (overflow::block, drop_newest,
+//   overwrite_oldest or spill to a synchronous fallback sink)
+// - Enqueued, dropped, high-water mark, drain latency and time spent in the wrapped sink are kept per sink and
+//   reported by tc::log::stats() and tc::log::for_each_sink_stats()
+// - Optional per-CPU rings (options::per_cpu, x86-64 Linux with glibc 2.35+): a record is committed to the current
+//   CPU's ring by a restartable sequence (rseq) instead of a CAS on the shared queue
+//
+// Usage:
+//   tc::async::options opt;
+//   opt.policy = tc::async::overflow::drop_newest;
+//   static tc::async::buffered_sink out(&tc::uring::file_sink::sink, &file, opt);
+//   tc::log::add_sink(&tc::async::buffered_sink::sink, &out);
+
+#pragma once
+
+#include "try_catch.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if !defined(TC_ASYNC_RSEQ)
+#if defined(__linux__) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) &&                          \
+    __has_include(<sys/rseq.h>)
+#define TC_ASYNC_RSEQ 1
+#else
+#define TC_ASYNC_RSEQ 0
+#endif
+#endif
+
+#if TC_ASYNC_RSEQ
+#include <sys/rseq.h>
+#include <unistd.h>
+#endif
+
+// Message plus context bytes kept per queued record: by default all a TC_LOG_* record can carry. A longer record
+// is cut, ends with "[truncated]" and is counted in sink_stats::truncated.
+#if !defined(TC_ASYNC_RECORD_BYTES)
+#define TC_ASYNC_RECORD_BYTES (TC_LOG_MESSAGE_MAX + TC_LOG_CONTEXT_BYTES)
+#endif
+
+#if !defined(TC_ASYNC_BATCH_MAX)
+#define TC_ASYNC_BATCH_MAX 256
+#endif
+
+namespace tc {
+namespace detail {
+
+#if TC_ASYNC_RSEQ
+// The calling thread's rseq area, registered by glibc at thread start; nullptr when registration is disabled
+// (glibc.pthread.rseq=0) or failed.
+inline struct rseq* this_thread_rseq() noexcept {
+    if (__rseq_size == 0)
+        return nullptr;
+    char* tp;
+    __asm__("movq %%fs:0, %0" : "=r"(tp));
+    auto* rs = reinterpret_cast<struct rseq*>(tp + __rseq_offset);
+    return static_cast<std::int32_t>(__atomic_load_n(&rs->cpu_id, __ATOMIC_RELAXED)) >= 0 ? rs : nullptr;
+}
+
+// Stores `newv` to `*v` if it still holds `expect` and the thread is still running on `cpu`, as one restartable
+// sequence ending in the store: the kernel restarts it at the abort label if the thread is preempted, migrated or
+// signalled before the store. Returns 0 once stored, 1 if `*v` had changed, -1 if aborted. The descriptor and the
+// abort handler go in the function's COMDAT group, so they are discarded along with duplicate copies of it.
+inline int rseq_cmpeqv_storev(struct rseq* rs, std::uint64_t* v, std::uint64_t expect, std::uint64_t newv,
+                              std::uint32_t cpu) noexcept {
+    __asm__ goto(".pushsection __rseq_cs, \"aw?\"\n\t"
+                 ".balign 32\n\t"
+                 "3:\n\t"
+                 ".long 0x0, 0x0\n\t"        // version, flags
+                 ".quad 1f, (2f - 1f), 4f\n\t" // start, length, abort
+                 ".popsection\n\t"
+                 "leaq 3b(%%rip), %%rax\n\t"
+                 "movq %%rax, %[rseq_cs]\n\t"
+                 "1:\n\t"
+                 "cmpl %[cpu], %[cpu_id]\n\t"
+                 "jnz 4f\n\t"
+                 "cmpq %[v], %[expect]\n\t"
+                 "jnz %l[changed]\n\t"
+                 "movq %[newv], %[v]\n\t"
+                 "2:\n\t"
+                 ".pushsection __rseq_failure, \"ax?\"\n\t"
+                 ".byte 0x0f, 0xb9, 0x3d\n\t" // ud1 carrying RSEQ_SIG, which must precede the abort handler
+                 ".long 0x53053053\n\t"
+                 "4:\n\t"
+                 "jmp %l[aborted]\n\t"
+                 ".popsection\n\t"
+                 :
+                 : [cpu] "r"(cpu), [cpu_id] "m"(rs->cpu_id), [rseq_cs] "m"(rs->rseq_cs), [v] "m"(*v),
+                   [expect] "r"(expect), [newv] "r"(newv)
+                 : "memory", "cc", "rax"
+                 : changed, aborted);
+    return 0;
+changed:
+    return 1;
+aborted:
+    return -1;
+}
+#endif
+
+} // namespace detail
+
+namespace async {
+
+enum class overflow {
+    block,            // wait for the drain thread to make room
+    drop_newest,      // reject the record being logged
+    overwrite_oldest, // discard the oldest queued record to make room
+    spill,            // write the record synchronously to options::fallback
+};
+
+struct options {
+    std::size_t capacity = 1024; // queued records, rounded up to a power of two
+    overflow policy = overflow::block;
+    log::record_sink_t fallback = &log::stderr_record_sink; // used by overflow::spill
+    void* fallback_ctx = nullptr;
+    std::size_t batch = 64;     // records per call to the wrapped sink, at most TC_ASYNC_BATCH_MAX
+    const char* name = "async"; // as reported by tc::log::for_each_sink_stats()
+    // Put a ring of `per_cpu_capacity` records in front of the shared queue for each CPU. A record goes to the ring
+    // of the CPU its thread runs on, and to the shared queue only while that ring is full; `policy` applies once
+    // both are. Ignored (everything uses the shared queue) where rseq is unavailable. A thread's records are still
+    // delivered in the order it logged them when it migrates or overflows into the shared queue, as long as it
+    // logs to at most 8 per-CPU sinks; records of different threads are ordered by timestamp within each batch.
+    bool per_cpu = false;
+    std::size_t per_cpu_capacity = 128; // rounded up to a power of two
+};
+
+class buffered_sink {
+  public:
+    // Starts the drain thread. `downstream` is only ever called from that thread.
+    buffered_sink(log::record_sink_t downstream, void* ctx, const options& opt = options())
+        : downstream_(downstream), ctx_(ctx), opt_(opt), id_(next_id().fetch_add(1) + 1) {
+        std::size_t cap = 2;
+        while (cap < opt.capacity)
+            cap <<= 1;
+        mask_ = cap - 1;
+        slots_ = new slot[cap];
+        for (std::size_t i = 0; i < cap; ++i)
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        opt_.batch = std::min<std::size_t>(std::max<std::size_t>(opt.batch, 1), TC_ASYNC_BATCH_MAX);
+#if TC_ASYNC_RSEQ
+        if (opt.per_cpu && ::tc::detail::this_thread_rseq() != nullptr) {
+            const long conf = ::sysconf(_SC_NPROCESSORS_CONF);
+            cpus_ = conf > 0 ? static_cast<std::uint32_t>(conf) : 1;
+            std::size_t ring = 2;
+            while (ring < opt.per_cpu_capacity)
+                ring <<= 1;
+            ring_mask_ = ring - 1;
+            rings_ = new cpu_ring[cpus_];
+            for (std::uint32_t c = 0; c < cpus_; ++c)
+                rings_[c].slots = new slot[ring];
+        }
+#endif
+        metrics_ = ::tc::detail::acquire_sink_metrics(opt.name);
+        drain_ = std::thread([this] { drain(); });
+    }
+
+    // Delivers everything still queued, then stops the drain thread.
+    ~buffered_sink() {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        work_.notify_one();
+        drain_.join();
+        ::tc::detail::release_sink_metrics(metrics_);
+        for (std::uint32_t c = 0; c < cpus_; ++c)
+            delete[] rings_[c].slots;
+        delete[] rings_;
+        delete[] slots_;
+    }
+
+    buffered_sink(const buffered_sink&) = delete;
+    buffered_sink& operator=(const buffered_sink&) = delete;
+
+    // tc::log record sink.
+    static void sink(void* ctx, const log::record* recs, std::size_t n) {
+        auto* self = static_cast<buffered_sink*>(ctx);
+        for (std::size_t i = 0; i < n; ++i)
+            self->push(recs[i]);
+    }
+
+    // Queues one record, applying the overflow policy when the queue is full. Returns false if it was dropped.
+    bool push(const log::record& rec) {
+        if (rings_ != nullptr && enqueue_on_cpu(rec))
+            return true;
+        if (enqueue(rec))
+            return true;
+        switch (opt_.policy) {
+        case overflow::drop_newest:
+            break;
+        case overflow::spill:
+            metrics_->spilled.fetch_add(1, std::memory_order_relaxed);
+            if (opt_.fallback != nullptr)
+                opt_.fallback(opt_.fallback_ctx, &rec, 1);
+            return true;
+        case overflow::overwrite_oldest:
+            for (;;) {
+                if (discard_oldest())
+                    metrics_->overwritten.fetch_add(1, std::memory_order_relaxed);
+                else
+                    std::this_thread::yield(); // a cell is still being written or copied out
+                if (enqueue(rec))
+                    return true;
+            }
+        case overflow::block:
+            if (draining_thread() == this)
+                break; // the wrapped sink is logging: waiting on ourselves would never end
+            metrics_->blocked.fetch_add(1, std::memory_order_relaxed);
+            while (!enqueue(rec)) {
+                std::unique_lock<std::mutex> lock(mu_);
+                ++space_waiters_;
+                work_.notify_one();
+                room_.wait_for(lock, std::chrono::milliseconds(1));
+                --space_waiters_;
+            }
+            return true;
+        }
+        metrics_->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Waits until every record queued before the call has been handed to the wrapped sink (or overwritten).
+    void flush() {
+        std::uint64_t target = enqueue_pos_.load(std::memory_order_acquire);
+        for (std::uint32_t c = 0; c < cpus_; ++c)
+            target += ring_head(rings_[c]);
+        std::unique_lock<std::mutex> lock(mu_);
+        while (done_.load(std::memory_order_acquire) < target) {
+            ++space_waiters_;
+            work_.notify_one();
+            room_.wait_for(lock, std::chrono::milliseconds(1));
+            --space_waiters_;
+        }
+    }
+
+    log::sink_stats stats() const {
+        return log::snapshot_sink_stats(*metrics_);
+    }
+
+    // Whether records from this thread go to per-CPU rings.
+    bool per_cpu() const noexcept {
+#if TC_ASYNC_RSEQ
+        return rings_ != nullptr && ::tc::detail::this_thread_rseq() != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    // Bytes allocated for queued records: the shared queue plus every per-CPU ring.
+    std::size_t memory_bytes() const noexcept {
+        return sizeof(slot) * ((mask_ + 1) + (rings_ != nullptr ? cpus_ * (ring_mask_ + 1) : 0));
+    }
+
+  private:
+    // A bounded MPMC queue cell (Vyukov): `seq` == position when free for that position's producer, position + 1
+    // once published, position + capacity once consumed. Producers discarding under overwrite_oldest consume too.
+    struct slot {
+        std::atomic<std::uint64_t> seq{0};
+        log::level level;
+        int line;
+        const char* file;
+        const char* func;
+        std::uint64_t timestamp;
+        std::uint64_t thread_id;
+        std::uint64_t first_timestamp;
+        std::uint32_t repeats;
+        std::uint32_t payload_len;
+        std::uint32_t context_len;
+        std::uint32_t after_queue; // where the thread's previous record went, if not to this queue, else no_queue
+        std::uint64_t after_pos;   // and its position there
+        bool truncated;
+        std::uint64_t enqueued_at; // clock ticks, for the drain latency
+        char text[TC_ASYNC_RECORD_BYTES];
+    };
+
+    static constexpr std::uint32_t shared_queue = 0xfffffffe, no_queue = 0xffffffff;
+
+    // The queue and position of the calling thread's last record for a per-CPU sink, for the last few such sinks
+    // it used (direct-mapped by sink id).
+    struct last_record {
+        std::uint64_t sink = 0;
+        std::uint32_t queue = 0;
+        std::uint64_t pos = 0;
+    };
+
+    static last_record& last_record_of(std::uint64_t id) {
+        static thread_local last_record last[8];
+        return last[id % 8];
+    }
+
+    static std::atomic<std::uint64_t>& next_id() {
+        static std::atomic<std::uint64_t> n{0};
+        return n;
+    }
+
+    static constexpr std::string_view truncation_marker = "[truncated]";
+    static_assert(TC_ASYNC_RECORD_BYTES > truncation_marker.size(), "TC_ASYNC_RECORD_BYTES is too small");
+
+    // Records from one CPU. `head` counts reservations and is only written by rseq commits on that CPU; cells are
+    // published through their `seq` as in the shared queue, and handed back by the drain thread advancing `tail`.
+    struct cpu_ring {
+        alignas(64) std::uint64_t head = 0;
+        alignas(64) std::atomic<std::uint64_t> tail{0};
+        slot* slots = nullptr;
+    };
+
+    static std::uint64_t ring_head(const cpu_ring& r) noexcept {
+#if TC_ASYNC_RSEQ
+        return __atomic_load_n(&r.head, __ATOMIC_ACQUIRE);
+#else
+        return r.head;
+#endif
+    }
+
+    static const buffered_sink*& draining_thread() {
+        static thread_local const buffered_sink* self = nullptr;
+        return self;
+    }
+
+    bool enqueue(const log::record& rec) {
+        std::uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot& s = slots_[pos & mask_];
+            const auto diff = static_cast<std::int64_t>(s.seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        fill(slots_[pos & mask_], rec, pos, shared_queue);
+        metrics_->enqueued.fetch_add(1, std::memory_order_relaxed);
+        metrics_->note_depth(pos + 1 - dequeue_pos_.load(std::memory_order_relaxed));
+        wake();
+        return true;
+    }
+
+    // Reserves the next cell of the current CPU's ring; false if the ring is full or the thread has no rseq area.
+    // Enqueued count and depth of ring records are kept by the drain thread, so this touches no shared cache line
+    // other than `idle_`.
+    bool enqueue_on_cpu(const log::record& rec) {
+#if TC_ASYNC_RSEQ
+        struct rseq* rs = ::tc::detail::this_thread_rseq();
+        if (rs == nullptr)
+            return false;
+        for (;;) {
+            const std::uint32_t cpu = __atomic_load_n(&rs->cpu_id_start, __ATOMIC_RELAXED);
+            if (cpu >= cpus_)
+                return false;
+            cpu_ring& r = rings_[cpu];
+            const std::uint64_t head = __atomic_load_n(&r.head, __ATOMIC_RELAXED);
+            if (head - r.tail.load(std::memory_order_acquire) > ring_mask_)
+                return false;
+            if (::tc::detail::rseq_cmpeqv_storev(rs, &r.head, head, head + 1, cpu) != 0)
+                continue; // preempted or migrated, or another thread on this CPU took the cell
+            fill(r.slots[head & ring_mask_], rec, head, cpu);
+            wake();
+            return true;
+        }
+#else
+        (void)rec;
+        return false;
+#endif
+    }
+
+    // Copies `rec` into a reserved cell and publishes it for position `pos` of `queue`. A record that does not fit
+    // keeps its payload first, and the part that was cut ends with the marker. With per-CPU rings, a record that
+    // lands in another queue than the thread's previous one names that one, for predecessor_taken().
+    void fill(slot& s, const log::record& rec, std::uint64_t pos, std::uint32_t queue) {
+        std::uint32_t after_queue = no_queue;
+        std::uint64_t after_pos = 0;
+        if (rings_ != nullptr) {
+            last_record& last = last_record_of(id_);
+            if (last.sink == id_ && last.queue != queue) {
+                after_queue = last.queue;
+                after_pos = last.pos;
+            }
+            last = {id_, queue, pos};
+        }
+        // Atomic, as dequeue() may read them before it claims the cell.
+        __atomic_store_n(&s.after_queue, after_queue, __ATOMIC_RELAXED);
+        __atomic_store_n(&s.after_pos, after_pos, __ATOMIC_RELAXED);
+        s.level = rec.level;
+        s.line = rec.line;
+        s.file = rec.file;
+        s.func = rec.func;
+        s.timestamp = rec.timestamp;
+        s.thread_id = rec.thread_id;
+        s.first_timestamp = rec.first_timestamp;
+        s.repeats = rec.repeats;
+        s.truncated = rec.payload.size() + rec.context.size() > sizeof(s.text);
+        const std::size_t room = sizeof(s.text) - (s.truncated ? truncation_marker.size() : 0);
+        s.payload_len = static_cast<std::uint32_t>(std::min(rec.payload.size(), room));
+        s.context_len = static_cast<std::uint32_t>(std::min(rec.context.size(), room - s.payload_len));
+        std::memcpy(s.text, rec.payload.data(), s.payload_len);
+        std::memcpy(s.text + s.payload_len, rec.context.data(), s.context_len);
+        if (s.truncated) {
+            std::memcpy(s.text + s.payload_len + s.context_len, truncation_marker.data(), truncation_marker.size());
+            if (s.payload_len < rec.payload.size())
+                s.payload_len += static_cast<std::uint32_t>(truncation_marker.size());
+            else
+                s.context_len += static_cast<std::uint32_t>(truncation_marker.size());
+        }
+        s.enqueued_at = ::tc::detail::clock_ticks();
+        s.seq.store(pos + 1, std::memory_order_release);
+    }
+
+    void wake() {
+        if (idle_.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(mu_);
+            work_.notify_one();
+        }
+    }
+
+    // Claims the oldest published cell; returns its position, or false when there is none. With `in_order` (the
+    // drain thread of a per-CPU sink), also false while that record's predecessor has not been taken.
+    bool dequeue(std::uint64_t* out, bool in_order = false) {
+        std::uint64_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot& s = slots_[pos & mask_];
+            const auto diff = static_cast<std::int64_t>(s.seq.load(std::memory_order_acquire) - (pos + 1));
+            if (diff == 0) {
+                // If the cell is refilled meanwhile, these reads are stale but the claim below fails.
+                if (in_order && !predecessor_taken(__atomic_load_n(&s.after_queue, __ATOMIC_RELAXED),
+                                                   __atomic_load_n(&s.after_pos, __ATOMIC_RELAXED)))
+                    return false;
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    *out = pos;
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty, or the next record is still being written
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Whether the drain thread has taken (or overwrite_oldest discarded) the record at `pos` of `queue`. Only ever
+    // false for a record published before the one asking, so waiting on it cannot deadlock.
+    bool predecessor_taken(std::uint32_t queue, std::uint64_t pos) const {
+        if (queue == no_queue)
+            return true;
+        if (queue == shared_queue)
+            return dequeue_pos_.load(std::memory_order_relaxed) > pos;
+        return rings_[queue].tail.load(std::memory_order_relaxed) > pos;
+    }
+
+    void release(std::uint64_t pos) {
+        slots_[pos & mask_].seq.store(pos + mask_ + 1, std::memory_order_release);
+    }
+
+    bool discard_oldest() {
+        std::uint64_t pos;
+        if (!dequeue(&pos))
+            return false;
+        release(pos);
+        done_.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    // Copies each batch out of the queues before calling the wrapped sink, so a slow sink holds no cells. With
+    // per-CPU rings, a record is only taken after its thread's previous one (which may sit in another ring or the
+    // shared queue, behind where the last batch stopped), and each batch is sorted by timestamp.
+    void drain() {
+        draining_thread() = this;
+        std::unique_ptr<char[]> text(new char[opt_.batch * TC_ASYNC_RECORD_BYTES]);
+        log::record recs[TC_ASYNC_BATCH_MAX];
+        std::uint32_t first_ring = 0;
+        for (;;) {
+            const std::uint64_t start = ::tc::detail::clock_ticks();
+            std::uint64_t latency = 0, latency_max = 0;
+            std::size_t n = 0, truncated = 0;
+            const auto take = [&](const slot& s) {
+                const std::uint64_t waited = start > s.enqueued_at ? start - s.enqueued_at : 0;
+                latency += waited;
+                latency_max = std::max(latency_max, waited);
+                truncated += s.truncated ? 1 : 0;
+                char* copy = text.get() + n * TC_ASYNC_RECORD_BYTES;
+                std::memcpy(copy, s.text, s.payload_len + s.context_len);
+                const std::string_view payload(copy, s.payload_len);
+                const std::string_view context(copy + s.payload_len, s.context_len);
+                recs[n++] = log::record{s.level, s.line, s.file, s.func, s.timestamp, s.thread_id, payload, context,
+                                        s.repeats, s.first_timestamp};
+            };
+            std::size_t from_rings = 0;
+            if (rings_ != nullptr) {
+                metrics_->note_depth(backlog());
+                for (std::uint32_t i = 0; i < cpus_ && n < opt_.batch; ++i) {
+                    cpu_ring& r = rings_[(first_ring + i) % cpus_];
+                    std::uint64_t tail = r.tail.load(std::memory_order_relaxed);
+                    const std::uint64_t before = tail;
+                    for (; n < opt_.batch; ++tail) {
+                        const slot& s = r.slots[tail & ring_mask_];
+                        if (s.seq.load(std::memory_order_acquire) != tail + 1 ||
+                            !predecessor_taken(s.after_queue, s.after_pos))
+                            break;
+                        take(s);
+                    }
+                    if (tail != before)
+                        r.tail.store(tail, std::memory_order_release);
+                }
+                first_ring = (first_ring + 1) % cpus_; // no CPU's ring always goes first into a full batch
+                from_rings = n;
+            }
+            std::uint64_t pos;
+            while (n < opt_.batch && dequeue(&pos, rings_ != nullptr)) {
+                take(slots_[pos & mask_]);
+                release(pos);
+            }
+            if (n == 0) {
+                std::unique_lock<std::mutex> lock(mu_);
+                if (stop_ && backlog() == 0)
+                    break;
+                idle_.store(true, std::memory_order_seq_cst);
+                if (!ready()) // the timeout also bounds a wakeup missed by a producer publishing right now
+                    work_.wait_for(lock, std::chrono::milliseconds(10));
+                idle_.store(false, std::memory_order_relaxed);
+                continue;
+            }
+
+            if (space_waiters_.load(std::memory_order_relaxed) != 0) {
+                std::lock_guard<std::mutex> lock(mu_);
+                room_.notify_all();
+            }
+            if (truncated != 0)
+                metrics_->truncated.fetch_add(truncated, std::memory_order_relaxed);
+            if (from_rings != 0) {
+                metrics_->enqueued.fetch_add(from_rings, std::memory_order_relaxed);
+                std::stable_sort(recs, recs + n, [](const log::record& a, const log::record& b) {
+                    return a.timestamp < b.timestamp;
+                });
+            }
+            const std::uint64_t call = ::tc::detail::clock_ticks();
+            downstream_(ctx_, recs, n);
+            const std::uint64_t spent = ::tc::detail::clock_ticks() - call;
+            done_.fetch_add(n, std::memory_order_release);
+
+            const double ns_per_tick = ::tc::detail::clock_ns_per_tick();
+            const auto ns = [ns_per_tick](std::uint64_t ticks) {
+                return static_cast<std::uint64_t>(static_cast<double>(ticks) * ns_per_tick);
+            };
+            metrics_->note_drained(n, ns(latency), ns(latency_max), ns(spent));
+            if (space_waiters_.load(std::memory_order_relaxed) != 0) {
+                std::lock_guard<std::mutex> lock(mu_);
+                room_.notify_all();
+            }
+        }
+        draining_thread() = nullptr;
+    }
+
+    // Whether the drain thread has anything to do; called with mu_ held.
+    bool ready() const {
+        if (stop_)
+            return true;
+        for (std::uint32_t c = 0; c < cpus_; ++c) {
+            const std::uint64_t tail = rings_[c].tail.load(std::memory_order_relaxed);
+            if (rings_[c].slots[tail & ring_mask_].seq.load(std::memory_order_acquire) == tail + 1)
+                return true;
+        }
+        const std::uint64_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        return slots_[pos & mask_].seq.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    // Records reserved but not yet taken by the drain thread, over the shared queue and every ring.
+    std::uint64_t backlog() const {
+        std::uint64_t n = enqueue_pos_.load(std::memory_order_relaxed) - dequeue_pos_.load(std::memory_order_relaxed);
+        for (std::uint32_t c = 0; c < cpus_; ++c)
+            n += ring_head(rings_[c]) - rings_[c].tail.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    log::record_sink_t downstream_;
+    void* ctx_;
+    options opt_;
+    slot* slots_ = nullptr;
+    std::size_t mask_ = 0;
+    ::tc::detail::sink_metrics* metrics_ = nullptr;
+    std::uint64_t id_; // unique per sink, for last_record_of()
+    cpu_ring* rings_ = nullptr; // per-CPU rings, or nullptr
+    std::uint32_t cpus_ = 0;
+    std::size_t ring_mask_ = 0;
+
+    alignas(64) std::atomic<std::uint64_t> enqueue_pos_{0};
+    alignas(64) std::atomic<std::uint64_t> dequeue_pos_{0};
+    alignas(64) std::atomic<std::uint64_t> done_{0}; // records delivered or overwritten
+    std::atomic<bool> idle_{false};                  // the drain thread is (about to be) waiting for work
+    std::atomic<int> space_waiters_{0};              // producers and flush() calls waiting on `room_`
+
+    std::mutex mu_;
+    std::condition_variable work_; // wakes the drain thread
+    std::condition_variable room_; // wakes producers waiting for room and flush()
+    bool stop_ = false;
+    std::thread drain_;
+};
+
+} // namespace async
+} // namespace tc
@@ -0,0 +1,326 @@
+// tc/crash_reporter.hpp
+// Async-signal-safe crash reporter for POSIX systems.
+// - Handles SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT (including TC_ABORT / std::abort) on an alternate stack
+// - Writes a report with only write(2) from preallocated buffers: signal info, the last TC_ABORT context,
+//   registers, a raw backtrace and /proc/self/maps so addresses can be symbolized offline
+// - Chains to the previously installed handler (or the default action) afterwards; other threads that crash
+//   meanwhile wait for the report instead of killing the process half-way through it
+//
+// Usage:
+//   tc::crash::install("/var/tmp/app.crash"); // nullptr: report to stderr only
+//
+// Symbolize offline, e.g. `addr2line -e app -f -C <addr - module base>` using the maps listing in the report.
+
+#pragma once
+
+#include "try_catch.hpp"
+
+#if TC_POSIX
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+
+#if !defined(TC_HAVE_EXECINFO)
+#if __has_include(<execinfo.h>)
+#define TC_HAVE_EXECINFO 1
+#else
+#define TC_HAVE_EXECINFO 0
+#endif
+#endif
+
+#if TC_HAVE_EXECINFO
+#include <execinfo.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__aarch64__)
+#include <ucontext.h>
+#endif
+#endif
+
+#if !defined(TC_CRASH_ALTSTACK_SIZE)
+#define TC_CRASH_ALTSTACK_SIZE (64 * 1024)
+#endif
+
+#if !defined(TC_CRASH_MAX_FRAMES)
+#define TC_CRASH_MAX_FRAMES 64
+#endif
+
+namespace tc {
+namespace detail {
+
+struct crash_state {
+    char path[1024] = {};
+    bool to_stderr = true;
+    bool run_fatal_handlers = false;
+    std::atomic<bool> installed{false};
+    std::atomic<std::uintptr_t> reporter{0}; // crash_thread_id() of the thread writing the report, 0 if none
+    std::atomic<bool> reported{false};
+    struct sigaction previous[NSIG] = {};
+    char report[16 * 1024] = {};
+    alignas(16) char altstack[TC_CRASH_ALTSTACK_SIZE] = {};
+};
+
+inline crash_state& crash_globals() {
+    static crash_state st;
+    return st;
+}
+
+inline const int* crash_signals(int* count) {
+    static const int sigs[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+    *count = static_cast<int>(sizeof(sigs) / sizeof(sigs[0]));
+    return sigs;
+}
+
+inline const char* crash_signal_name(int sig) {
+    switch (sig) {
+    case SIGSEGV:
+        return "SIGSEGV";
+    case SIGBUS:
+        return "SIGBUS";
+    case SIGILL:
+        return "SIGILL";
+    case SIGFPE:
+        return "SIGFPE";
+    case SIGABRT:
+        return "SIGABRT";
+    default:
+        return "signal";
+    }
+}
+
+inline void crash_append_registers(safe_buffer& out, void* uctx) {
+#if defined(__linux__) && defined(__x86_64__)
+    const auto& g = static_cast<ucontext_t*>(uctx)->uc_mcontext.gregs;
+    static const struct {
+        const char* name;
+        int idx;
+    } regs[] = {{"rip", REG_RIP}, {"rsp", REG_RSP}, {"rbp", REG_RBP}, {"rax", REG_RAX}, {"rbx", REG_RBX},
+                {"rcx", REG_RCX}, {"rdx", REG_RDX}, {"rsi", REG_RSI}, {"rdi", REG_RDI}, {"r8", REG_R8},
+                {"r9", REG_R9},   {"r10", REG_R10}, {"r11", REG_R11}, {"r12", REG_R12}, {"r13", REG_R13},
+                {"r14", REG_R14}, {"r15", REG_R15}};
+    out.str("registers:\n");
+    for (std::size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); ++i)
+        out.str("  ").str(regs[i].name).str(" ").hex(static_cast<std::uint64_t>(g[regs[i].idx])).str("\n");
+#elif defined(__linux__) && defined(__aarch64__)
+    const auto& m = static_cast<ucontext_t*>(uctx)->uc_mcontext;
+    out.str("registers:\n  pc ").hex(m.pc).str("\n  sp ").hex(m.sp).str("\n");
+    for (int i = 0; i < 31; ++i)
+        out.str("  x").u64(static_cast<std::uint64_t>(i)).str(" ").hex(m.regs[i]).str("\n");
+#else
+    (void)out;
+    (void)uctx;
+#endif
+}
+
+// Copies /proc/self/maps (Linux) so raw addresses can be mapped to modules offline.
+inline void crash_copy_maps(int fd) {
+#if defined(__linux__)
+    const int maps = ::open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps < 0)
+        return;
+    char chunk[512];
+    safe_write(fd, "maps:\n", 6);
+    for (;;) {
+        const ssize_t n = ::read(maps, chunk, sizeof(chunk));
+        if (n <= 0)
+            break;
+        safe_write(fd, chunk, static_cast<std::size_t>(n));
+    }
+    ::close(maps);
+#else
+    (void)fd;
+#endif
+}
+
+// Nonzero id of the calling thread, from the kernel on Linux and pthread_self() elsewhere.
+inline std::uintptr_t crash_thread_id() {
+#if defined(__linux__)
+    return static_cast<std::uintptr_t>(::syscall(SYS_gettid));
+#else
+    const pthread_t self = ::pthread_self();
+    std::uintptr_t id = 0;
+    std::memcpy(&id, &self, sizeof(self) < sizeof(id) ? sizeof(self) : sizeof(id));
+    return id;
+#endif
+}
+
+inline void crash_handler(int sig, siginfo_t* info, void* uctx) {
+    crash_state& st = crash_globals();
+    const std::uintptr_t self = crash_thread_id();
+    std::uintptr_t expected = 0;
+    if (!st.reporter.compare_exchange_strong(expected, self) && expected != self) {
+        // Another thread is writing the report, and it chains to the previous handler once done, which normally ends
+        // the process. Chaining from here as well would kill it half-way through the report, so wait. If the process
+        // survives the report, return: a fault re-executes and now reaches the restored handler.
+        const timespec nap{0, 10 * 1000 * 1000};
+        while (!st.reported.load(std::memory_order_acquire))
+            ::nanosleep(&nap, nullptr);
+        return;
+    }
+    if (expected == 0) {
+        safe_buffer out{st.report, sizeof(st.report)};
+        out.str("*** tc crash report ***\nsignal: ").i64(sig).str(" (").str(crash_signal_name(sig)).str(")");
+        if (info != nullptr)
+            out.str(" code: ").i64(info->si_code).str(" addr: ").hex(reinterpret_cast<std::uintptr_t>(info->si_addr));
+        out.str("\npid: ").i64(static_cast<std::int64_t>(::getpid()));
+#if defined(__linux__)
+        out.str(" tid: ").i64(static_cast<std::int64_t>(::syscall(SYS_gettid)));
+#endif
+        out.str("\n");
+
+        const abort_context& ctx = last_abort_context();
+        if (const char* msg = ctx.msg.load(std::memory_order_acquire)) {
+            out.str("abort: ")
+                .str(ctx.file.load(std::memory_order_relaxed))
+                .str(":")
+                .i64(ctx.line.load(std::memory_order_relaxed))
+                .str(" in ")
+                .str(ctx.func.load(std::memory_order_relaxed))
+                .str("\n  msg: ")
+                .str(msg)
+                .str("\n");
+        }
+        crash_append_registers(out, uctx);
+
+#if TC_HAVE_EXECINFO
+        void* frames[TC_CRASH_MAX_FRAMES];
+        const int n = ::backtrace(frames, TC_CRASH_MAX_FRAMES);
+        out.str("backtrace:\n");
+        for (int i = 0; i < n; ++i)
+            out.str("  #").i64(i).str(" ").hex(reinterpret_cast<std::uintptr_t>(frames[i])).str("\n");
+#endif
+
+        if (st.to_stderr)
+            safe_write(2, st.report, out.len);
+        if (st.path[0] != '\0') {
+            const int fd = ::open(st.path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd >= 0) {
+                safe_write(fd, st.report, out.len);
+                crash_copy_maps(fd);
+                ::close(fd);
+            }
+        }
+        // After the report is safely on disk: handlers are not required to be async-signal-safe.
+        if (st.run_fatal_handlers)
+            run_fatal_handlers({fatal::reason::signal, nullptr, 0, nullptr, nullptr, sig});
+
+        // One report per process: hand every crash signal back before releasing the threads that waited for it.
+        int count = 0;
+        const int* sigs = crash_signals(&count);
+        for (int i = 0; i < count; ++i)
+            ::sigaction(sigs[i], &st.previous[sigs[i]], nullptr);
+        st.reported.store(true, std::memory_order_release);
+    }
+
+    // Hand the signal to whoever was installed before us (or the default action, which dumps core).
+    ::sigaction(sig, &st.previous[sig], nullptr);
+    if (st.previous[sig].sa_flags & SA_SIGINFO) {
+        if (st.previous[sig].sa_sigaction != nullptr) {
+            st.previous[sig].sa_sigaction(sig, info, uctx);
+            return;
+        }
+    } else if (st.previous[sig].sa_handler != SIG_DFL && st.previous[sig].sa_handler != SIG_IGN) {
+        st.previous[sig].sa_handler(sig);
+        return;
+    }
+    ::raise(sig);
+}
+
+} // namespace detail
+
+namespace crash {
+
+// Give the calling thread an alternate signal stack so stack overflows can still be reported. install() does
+// this for the installing thread; the buffer is allocated here, never inside the handler.
+inline bool enable_alt_stack_for_this_thread(std::size_t size = TC_CRASH_ALTSTACK_SIZE) {
+    stack_t ss{};
+    ss.ss_sp = std::malloc(size);
+    if (ss.ss_sp == nullptr)
+        return false;
+    ss.ss_size = size;
+    if (::sigaltstack(&ss, nullptr) != 0) {
+        std::free(ss.ss_sp);
+        return false;
+    }
+    return true;
+}
+
+// Install handlers for fatal signals. `path` receives the report (truncated on each crash); pass nullptr to only
+// write to stderr. With `run_fatal_handlers`, the tc::fatal chain runs after the report is written (it has
+// already run for TC_ABORT). Returns false if already installed, or if the alternate stack or a handler could not
+// be set: then every handler changed so far is restored, errno tells why, and install() can be called again.
+inline bool install(const char* path, bool also_stderr = true, bool run_fatal_handlers = false) {
+    using namespace ::tc::detail;
+    crash_state& st = crash_globals();
+    bool expected = false;
+    if (!st.installed.compare_exchange_strong(expected, true))
+        return false;
+
+    st.path[0] = '\0';
+    if (path != nullptr) {
+        safe_buffer p{st.path, sizeof(st.path) - 1};
+        p.str(path);
+        st.path[p.len] = '\0';
+    }
+    st.to_stderr = also_stderr;
+    st.run_fatal_handlers = run_fatal_handlers;
+
+#if TC_HAVE_EXECINFO
+    // backtrace() may load libgcc and allocate on first use; do that now rather than inside the handler.
+    void* warm[1];
+    (void)::backtrace(warm, 1);
+#endif
+
+    stack_t ss{};
+    ss.ss_sp = st.altstack;
+    ss.ss_size = sizeof(st.altstack);
+    stack_t previous_ss{};
+    if (::sigaltstack(&ss, &previous_ss) != 0) {
+        st.installed.store(false);
+        return false;
+    }
+
+    struct sigaction sa{};
+    sa.sa_sigaction = &crash_handler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    int count = 0;
+    const int* sigs = crash_signals(&count);
+    for (int i = 0; i < count; ++i) {
+        if (::sigaction(sigs[i], &sa, &st.previous[sigs[i]]) != 0) {
+            const int err = errno;
+            while (i-- > 0)
+                ::sigaction(sigs[i], &st.previous[sigs[i]], nullptr);
+            ::sigaltstack(&previous_ss, nullptr);
+            st.installed.store(false);
+            errno = err;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Restore the handlers that were active before install().
+inline void uninstall() {
+    using namespace ::tc::detail;
+    crash_state& st = crash_globals();
+    if (!st.installed.load())
+        return;
+    int count = 0;
+    const int* sigs = crash_signals(&count);
+    for (int i = 0; i < count; ++i)
+        ::sigaction(sigs[i], &st.previous[sigs[i]], nullptr);
+    st.installed.store(false);
+}
+
+} // namespace crash
+} // namespace tc
+
+#endif // TC_POSIX
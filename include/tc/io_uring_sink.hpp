@@ -0,0 +1,426 @@
+// tc/io_uring_sink.hpp
+// Asynchronous log file writer for Linux built on io_uring, using the raw syscalls (no liburing).
+// - Records are formatted into large page-aligned buffers. A full buffer is submitted as one IORING_OP_WRITE_FIXED
+//   against buffers registered with the ring, so logging threads do not block in write(2)
+// - At most `options::buffers` writes are in flight; a producer only waits when every buffer is still in flight
+// - Kernels without io_uring (or where it is disabled) fall back to one pwritev(2) per window of filled buffers
+//
+// Usage:
+//   static tc::uring::file_sink file("/var/log/app.log");
+//   int id = tc::log::add_sink(&tc::uring::file_sink::sink, &file, tc::log::level::info, 64);
+//   ...
+//   tc::log::remove_sink(id); // then file.flush(), or let the destructor drain it
+
+#pragma once
+
+#include "try_catch.hpp"
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#if !defined(TC_HAVE_IO_URING)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#define TC_HAVE_IO_URING 1
+#else
+#define TC_HAVE_IO_URING 0
+#endif
+#endif
+
+#if TC_HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#if !defined(TC_URING_MAX_BUFFERS)
+#define TC_URING_MAX_BUFFERS 64
+#endif
+
+namespace tc {
+namespace uring {
+
+struct options {
+    std::size_t buffer_size = 256 * 1024; // bytes per buffer, rounded up to the page size
+    unsigned buffers = 8;                 // in-flight window, at most TC_URING_MAX_BUFFERS
+    bool truncate = false;                // otherwise append to an existing file
+    bool use_io_uring = true;             // false forces the pwritev fallback
+    log::level flush_level = log::level::error; // records at or above this submit the current buffer right away
+};
+
+struct stats {
+    std::uint64_t records = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t submissions = 0; // io_uring writes, or pwritev calls in fallback mode
+    std::uint64_t waits = 0;       // times a producer waited for a free buffer
+    std::uint64_t errors = 0;      // failed writes (the data is retried once with pwrite)
+};
+
+class file_sink {
+  public:
+    explicit file_sink(const char* path, const options& opt = options()) {
+        const long page = ::sysconf(_SC_PAGESIZE);
+        page_ = page > 0 ? static_cast<std::size_t>(page) : 4096;
+        size_ = (std::max<std::size_t>(opt.buffer_size, page_) + page_ - 1) / page_ * page_;
+        count_ = std::min<unsigned>(std::max(opt.buffers, 2u), TC_URING_MAX_BUFFERS);
+        flush_level_ = opt.flush_level;
+
+        fd_ = ::open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (opt.truncate ? O_TRUNC : 0), 0644);
+        if (fd_ < 0)
+            return;
+        const off_t end = ::lseek(fd_, 0, SEEK_END);
+        offset_ = end > 0 ? static_cast<std::uint64_t>(end) : 0;
+        pool_ = static_cast<char*>(std::aligned_alloc(page_, size_ * count_));
+        if (pool_ == nullptr) {
+            ::close(fd_);
+            fd_ = -1;
+            return;
+        }
+#if TC_HAVE_IO_URING
+        if (opt.use_io_uring)
+            setup_ring();
+#endif
+    }
+
+    ~file_sink() {
+        flush();
+#if TC_HAVE_IO_URING
+        teardown_ring();
+#endif
+        std::free(pool_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    file_sink(const file_sink&) = delete;
+    file_sink& operator=(const file_sink&) = delete;
+
+    bool ok() const {
+        return fd_ >= 0;
+    }
+    bool using_io_uring() const {
+        return ring_.fd >= 0;
+    }
+
+    // tc::log record sink; register with a batch size > 1 so one call formats many records.
+    static void sink(void* ctx, const log::record* recs, std::size_t n) {
+        static_cast<file_sink*>(ctx)->write(recs, n);
+    }
+
+    void write(const log::record* recs, std::size_t n) {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (fd_ < 0)
+            return;
+        bool urgent = false;
+        for (std::size_t i = 0; i < n; ++i) {
+            const log::record& r = recs[i];
+            const std::size_t need = ::tc::detail::record_line_bound(r);
+            if (cur_ < 0 || fill_[cur_] + need > size_) {
+                if (cur_ >= 0)
+                    submit_current();
+                cur_ = acquire_buffer();
+            }
+            ::tc::detail::safe_buffer out{pool_ + static_cast<std::size_t>(cur_) * size_ + fill_[cur_],
+                                          size_ - fill_[cur_]};
+            ::tc::detail::append_record_line(out, r);
+            fill_[cur_] += out.len;
+            stats_.bytes += out.len;
+            urgent = urgent || r.level >= flush_level_;
+        }
+        stats_.records += n;
+        if (urgent && cur_ >= 0) {
+            submit_current();
+            if (ring_.fd < 0)
+                write_pending();
+        }
+    }
+
+    // Submits the partially filled buffer and returns once every write has completed.
+    void flush() {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (fd_ < 0)
+            return;
+        if (cur_ >= 0)
+            submit_current();
+#if TC_HAVE_IO_URING
+        while (ring_.fd >= 0 && in_flight_ > 0)
+            wait_completion();
+#endif
+        write_pending();
+    }
+
+    stats get_stats() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        return stats_;
+    }
+
+  private:
+    enum : unsigned char { free_, filling, pending, in_flight };
+
+    struct ring_state {
+        int fd = -1;
+        bool fixed = false; // buffers registered, use WRITE_FIXED
+        void* sq_map = nullptr;
+        std::size_t sq_len = 0;
+        void* cq_map = nullptr;
+        std::size_t cq_len = 0;
+        void* sqe_map = nullptr;
+        std::size_t sqe_len = 0;
+        unsigned* sq_tail = nullptr;
+        unsigned* sq_mask = nullptr;
+        unsigned* sq_array = nullptr;
+        unsigned* cq_head = nullptr;
+        unsigned* cq_tail = nullptr;
+        unsigned* cq_mask = nullptr;
+#if TC_HAVE_IO_URING
+        io_uring_sqe* sqes = nullptr;
+        io_uring_cqe* cqes = nullptr;
+#endif
+    };
+
+    char* buffer(int i) const {
+        return pool_ + static_cast<std::size_t>(i) * size_;
+    }
+
+    int acquire_buffer() {
+        for (;;) {
+            for (unsigned k = 0; k < count_; ++k) {
+                const int i = static_cast<int>((next_ + k) % count_);
+                if (state_[i] == free_) {
+                    next_ = static_cast<unsigned>(i) + 1;
+                    state_[i] = filling;
+                    fill_[i] = 0;
+                    return i;
+                }
+            }
+            ++stats_.waits;
+#if TC_HAVE_IO_URING
+            if (ring_.fd >= 0 && in_flight_ > 0) {
+                wait_completion();
+                continue;
+            }
+#endif
+            write_pending();
+        }
+    }
+
+    // Assigns the file range now, so completions may arrive in any order.
+    void submit_current() {
+        const int i = cur_;
+        cur_ = -1;
+        if (fill_[i] == 0) {
+            state_[i] = free_;
+            return;
+        }
+        off_[i] = offset_;
+        offset_ += fill_[i];
+        state_[i] = pending;
+        order_[pending_count_++] = i;
+#if TC_HAVE_IO_URING
+        if (ring_.fd >= 0)
+            submit_pending();
+#endif
+    }
+
+    // Fallback (and io_uring error path): one pwritev per run of file-contiguous pending buffers.
+    void write_pending() {
+        std::size_t k = 0;
+        while (k < pending_count_) {
+            iovec iov[TC_URING_MAX_BUFFERS];
+            int n = 0;
+            const std::uint64_t start = off_[order_[k]];
+            std::uint64_t end = start;
+            while (k + n < pending_count_ && off_[order_[k + n]] == end) {
+                const int i = order_[k + n];
+                iov[n] = {buffer(i), fill_[i]};
+                end += fill_[i];
+                ++n;
+            }
+            ++stats_.submissions;
+            const ssize_t w = ::pwritev(fd_, iov, n, static_cast<off_t>(start));
+            std::size_t done = w > 0 ? static_cast<std::size_t>(w) : 0;
+            if (w < 0)
+                ++stats_.errors;
+            for (int j = 0; j < n; ++j) {
+                const int i = order_[k + j];
+                const std::size_t from = std::min(done, fill_[i]);
+                done -= from;
+                if (from < fill_[i])
+                    write_sync(buffer(i) + from, fill_[i] - from, off_[i] + from);
+                state_[i] = free_;
+            }
+            k += static_cast<std::size_t>(n);
+        }
+        pending_count_ = 0;
+    }
+
+    void write_sync(const char* data, std::size_t len, std::uint64_t off) {
+        while (len > 0) {
+            const ssize_t w = ::pwrite(fd_, data, len, static_cast<off_t>(off));
+            if (w <= 0) {
+                ++stats_.errors;
+                return;
+            }
+            data += w;
+            len -= static_cast<std::size_t>(w);
+            off += static_cast<std::uint64_t>(w);
+        }
+    }
+
+#if TC_HAVE_IO_URING
+    static int sys_setup(unsigned entries, io_uring_params* p) {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+    }
+    static int sys_enter(int fd, unsigned submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, submit, min_complete, flags, nullptr, 0));
+    }
+    static int sys_register(int fd, unsigned op, const void* arg, unsigned n) {
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, op, arg, n));
+    }
+
+    void setup_ring() {
+        io_uring_params p{};
+        const int fd = sys_setup(count_, &p);
+        if (fd < 0)
+            return; // ENOSYS, EPERM (seccomp, io_uring_disabled): stay on pwritev
+        ring_.sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        ring_.cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+            ring_.sq_len = ring_.cq_len = std::max(ring_.sq_len, ring_.cq_len);
+        ring_.sq_map = ::mmap(nullptr, ring_.sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                              IORING_OFF_SQ_RING);
+        ring_.cq_map = single ? ring_.sq_map
+                              : ::mmap(nullptr, ring_.cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                       IORING_OFF_CQ_RING);
+        ring_.sqe_len = p.sq_entries * sizeof(io_uring_sqe);
+        ring_.sqe_map = ::mmap(nullptr, ring_.sqe_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_SQES);
+        if (ring_.sq_map == MAP_FAILED || ring_.cq_map == MAP_FAILED || ring_.sqe_map == MAP_FAILED) {
+            ring_.fd = fd;
+            teardown_ring();
+            return;
+        }
+        char* sq = static_cast<char*>(ring_.sq_map);
+        char* cq = static_cast<char*>(ring_.cq_map);
+        ring_.sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        ring_.sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        ring_.sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        ring_.cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        ring_.cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        ring_.cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        ring_.cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        ring_.sqes = static_cast<io_uring_sqe*>(ring_.sqe_map);
+        ring_.fd = fd;
+
+        // Registration pins the pages once instead of on every write; it can fail under RLIMIT_MEMLOCK.
+        iovec iov[TC_URING_MAX_BUFFERS];
+        for (unsigned i = 0; i < count_; ++i)
+            iov[i] = {buffer(static_cast<int>(i)), size_};
+        ring_.fixed = sys_register(fd, IORING_REGISTER_BUFFERS, iov, count_) == 0;
+    }
+
+    void teardown_ring() {
+        if (ring_.fd < 0)
+            return;
+        if (ring_.sqe_map != nullptr && ring_.sqe_map != MAP_FAILED)
+            ::munmap(ring_.sqe_map, ring_.sqe_len);
+        if (ring_.cq_map != nullptr && ring_.cq_map != MAP_FAILED && ring_.cq_map != ring_.sq_map)
+            ::munmap(ring_.cq_map, ring_.cq_len);
+        if (ring_.sq_map != nullptr && ring_.sq_map != MAP_FAILED)
+            ::munmap(ring_.sq_map, ring_.sq_len);
+        ::close(ring_.fd);
+        ring_ = ring_state();
+    }
+
+    void submit_pending() {
+        for (std::size_t k = 0; k < pending_count_; ++k) {
+            const int i = order_[k];
+            const unsigned tail = *ring_.sq_tail;
+            const unsigned idx = tail & *ring_.sq_mask;
+            io_uring_sqe* sqe = &ring_.sqes[idx];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->fd = fd_;
+            sqe->off = off_[i];
+            sqe->user_data = static_cast<std::uint64_t>(i);
+            if (ring_.fixed) {
+                sqe->opcode = IORING_OP_WRITE_FIXED;
+                sqe->addr = reinterpret_cast<std::uint64_t>(buffer(i));
+                sqe->len = static_cast<std::uint32_t>(fill_[i]);
+                sqe->buf_index = static_cast<std::uint16_t>(i);
+            } else {
+                iov_[i] = {buffer(i), fill_[i]};
+                sqe->opcode = IORING_OP_WRITEV;
+                sqe->addr = reinterpret_cast<std::uint64_t>(&iov_[i]);
+                sqe->len = 1;
+            }
+            ring_.sq_array[idx] = idx;
+            __atomic_store_n(ring_.sq_tail, tail + 1, __ATOMIC_RELEASE);
+            if (sys_enter(ring_.fd, 1, 0, 0) != 1) {
+                // Roll back and write this one synchronously; later buffers retry on the next submission.
+                __atomic_store_n(ring_.sq_tail, tail, __ATOMIC_RELEASE);
+                ++stats_.errors;
+                write_sync(buffer(i), fill_[i], off_[i]);
+                state_[i] = free_;
+                continue;
+            }
+            state_[i] = in_flight;
+            ++in_flight_;
+            ++stats_.submissions;
+        }
+        pending_count_ = 0;
+    }
+
+    void reap() {
+        unsigned head = *ring_.cq_head;
+        const unsigned tail = __atomic_load_n(ring_.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = ring_.cqes[head & *ring_.cq_mask];
+            const int i = static_cast<int>(cqe.user_data);
+            const std::size_t done = cqe.res > 0 ? static_cast<std::size_t>(cqe.res) : 0;
+            if (cqe.res < 0)
+                ++stats_.errors;
+            if (done < fill_[i])
+                write_sync(buffer(i) + done, fill_[i] - done, off_[i] + done); // short write or error
+            state_[i] = free_;
+            --in_flight_;
+        }
+        __atomic_store_n(ring_.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    void wait_completion() {
+        reap();
+        if (in_flight_ == 0)
+            return;
+        sys_enter(ring_.fd, 0, 1, IORING_ENTER_GETEVENTS);
+        reap();
+    }
+#endif
+
+    mutable std::mutex mu_;
+    int fd_ = -1;
+    char* pool_ = nullptr;
+    std::size_t page_ = 4096;
+    std::size_t size_ = 0;
+    unsigned count_ = 0;
+    unsigned next_ = 0;
+    int cur_ = -1;
+    unsigned in_flight_ = 0;
+    std::size_t pending_count_ = 0;
+    std::uint64_t offset_ = 0;
+    log::level flush_level_ = log::level::error;
+    unsigned char state_[TC_URING_MAX_BUFFERS] = {};
+    std::size_t fill_[TC_URING_MAX_BUFFERS] = {};
+    std::uint64_t off_[TC_URING_MAX_BUFFERS] = {};
+    int order_[TC_URING_MAX_BUFFERS] = {};
+    iovec iov_[TC_URING_MAX_BUFFERS] = {};
+    ring_state ring_;
+    stats stats_;
+};
+
+} // namespace uring
+} // namespace tc
+
+#endif // __linux__
@@ -0,0 +1,371 @@
+// tc/mmap_ring_sink.hpp
+// Crash-surviving circular log file for POSIX, shared through mmap(2).
+// - Producers reserve space with one atomic fetch-add on the write cursor in the file header and copy the formatted
+//   record into the shared mapping; the logging path makes no system calls
+// - The pages belong to the file, so everything committed before a crash is still there afterwards, without fsync
+// - Each record carries its absolute ring position, so readers detect records that were overwritten while they
+//   read them and resynchronize after records that a crashing producer left half written
+// - `tc_logtail` (tools/tc_logtail.cpp) follows the file live or dumps what survived a crash
+//
+// Usage:
+//   static tc::ring::mmap_sink ring("/dev/shm/app.tclog", 16 << 20);
+//   tc::log::add_sink(&tc::ring::mmap_sink::sink, &ring);
+//
+// File layout: a 4 KiB header (magic, capacity, write cursor, generation), then `capacity` bytes of records. Each
+// record is a 32-byte header followed by its text line, padded to 32 bytes; a record never wraps, the tail of the
+// ring is filled with a padding record instead.
+
+#pragma once
+
+#include "try_catch.hpp"
+
+#if TC_POSIX
+
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace tc {
+namespace ring {
+
+inline constexpr char file_magic[8] = {'T', 'C', 'R', 'I', 'N', 'G', '1', '\0'};
+inline constexpr std::size_t file_header_size = 4096;
+inline constexpr std::uint32_t file_version = 1;
+
+struct file_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::uint64_t capacity;                  // bytes of record space, a power of two
+    std::atomic<std::uint64_t> write_cursor; // total bytes ever reserved; position & (capacity - 1) is the offset
+    std::atomic<std::uint64_t> generation;   // bumped each time a producer attaches
+};
+
+enum record_state : std::uint32_t { writing = 0, committed = 1, padding = 2 };
+
+struct record_header {
+    std::atomic<std::uint64_t> pos; // absolute position this record was reserved at
+    std::uint32_t size;             // whole record including this header, a multiple of 32
+    std::atomic<std::uint32_t> state;
+    std::uint64_t timestamp; // nanoseconds since the Unix epoch
+    std::uint32_t thread_id;
+    std::uint8_t level;
+    std::uint8_t reserved[3];
+};
+static_assert(sizeof(record_header) == 32, "ring record header must stay 32 bytes");
+
+} // namespace ring
+
+namespace detail {
+inline constexpr std::size_t ring_align = 32;
+
+inline std::size_t ring_round_up(std::size_t n) {
+    return (n + ring_align - 1) & ~(ring_align - 1);
+}
+
+// Maps the whole file; returns nullptr on failure. `len` receives the mapping size.
+inline void* ring_map_file(int fd, bool writable, std::size_t* len) {
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(ring::file_header_size))
+        return nullptr;
+    *len = static_cast<std::size_t>(st.st_size);
+    void* p = ::mmap(nullptr, *len, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    return p == MAP_FAILED ? nullptr : p;
+}
+
+inline bool ring_header_valid(const ring::file_header* h, std::size_t mapped) {
+    using namespace ring;
+    return std::memcmp(h->magic, file_magic, sizeof(file_magic)) == 0 && h->version == file_version &&
+           h->header_size == file_header_size && h->capacity != 0 && (h->capacity & (h->capacity - 1)) == 0 &&
+           file_header_size + h->capacity <= mapped;
+}
+} // namespace detail
+
+namespace ring {
+
+// Producer side: a v2 record sink. Safe to call from any number of threads and processes mapping the same file.
+class mmap_sink {
+  public:
+    // Opens or creates `path`. An existing ring with the same capacity is continued (its records stay readable);
+    // otherwise the file is reinitialized. `capacity` is rounded up to a power of two, at least 64 KiB.
+    explicit mmap_sink(const char* path, std::size_t capacity = 16u << 20) {
+        std::size_t cap = 64 * 1024;
+        while (cap < capacity)
+            cap <<= 1;
+        fd_ = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0)
+            return;
+        struct stat st {};
+        const bool reuse = ::fstat(fd_, &st) == 0 && static_cast<std::size_t>(st.st_size) == file_header_size + cap;
+        if (!reuse && ::ftruncate(fd_, static_cast<off_t>(file_header_size + cap)) != 0) {
+            close_file();
+            return;
+        }
+        void* p = ::tc::detail::ring_map_file(fd_, true, &len_);
+        if (p == nullptr) {
+            close_file();
+            return;
+        }
+        base_ = static_cast<char*>(p);
+        auto* h = header();
+        if (!reuse || !::tc::detail::ring_header_valid(h, len_) || h->capacity != cap) {
+            std::memset(base_, 0, len_);
+            h->version = file_version;
+            h->header_size = file_header_size;
+            h->capacity = cap;
+            std::memcpy(h->magic, file_magic, sizeof(file_magic)); // last: readers check the magic first
+        }
+        mask_ = cap - 1;
+        generation_ = h->generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+
+    ~mmap_sink() {
+        if (base_ != nullptr)
+            ::munmap(base_, len_);
+        close_file();
+    }
+
+    mmap_sink(const mmap_sink&) = delete;
+    mmap_sink& operator=(const mmap_sink&) = delete;
+
+    bool ok() const {
+        return base_ != nullptr;
+    }
+    std::uint64_t generation() const {
+        return generation_;
+    }
+
+    static void sink(void* ctx, const log::record* recs, std::size_t n) {
+        static_cast<mmap_sink*>(ctx)->write(recs, n);
+    }
+
+    void write(const log::record* recs, std::size_t n) {
+        if (base_ == nullptr)
+            return;
+        char line[TC_LOG_MESSAGE_MAX + TC_LOG_CONTEXT_BYTES + 1024];
+        for (std::size_t i = 0; i < n; ++i) {
+            ::tc::detail::safe_buffer out{line, sizeof(line)};
+            ::tc::detail::append_record_line(out, recs[i]);
+            const std::uint64_t ts = log::timestamp_to_unix_ns(recs[i].timestamp);
+            append(line, out.len, ts, static_cast<std::uint32_t>(recs[i].thread_id),
+                   static_cast<std::uint8_t>(recs[i].level));
+        }
+    }
+
+    // Appends one record; `text` should end with '\n'. Returns false if it can never fit in the ring.
+    bool append(const char* text, std::size_t len, std::uint64_t unix_ns, std::uint32_t tid, std::uint8_t level) {
+        const std::size_t size = ::tc::detail::ring_round_up(sizeof(record_header) + len);
+        if (base_ == nullptr || size > (mask_ + 1) / 4)
+            return false;
+        for (;;) {
+            const std::uint64_t pos = header()->write_cursor.fetch_add(size, std::memory_order_relaxed);
+            const std::size_t off = static_cast<std::size_t>(pos & mask_);
+            const std::size_t room = mask_ + 1 - off;
+            if (size <= room) {
+                record_header* r = begin(pos, size);
+                r->timestamp = unix_ns;
+                r->thread_id = tid;
+                r->level = level;
+                char* body = reinterpret_cast<char*>(r + 1);
+                std::memcpy(body, text, len);
+                std::memset(body + len, 0, size - sizeof(record_header) - len); // readers stop at the first NUL
+                r->state.store(committed, std::memory_order_release);
+                return true;
+            }
+            // The reservation straddles the end: mark both halves as padding and reserve again.
+            begin(pos, room)->state.store(padding, std::memory_order_release);
+            begin(pos + room, size - room)->state.store(padding, std::memory_order_release);
+        }
+    }
+
+  private:
+    file_header* header() const {
+        return reinterpret_cast<file_header*>(base_);
+    }
+
+    // Claims the slot for `pos`: invalidate first, so readers that copied the old contents notice the overwrite.
+    record_header* begin(std::uint64_t pos, std::size_t size) {
+        auto* r = reinterpret_cast<record_header*>(base_ + file_header_size + (pos & mask_));
+        r->state.store(writing, std::memory_order_relaxed);
+        r->pos.store(pos, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+        r->size = static_cast<std::uint32_t>(size);
+        return r;
+    }
+
+    void close_file() {
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+    }
+
+    int fd_ = -1;
+    char* base_ = nullptr;
+    std::size_t len_ = 0;
+    std::uint64_t mask_ = 0;
+    std::uint64_t generation_ = 0;
+};
+
+// Consumer side, used by tc_logtail. Maps the file read-only; never blocks the producers.
+class reader {
+  public:
+    struct entry {
+        std::uint64_t pos;
+        std::uint64_t timestamp; // nanoseconds since the Unix epoch
+        std::uint32_t thread_id;
+        log::level level;
+        std::string_view text; // valid until the next call to next()
+    };
+
+    enum class result { record, caught_up, pending };
+
+    explicit reader(const char* path) {
+        fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0)
+            return;
+        void* p = ::tc::detail::ring_map_file(fd_, false, &len_);
+        if (p == nullptr)
+            return;
+        base_ = static_cast<const char*>(p);
+        if (!::tc::detail::ring_header_valid(header(), len_)) {
+            ::munmap(const_cast<char*>(base_), len_);
+            base_ = nullptr;
+            return;
+        }
+        mask_ = header()->capacity - 1;
+        seek_oldest();
+    }
+
+    ~reader() {
+        if (base_ != nullptr)
+            ::munmap(const_cast<char*>(base_), len_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    reader(const reader&) = delete;
+    reader& operator=(const reader&) = delete;
+
+    bool ok() const {
+        return base_ != nullptr;
+    }
+    std::uint64_t generation() const {
+        return header()->generation.load(std::memory_order_acquire);
+    }
+    std::uint64_t position() const {
+        return pos_;
+    }
+    // Bytes skipped because they were overwritten before being read, or left torn by a crashed producer.
+    std::uint64_t lost() const {
+        return lost_;
+    }
+
+    void seek_oldest() {
+        const std::uint64_t end = header()->write_cursor.load(std::memory_order_acquire);
+        pos_ = end > mask_ + 1 ? end - (mask_ + 1) : 0;
+        if (pos_ != 0)
+            resync(end);
+    }
+    void seek_end() {
+        pos_ = header()->write_cursor.load(std::memory_order_acquire);
+    }
+
+    // `pending` means a record at the read position is still being written. A live follower retries later; after
+    // a crash, call skip_torn() to resynchronize past it.
+    result next(entry& out) {
+        for (;;) {
+            const std::uint64_t end = header()->write_cursor.load(std::memory_order_acquire);
+            if (pos_ >= end)
+                return result::caught_up;
+            if (end - pos_ > mask_ + 1) {
+                lost_ += end - (mask_ + 1) - pos_; // lapped by the producers
+                pos_ = end - (mask_ + 1);
+                resync(end);
+                continue;
+            }
+            // The stamp is loaded first: begin() publishes it after marking the slot `writing`, so a stamp from this
+            // lap can never be paired with the committed state of the record it replaced.
+            const record_header* r = at(pos_);
+            const std::uint64_t stamp = r->pos.load(std::memory_order_acquire);
+            const std::uint32_t state = r->state.load(std::memory_order_acquire);
+            const std::uint32_t size = r->size;
+            if (stamp > pos_)
+                continue; // overwritten by a later lap since `end` was read
+            if (stamp != pos_ || state == writing)
+                return result::pending;
+            if (size < sizeof(record_header) || size % ::tc::detail::ring_align != 0 ||
+                (pos_ & mask_) + size > mask_ + 1) {
+                skip_torn();
+                continue;
+            }
+            if (state == padding) {
+                pos_ += size;
+                continue;
+            }
+            const std::size_t len = size - sizeof(record_header);
+            text_.resize(len);
+            std::memcpy(&text_[0], reinterpret_cast<const char*>(r + 1), len);
+            out.timestamp = r->timestamp;
+            out.thread_id = r->thread_id;
+            out.level = static_cast<log::level>(r->level);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (r->pos.load(std::memory_order_relaxed) != pos_ ||
+                r->state.load(std::memory_order_relaxed) != committed) {
+                continue; // overwritten while copying; the lap check above moves us forward
+            }
+            const std::size_t nul = text_.find('\0');
+            out.pos = pos_;
+            out.text = std::string_view(text_.data(), nul == std::string::npos ? len : nul);
+            pos_ += size;
+            return result::record;
+        }
+    }
+
+    // Skips the record at the read position (left half written by a crashed producer): by its size if that much
+    // was written, otherwise by scanning forward for the next slot stamped with its own position.
+    void skip_torn() {
+        const std::uint64_t end = header()->write_cursor.load(std::memory_order_acquire);
+        const std::uint64_t from = pos_;
+        const record_header* r = at(pos_);
+        const std::uint32_t size = r->size;
+        if (r->pos.load(std::memory_order_relaxed) == pos_ && size >= sizeof(record_header) &&
+            size % ::tc::detail::ring_align == 0 && (pos_ & mask_) + size <= mask_ + 1) {
+            pos_ += size;
+        } else {
+            pos_ += ::tc::detail::ring_align;
+            resync(end);
+        }
+        lost_ += pos_ - from;
+    }
+
+  private:
+    const file_header* header() const {
+        return reinterpret_cast<const file_header*>(base_);
+    }
+    const record_header* at(std::uint64_t pos) const {
+        return reinterpret_cast<const record_header*>(base_ + file_header_size + (pos & mask_));
+    }
+
+    // Advances pos_ to the first 32-byte slot whose header carries its own absolute position.
+    void resync(std::uint64_t end) {
+        for (; pos_ < end; pos_ += ::tc::detail::ring_align) {
+            const record_header* r = at(pos_);
+            if (r->pos.load(std::memory_order_relaxed) == pos_)
+                return;
+        }
+    }
+
+    int fd_ = -1;
+    const char* base_ = nullptr;
+    std::size_t len_ = 0;
+    std::uint64_t mask_ = 0;
+    std::uint64_t pos_ = 0;
+    std::uint64_t lost_ = 0;
+    std::string text_;
+};
+
+} // namespace ring
+} // namespace tc
+
+#endif // TC_POSIX
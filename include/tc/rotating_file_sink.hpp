@@ -0,0 +1,385 @@
+// tc/rotating_file_sink.hpp
+// Log file for POSIX that rotates itself by size and by age and keeps a bounded number of old segments, so no
+// external rotator (and no pipe from stderr into it) is needed.
+// - Records go through a tc::async::buffered_sink: only its drain thread formats, writes and rotates, so a rename
+//   or reopen never runs on a logging thread
+// - The queue keeps TC_ASYNC_RECORD_BYTES of message and context per record, by default all a TC_LOG_* record can
+//   carry; a longer record is written cut short, ending in "[truncated]" (see sink_stats::truncated)
+// - Rotation renames the file to `<path>.<UTC time>`, opens a new one and swaps it in as the current descriptor
+// - Rotated segments can be compressed by a child process (`gzip -f <segment>` by default) that the drain thread
+//   starts with posix_spawn and reaps without waiting for it
+// - Segments beyond `options::max_files` are deleted oldest first, including ones left by earlier runs; one still
+//   being compressed is deleted once its compressor has exited
+//
+// Usage:
+//   tc::rotate::options opt;
+//   opt.max_bytes = 64 << 20;
+//   opt.interval_ms = 24 * 3600 * 1000;
+//   opt.compress = true;
+//   static tc::rotate::file_sink file("/var/log/app.log", opt);
+//   tc::log::add_sink(&tc::rotate::file_sink::sink, &file);
+
+#pragma once
+
+#include "async_sink.hpp"
+
+#if TC_POSIX
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <vector>
+
+extern "C" char** environ;
+
+namespace tc {
+namespace rotate {
+
+struct options {
+    std::uint64_t max_bytes = 64ull << 20; // rotate before the file would grow past this; 0 for no size limit
+    std::uint64_t interval_ms = 0;         // rotate at the first write this long after the file was opened; 0 for never
+    unsigned max_files = 8;                // rotated segments kept, oldest deleted first; 0 to keep all
+    bool compress = false;                 // compress each rotated segment in a child process
+    const char* compressor = "gzip";       // looked up in PATH and run as `compressor -f <segment>`
+    const char* compressed_suffix = ".gz"; // what the compressor appends to the segment name
+    bool truncate = false;                 // otherwise append to an existing file
+    std::size_t buffer_size = 64 * 1024;   // bytes formatted per write(2)
+    async::options queue = default_queue(); // the buffered sink in front of the file (records: TC_ASYNC_RECORD_BYTES)
+
+    static async::options default_queue() {
+        async::options q;
+        q.name = "rotating_file";
+        return q;
+    }
+};
+
+struct stats {
+    std::uint64_t records = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t rotations = 0;
+    std::uint64_t compressions = 0; // compressor runs that exited with status 0
+    std::uint64_t deleted = 0;      // segments removed by max_files
+    std::uint64_t errors = 0;       // failed writes, renames, opens and compressor runs
+};
+
+class file_sink {
+  public:
+    explicit file_sink(const char* path, const options& opt = options())
+        : path_(path), opt_(opt), buffer_(new char[std::max<std::size_t>(opt.buffer_size, 4096)]) {
+        opt_.buffer_size = std::max<std::size_t>(opt.buffer_size, 4096);
+        const std::size_t slash = path_.rfind('/');
+        dir_ = slash == std::string::npos ? std::string() : path_.substr(0, slash + 1);
+        base_ = path_.substr(dir_.size());
+        const int fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (opt.truncate ? O_TRUNC : 0), 0644);
+        if (fd < 0)
+            return;
+        struct stat st;
+        file_bytes_ = ::fstat(fd, &st) == 0 ? static_cast<std::uint64_t>(st.st_size) : 0;
+        opened_at_ = now_ms();
+        fd_.store(fd, std::memory_order_release);
+        find_segments();
+        queue_.reset(new async::buffered_sink(&file_sink::drain_sink, this, opt_.queue));
+    }
+
+    // Delivers everything queued, then waits for running compressors.
+    ~file_sink() {
+        queue_.reset();
+        for (const auto& c : children_)
+            wait_child(c.pid, 0);
+        children_.clear();
+        prune();
+        const int fd = fd_.exchange(-1);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    file_sink(const file_sink&) = delete;
+    file_sink& operator=(const file_sink&) = delete;
+
+    bool ok() const {
+        return fd_.load(std::memory_order_acquire) >= 0;
+    }
+
+    // tc::log record sink: queues the records for the drain thread.
+    static void sink(void* ctx, const log::record* recs, std::size_t n) {
+        auto* self = static_cast<file_sink*>(ctx);
+        if (self->queue_ == nullptr)
+            return;
+        for (std::size_t i = 0; i < n; ++i)
+            self->queue_->push(recs[i]);
+    }
+
+    // Returns once every record queued before the call is in the file (or was dropped by the queue's policy).
+    void flush() {
+        if (queue_ != nullptr)
+            queue_->flush();
+    }
+
+    // The descriptor records are currently written to; it changes on rotation.
+    int fd() const {
+        return fd_.load(std::memory_order_acquire);
+    }
+
+    stats get_stats() const {
+        std::lock_guard<std::mutex> lock(stats_mu_);
+        return stats_;
+    }
+
+    // Rotated segments still on disk, oldest first, without the compressed suffix.
+    std::vector<std::string> segments() const {
+        std::lock_guard<std::mutex> lock(stats_mu_);
+        return segments_;
+    }
+
+  private:
+    static std::uint64_t now_ms() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                              std::chrono::system_clock::now().time_since_epoch())
+                                              .count());
+    }
+
+    static void drain_sink(void* ctx, const log::record* recs, std::size_t n) {
+        static_cast<file_sink*>(ctx)->write(recs, n);
+    }
+
+    // Drain thread only, like everything below.
+    void write(const log::record* recs, std::size_t n) {
+        if (fd_.load(std::memory_order_relaxed) < 0)
+            return;
+        if (opt_.interval_ms != 0 && now_ms() - opened_at_ >= opt_.interval_ms)
+            rotate();
+        // A queued record's payload and context take at most TC_ASYNC_RECORD_BYTES; the rest is for the tag, file,
+        // function and repeat note. A line that still does not fit is cut but keeps its newline.
+        char line[TC_ASYNC_RECORD_BYTES + 1024];
+        for (std::size_t i = 0; i < n; ++i) {
+            ::tc::detail::safe_buffer out{line, sizeof(line)};
+            ::tc::detail::append_record_line(out, recs[i]);
+            if (opt_.max_bytes != 0 && file_bytes_ + used_ + out.len > opt_.max_bytes && file_bytes_ + used_ > 0)
+                rotate();
+            if (used_ + out.len > opt_.buffer_size)
+                write_buffer();
+            std::memcpy(buffer_.get() + used_, line, out.len);
+            used_ += out.len;
+        }
+        write_buffer();
+        if (!children_.empty())
+            reap_children();
+        std::lock_guard<std::mutex> lock(stats_mu_);
+        stats_.records += n;
+    }
+
+    void write_buffer() {
+        std::size_t done = 0;
+        const int fd = fd_.load(std::memory_order_relaxed);
+        while (done < used_) {
+            const ssize_t w = ::write(fd, buffer_.get() + done, used_ - done);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                count_error();
+                break;
+            }
+            done += static_cast<std::size_t>(w);
+        }
+        file_bytes_ += done;
+        used_ = 0;
+        std::lock_guard<std::mutex> lock(stats_mu_);
+        stats_.bytes += done;
+    }
+
+    // Renames the current file to a new segment and swaps a freshly created file in. If the rename or the open
+    // fails, writing continues to the old descriptor; after a failed open that is the renamed segment, and the next
+    // rotation only retries the open.
+    void rotate() {
+        write_buffer();
+        opened_at_ = now_ms();
+        if (renamed_.empty()) {
+            if (file_bytes_ == 0)
+                return; // nothing to keep: an idle interval does not leave empty segments behind
+            const std::string segment = segment_name();
+            if (segment.empty() || ::rename(path_.c_str(), segment.c_str()) != 0) {
+                count_error();
+                return;
+            }
+            renamed_ = segment;
+        }
+        const int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            count_error(); // keep appending to the renamed segment
+            return;
+        }
+        const int old = fd_.exchange(fd, std::memory_order_acq_rel);
+        ::close(old);
+        file_bytes_ = 0;
+        std::string segment;
+        segment.swap(renamed_);
+        {
+            std::lock_guard<std::mutex> lock(stats_mu_);
+            ++stats_.rotations;
+            segments_.push_back(segment);
+        }
+        if (opt_.compress)
+            compress(segment);
+        prune();
+    }
+
+    // `<path>.<YYYYmmdd-HHMMSS>`, with `-NNN` (001 to 999, so names sort in rotation order) appended when a
+    // segment of that name exists. Empty once all 999 are taken: the file is not rotated within that second.
+    std::string segment_name() const {
+        const std::time_t t = static_cast<std::time_t>(now_ms() / 1000);
+        std::tm tm{};
+        ::gmtime_r(&t, &tm);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        const std::string name = path_ + "." + stamp;
+        std::string candidate = name;
+        for (unsigned k = 1; exists(candidate) || exists(candidate + opt_.compressed_suffix); ++k) {
+            if (k > 999)
+                return std::string();
+            char suffix[16];
+            std::snprintf(suffix, sizeof(suffix), "-%03u", k);
+            candidate = name + suffix;
+        }
+        return candidate;
+    }
+
+    // Whether `name` (a directory entry, compressed suffix removed) is one segment_name() makes for this file.
+    bool is_segment(const std::string& name) const {
+        static const char shape[] = "dddddddd-dddddd-ddd"; // d: digit
+        if (name.size() <= base_.size() + 1 || name.compare(0, base_.size(), base_) != 0 || name[base_.size()] != '.')
+            return false;
+        const std::size_t len = name.size() - base_.size() - 1;
+        if (len != 15 && len != 19)
+            return false;
+        for (std::size_t i = 0; i < len; ++i) {
+            const char c = name[base_.size() + 1 + i];
+            if (shape[i] == 'd' ? !std::isdigit(static_cast<unsigned char>(c)) : c != shape[i])
+                return false;
+        }
+        return true;
+    }
+
+    static bool exists(const std::string& name) {
+        struct stat st;
+        return ::lstat(name.c_str(), &st) == 0;
+    }
+
+    void compress(const std::string& segment) {
+        const std::string arg0 = opt_.compressor;
+        std::string flag = "-f";
+        std::string file = segment;
+        char* argv[] = {const_cast<char*>(arg0.c_str()), &flag[0], &file[0], nullptr};
+        pid_t pid;
+        if (::posix_spawnp(&pid, opt_.compressor, nullptr, nullptr, argv, environ) != 0) {
+            count_error();
+            return;
+        }
+        children_.push_back({pid, segment});
+    }
+
+    void reap_children() {
+        const std::size_t before = children_.size();
+        children_.erase(std::remove_if(children_.begin(), children_.end(),
+                                       [this](const child& c) { return wait_child(c.pid, WNOHANG); }),
+                        children_.end());
+        if (children_.size() != before)
+            prune();
+    }
+
+    bool compressing(const std::string& segment) const {
+        return std::any_of(children_.begin(), children_.end(), [&](const child& c) { return c.segment == segment; });
+    }
+
+    // True once `pid` has exited (or cannot be waited for, e.g. when SIGCHLD is ignored).
+    bool wait_child(pid_t pid, int flags) {
+        int status = 0;
+        pid_t r;
+        do {
+            r = ::waitpid(pid, &status, flags);
+        } while (r < 0 && errno == EINTR);
+        if (r == 0)
+            return false;
+        std::lock_guard<std::mutex> lock(stats_mu_);
+        if (r == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            ++stats_.compressions;
+        else if (r == pid)
+            ++stats_.errors;
+        return true;
+    }
+
+    // Deletes the oldest segments beyond max_files, stopping at one whose compressor is still running.
+    void prune() {
+        std::vector<std::string> victims;
+        {
+            std::lock_guard<std::mutex> lock(stats_mu_);
+            if (opt_.max_files == 0)
+                return;
+            std::size_t excess = 0;
+            while (segments_.size() - excess > opt_.max_files && !compressing(segments_[excess]))
+                ++excess;
+            victims.assign(segments_.begin(), segments_.begin() + static_cast<std::ptrdiff_t>(excess));
+            segments_.erase(segments_.begin(), segments_.begin() + static_cast<std::ptrdiff_t>(excess));
+            stats_.deleted += excess;
+        }
+        for (const auto& v : victims) {
+            ::unlink(v.c_str());
+            ::unlink((v + opt_.compressed_suffix).c_str());
+        }
+    }
+
+    // Picks up segments left by earlier runs, so max_files also bounds them. Other files next to the log, even ones
+    // named `<base>.<something>`, are never counted or deleted.
+    void find_segments() {
+        DIR* d = ::opendir(dir_.empty() ? "." : dir_.c_str());
+        if (d == nullptr)
+            return;
+        const std::string suffix = opt_.compressed_suffix;
+        while (const dirent* e = ::readdir(d)) {
+            std::string name = e->d_name;
+            if (!suffix.empty() && name.size() > suffix.size() &&
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+                name.resize(name.size() - suffix.size());
+            if (is_segment(name))
+                segments_.push_back(dir_ + name);
+        }
+        ::closedir(d);
+        std::sort(segments_.begin(), segments_.end());
+        segments_.erase(std::unique(segments_.begin(), segments_.end()), segments_.end());
+        prune();
+    }
+
+    void count_error() {
+        std::lock_guard<std::mutex> lock(stats_mu_);
+        ++stats_.errors;
+    }
+
+    std::string path_, dir_, base_; // dir_ keeps its trailing '/'
+    options opt_;
+    std::unique_ptr<char[]> buffer_;
+    std::size_t used_ = 0;
+    std::uint64_t file_bytes_ = 0; // size of the current file, as far as this sink has written it
+    std::uint64_t opened_at_ = 0;  // ms since the Unix epoch
+    std::string renamed_;          // segment the current descriptor writes to while reopening `path_` keeps failing
+    std::atomic<int> fd_{-1};
+    struct child {
+        pid_t pid;
+        std::string segment;
+    };
+    std::vector<child> children_; // running compressors
+    mutable std::mutex stats_mu_;
+    stats stats_;
+    std::vector<std::string> segments_;
+    std::unique_ptr<async::buffered_sink> queue_; // last: its drain thread uses everything above
+};
+
+} // namespace rotate
+} // namespace tc
+
+#endif // TC_POSIX
@@ -0,0 +1,427 @@
+// tc/shm_sink.hpp
+// Shared-memory log transport for POSIX: the logging process only copies records, an out-of-process collector
+// (tools/tc_logcollector.cpp) turns them into text and does the I/O.
+// - The segment is a POSIX shared memory object (shm_open) or, on Linux, a memfd handed to the collector
+// - Any number of threads and processes produce (one CAS on the write cursor per record), one collector consumes
+// - A full segment drops the record and counts it; producers never wait for the collector
+// - Records stay in the segment when the producer crashes; the collector drains them afterwards and skips a
+//   record the producer died in the middle of writing
+//
+// Usage:
+//   static tc::shm::producer shm("/app-log", 4 << 20);
+//   tc::log::add_sink(&tc::shm::producer::sink, &shm);
+//   // elsewhere: tc_logcollector -o /var/log/app.log /app-log
+//
+// Layout: a 4 KiB header (magic, capacity, write and read cursors, drop counter, producer pid), then `capacity`
+// bytes of records. A record is a 48-byte header, then its file name, function name and message, each followed by
+// a NUL, padded to 32 bytes. Records never wrap: a reservation that would cross the end first fills the tail with
+// a padding record.
+
+#pragma once
+
+#include "mmap_ring_sink.hpp"
+
+#if TC_POSIX
+
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <unistd.h>
+
+namespace tc {
+namespace shm {
+
+inline constexpr char segment_magic[8] = {'T', 'C', 'S', 'H', 'M', '1', '\0', '\0'};
+inline constexpr std::size_t segment_header_size = 4096;
+inline constexpr std::uint32_t segment_version = 1;
+
+struct segment_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::uint64_t capacity;                              // bytes of record space, a power of two
+    std::atomic<std::int32_t> producer_pid;              // last process to attach as a producer
+    std::atomic<std::uint64_t> generation;               // bumped each time a producer attaches
+    std::atomic<std::uint64_t> dropped;                  // records rejected because the segment was full
+    alignas(64) std::atomic<std::uint64_t> write_cursor; // total bytes ever reserved
+    alignas(64) std::atomic<std::uint64_t> read_cursor;  // total bytes the collector has released
+};
+static_assert(sizeof(segment_header) <= segment_header_size, "segment header must fit its page");
+
+enum record_state : std::uint32_t { writing = 0, committed = 1, padding = 2 };
+
+// A padding record only uses `pos`, `size` and `state`, so it fits in the smallest (32-byte) gap.
+struct record_header {
+    std::atomic<std::uint64_t> pos; // absolute position this record was reserved at
+    std::uint32_t size;             // whole record including this header, a multiple of 32
+    std::atomic<std::uint32_t> state;
+    std::uint64_t timestamp; // nanoseconds since the Unix epoch
+    std::uint64_t thread_id;
+    std::int32_t line;
+    std::uint16_t file_len;
+    std::uint16_t func_len;
+    std::uint32_t payload_len;
+    std::uint8_t level;
+    std::uint8_t reserved[3];
+};
+static_assert(sizeof(record_header) == 48, "shm record header must stay 48 bytes");
+
+} // namespace shm
+
+namespace detail {
+inline bool shm_header_valid(const shm::segment_header* h, std::size_t mapped) {
+    using namespace shm;
+    return std::memcmp(h->magic, segment_magic, sizeof(segment_magic)) == 0 && h->version == segment_version &&
+           h->header_size == segment_header_size && h->capacity != 0 && (h->capacity & (h->capacity - 1)) == 0 &&
+           segment_header_size + h->capacity <= mapped;
+}
+
+// "/name" (a single leading slash) is a shared memory object; anything else is a file path, e.g. /proc/PID/fd/N.
+inline int shm_open_segment(const char* name, int flags) {
+    if (name[0] == '/' && std::strchr(name + 1, '/') == nullptr)
+        return ::shm_open(name, flags, 0600);
+    return ::open(name, flags | O_CLOEXEC, 0600);
+}
+} // namespace detail
+
+namespace shm {
+
+// Producer side: a v2 record sink. Safe to call from any thread; other processes may attach to the same segment.
+class producer {
+  public:
+    // Opens or creates the segment `name` ("/name" for shm_open, otherwise a file path). A segment left by an
+    // earlier producer with the same capacity is continued, so records the collector has not read yet are kept.
+    // `capacity` is rounded up to a power of two, at least 64 KiB.
+    explicit producer(const char* name, std::size_t capacity = 4u << 20) {
+        fd_ = ::tc::detail::shm_open_segment(name, O_RDWR | O_CREAT);
+        attach(capacity);
+    }
+
+#if defined(__linux__)
+    // Anonymous segment backed by a memfd; pass fd() to the collector (inherited, or as /proc/PID/fd/N). Nothing
+    // outlives both processes, but records survive a producer crash while the collector keeps the segment mapped.
+    struct anonymous_t {};
+    static constexpr anonymous_t anonymous{};
+    explicit producer(anonymous_t, std::size_t capacity = 4u << 20) {
+        fd_ = ::memfd_create("tc-log", 0);
+        attach(capacity);
+    }
+#endif
+
+    ~producer() {
+        if (base_ != nullptr)
+            ::munmap(base_, len_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    producer(const producer&) = delete;
+    producer& operator=(const producer&) = delete;
+
+    bool ok() const {
+        return base_ != nullptr;
+    }
+    int fd() const {
+        return fd_;
+    }
+    std::uint64_t dropped() const {
+        return base_ ? header()->dropped.load(std::memory_order_relaxed) : 0;
+    }
+    // Bytes of records the collector has not released yet.
+    std::uint64_t backlog() const {
+        if (base_ == nullptr)
+            return 0;
+        return header()->write_cursor.load(std::memory_order_relaxed) -
+               header()->read_cursor.load(std::memory_order_relaxed);
+    }
+
+    // backlog() in the shape of tc::log::governor_config::queue_depth.
+    static std::size_t queue_depth(void* ctx) {
+        return static_cast<std::size_t>(static_cast<const producer*>(ctx)->backlog());
+    }
+
+    static void sink(void* ctx, const log::record* recs, std::size_t n) {
+        auto* self = static_cast<producer*>(ctx);
+        for (std::size_t i = 0; i < n; ++i)
+            self->push(recs[i]);
+    }
+
+    // Copies one record into the segment. Returns false (and counts a drop) if the collector is too far behind.
+    bool push(const log::record& rec) {
+        if (base_ == nullptr)
+            return false;
+        const char* file = rec.file ? rec.file : "(unknown)";
+        const char* func = rec.func ? rec.func : "(unknown)";
+        const std::size_t file_len = std::min<std::size_t>(std::strlen(file), 0xffff);
+        const std::size_t func_len = std::min<std::size_t>(std::strlen(func), 0xffff);
+        // A dedup repeat note and the context fields travel as part of the message, as in a text line.
+        char note[64];
+        const std::size_t note_len = ::tc::detail::format_repeat_note(rec, note, sizeof(note));
+        const std::size_t payload_len =
+            rec.payload.size() + note_len + (rec.context.empty() ? 0 : 1 + rec.context.size());
+        const std::size_t body = file_len + 1 + func_len + 1 + payload_len + 1;
+        const std::size_t size = ::tc::detail::ring_round_up(sizeof(record_header) + body);
+        if (size > (mask_ + 1) / 4) {
+            header()->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::uint64_t pos;
+        if (!reserve(size, &pos))
+            return false;
+
+        record_header* r = begin(pos, size);
+        r->timestamp = log::timestamp_to_unix_ns(rec.timestamp);
+        r->thread_id = rec.thread_id;
+        r->line = rec.line;
+        r->file_len = static_cast<std::uint16_t>(file_len);
+        r->func_len = static_cast<std::uint16_t>(func_len);
+        r->payload_len = static_cast<std::uint32_t>(payload_len);
+        r->level = static_cast<std::uint8_t>(rec.level);
+        char* p = reinterpret_cast<char*>(r + 1);
+        std::memcpy(p, file, file_len);
+        p[file_len] = '\0';
+        p += file_len + 1;
+        std::memcpy(p, func, func_len);
+        p[func_len] = '\0';
+        p += func_len + 1;
+        std::memcpy(p, rec.payload.data(), rec.payload.size());
+        std::memcpy(p + rec.payload.size(), note, note_len);
+        if (!rec.context.empty()) {
+            p[rec.payload.size() + note_len] = ' ';
+            std::memcpy(p + rec.payload.size() + note_len + 1, rec.context.data(), rec.context.size());
+        }
+        p[payload_len] = '\0';
+        r->state.store(committed, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    void attach(std::size_t capacity) {
+        if (fd_ < 0)
+            return;
+        std::size_t cap = 64 * 1024;
+        while (cap < capacity)
+            cap <<= 1;
+        struct stat st {};
+        const bool reuse = ::fstat(fd_, &st) == 0 && static_cast<std::size_t>(st.st_size) == segment_header_size + cap;
+        if (!reuse && ::ftruncate(fd_, static_cast<off_t>(segment_header_size + cap)) != 0)
+            return;
+        void* p = ::tc::detail::ring_map_file(fd_, true, &len_);
+        if (p == nullptr)
+            return;
+        base_ = static_cast<char*>(p);
+        auto* h = header();
+        if (!reuse || !::tc::detail::shm_header_valid(h, len_) || h->capacity != cap) {
+            std::memset(base_, 0, len_);
+            h->version = segment_version;
+            h->header_size = segment_header_size;
+            h->capacity = cap;
+            std::memcpy(h->magic, segment_magic, sizeof(segment_magic)); // last: the collector checks it first
+        }
+        mask_ = cap - 1;
+        h->producer_pid.store(static_cast<std::int32_t>(::getpid()), std::memory_order_relaxed);
+        h->generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    segment_header* header() const {
+        return reinterpret_cast<segment_header*>(base_);
+    }
+
+    // Claims `size` bytes at the write cursor, plus a padding record first if they would cross the end.
+    bool reserve(std::size_t size, std::uint64_t* out) {
+        auto* h = header();
+        std::uint64_t w = h->write_cursor.load(std::memory_order_relaxed);
+        std::size_t room, need;
+        do {
+            room = static_cast<std::size_t>(mask_ + 1 - (w & mask_));
+            need = size <= room ? size : room + size;
+            if (w + need - h->read_cursor.load(std::memory_order_acquire) > mask_ + 1) {
+                h->dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } while (!h->write_cursor.compare_exchange_weak(w, w + need, std::memory_order_relaxed));
+        if (need != size) {
+            begin(w, room)->state.store(padding, std::memory_order_release);
+            w += room;
+        }
+        *out = w;
+        return true;
+    }
+
+    // The stamp is published after the slot is marked `writing`, so the collector never pairs this reservation's
+    // stamp with the state of the record that used the slot one lap earlier.
+    record_header* begin(std::uint64_t pos, std::size_t size) {
+        auto* r = reinterpret_cast<record_header*>(base_ + segment_header_size + (pos & mask_));
+        r->state.store(writing, std::memory_order_relaxed);
+        r->pos.store(pos, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+        r->size = static_cast<std::uint32_t>(size);
+        return r;
+    }
+
+    int fd_ = -1;
+    char* base_ = nullptr;
+    std::size_t len_ = 0;
+    std::uint64_t mask_ = 0;
+};
+
+// Collector side: the single consumer of a segment. Every record handed out is released back to the producers.
+class consumer {
+  public:
+    struct entry {
+        log::level level;
+        int line;
+        std::uint64_t timestamp; // nanoseconds since the Unix epoch
+        std::uint64_t thread_id;
+        const char* file; // file, func and payload are valid until the next call to next()
+        const char* func;
+        std::string_view payload;
+
+        log::record to_record() const {
+            return {level, line, file, func, timestamp, thread_id, payload};
+        }
+    };
+
+    enum class result { record, empty, pending };
+
+    // Opens an existing segment by name ("/name" or a path).
+    explicit consumer(const char* name) {
+        fd_ = ::tc::detail::shm_open_segment(name, O_RDWR);
+        map();
+    }
+    // Adopts an inherited descriptor, e.g. a producer's memfd.
+    explicit consumer(int fd) : fd_(fd) {
+        map();
+    }
+
+    ~consumer() {
+        if (base_ != nullptr)
+            ::munmap(base_, len_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    consumer(const consumer&) = delete;
+    consumer& operator=(const consumer&) = delete;
+
+    bool ok() const {
+        return base_ != nullptr;
+    }
+    std::uint64_t dropped() const {
+        return header()->dropped.load(std::memory_order_relaxed);
+    }
+    std::uint64_t generation() const {
+        return header()->generation.load(std::memory_order_acquire);
+    }
+    // Bytes skipped over records left torn by a crashed producer.
+    std::uint64_t lost() const {
+        return lost_;
+    }
+    // False once the last producer to attach has exited; a record still pending then will never be committed.
+    bool producer_alive() const {
+        const pid_t pid = header()->producer_pid.load(std::memory_order_relaxed);
+        return pid > 0 && (::kill(pid, 0) == 0 || errno == EPERM);
+    }
+
+    // `pending` means the next record is reserved but not committed yet. Only call skip_torn() once its producer
+    // is known to be dead: skipping a record that is still being written would let the slot be reused under it.
+    result next(entry& out) {
+        auto* h = header();
+        for (;;) {
+            const std::uint64_t end = h->write_cursor.load(std::memory_order_acquire);
+            if (pos_ == end)
+                return result::empty;
+            const record_header* r = at(pos_);
+            const std::uint64_t stamp = r->pos.load(std::memory_order_acquire);
+            const std::uint32_t state = r->state.load(std::memory_order_acquire);
+            if (stamp != pos_ || state == writing)
+                return result::pending;
+            const std::uint32_t size = r->size;
+            if (!size_valid(size)) {
+                skip_torn();
+                continue;
+            }
+            if (state == padding) {
+                release(pos_ + size);
+                continue;
+            }
+            const std::size_t body = std::size_t(r->file_len) + 1 + r->func_len + 1 + r->payload_len + 1;
+            if (sizeof(record_header) + body > size) {
+                skip_torn();
+                continue;
+            }
+            buf_.assign(reinterpret_cast<const char*>(r + 1), body);
+            out.level = static_cast<log::level>(r->level);
+            out.line = r->line;
+            out.timestamp = r->timestamp;
+            out.thread_id = r->thread_id;
+            out.file = buf_.data();
+            out.func = buf_.data() + r->file_len + 1;
+            out.payload = std::string_view(out.func + r->func_len + 1, r->payload_len);
+            release(pos_ + size);
+            return result::record;
+        }
+    }
+
+    // Skips the record at the read position: by its size if that much was written, otherwise by scanning for the
+    // next slot stamped with its own position.
+    void skip_torn() {
+        const std::uint64_t end = header()->write_cursor.load(std::memory_order_acquire);
+        const std::uint64_t from = pos_;
+        const record_header* r = at(pos_);
+        std::uint64_t to = pos_ + ::tc::detail::ring_align;
+        if (r->pos.load(std::memory_order_acquire) == pos_ && size_valid(r->size))
+            to = pos_ + r->size;
+        else
+            while (to < end && at(to)->pos.load(std::memory_order_acquire) != to)
+                to += ::tc::detail::ring_align;
+        lost_ += to - from;
+        release(std::min(to, end));
+    }
+
+  private:
+    void map() {
+        if (fd_ < 0)
+            return;
+        void* p = ::tc::detail::ring_map_file(fd_, true, &len_);
+        if (p == nullptr)
+            return;
+        base_ = static_cast<char*>(p);
+        if (!::tc::detail::shm_header_valid(header(), len_)) {
+            ::munmap(base_, len_);
+            base_ = nullptr;
+            return;
+        }
+        mask_ = header()->capacity - 1;
+        pos_ = header()->read_cursor.load(std::memory_order_acquire); // resume where the last collector stopped
+    }
+
+    segment_header* header() const {
+        return reinterpret_cast<segment_header*>(base_);
+    }
+    const record_header* at(std::uint64_t pos) const {
+        return reinterpret_cast<const record_header*>(base_ + segment_header_size + (pos & mask_));
+    }
+    bool size_valid(std::uint32_t size) const {
+        return size >= ::tc::detail::ring_align && size % ::tc::detail::ring_align == 0 &&
+               (pos_ & mask_) + size <= mask_ + 1;
+    }
+
+    void release(std::uint64_t to) {
+        pos_ = to;
+        header()->read_cursor.store(to, std::memory_order_release);
+    }
+
+    int fd_ = -1;
+    char* base_ = nullptr;
+    std::size_t len_ = 0;
+    std::uint64_t mask_ = 0;
+    std::uint64_t pos_ = 0;
+    std::uint64_t lost_ = 0;
+    std::string buf_;
+};
+
+} // namespace shm
+} // namespace tc
+
+#endif // TC_POSIX
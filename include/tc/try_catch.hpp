@@ -20,20 +20,36 @@
 //   - TC_NOEXCEPT_IF_NOEXCEPTIONS (adds noexcept when exceptions are disabled)
 //   - TC_THROW(expr) and TC_RETHROW(): safe in no-exception builds (abort by default)
 //   - TC_ABORT(msg): abort helper used by TC_THROW in no-exception builds
+//   - tc::register_exception_formatter<T>(fn): describe non-std exceptions in TC_CATCH_ALL_WARN/ERROR
+//   - tc::install_terminate_handler(): log uncaught exceptions at error level before abort
+//   - TC_LOG_*_KV("msg", "key", value, ...): structured logfmt/JSON records for a pointer+length sink
+//   - TC_THROW_OR_RETURN(ex, errval): TC_THROW with a per-site circuit breaker that falls back to `return errval`
+//   - tc::log::control_sites("file=net/*.cpp +"): switch individual TC_LOG_* statements on or off at runtime
+//   - tc::log::set_governor({...}): throttle logging to record/byte budgets during log storms (errors always pass)
 //
 // You may customize behaviors by defining before including this header:
 //   - TC_ON_NOEXCEPT_THROW(file,line,func,msg): user-defined hook instead of abort
+//     (or register runtime handlers with tc::fatal::add_handler to run before the default abort)
 //   - TC_ENABLE_LOGGING (0/1): default 1 in Debug, 0 in Release
 //
 // This file is header-only and has no external dependencies.
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <charconv>
+#include <chrono>
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
 
 // ===================== Build-type detection =====================
 #if !defined(TC_DEBUG) && !defined(TC_RELEASE)
@@ -61,6 +77,19 @@
 #endif
 #endif
 
+// ===================== Platform detection =====================
+#if !defined(TC_POSIX)
+#if defined(__unix__) || defined(__APPLE__)
+#define TC_POSIX 1
+#else
+#define TC_POSIX 0
+#endif
+#endif
+
+#if TC_POSIX
+#include <unistd.h>
+#endif
+
 // ===================== Logging control =====================
 #if !defined(TC_ENABLE_LOGGING)
 #if TC_DEBUG
@@ -70,191 +99,3904 @@
 #endif
 #endif
 
+// Longest message a v2 record sink receives (longer ones are truncated) and the per-thread batch capacity used by
+// tc::log::set_record_sink(fn, ctx, batch > 1).
+#if !defined(TC_LOG_MESSAGE_MAX)
+#define TC_LOG_MESSAGE_MAX 2048
+#endif
+
+#if !defined(TC_LOG_BATCH_MAX)
+#define TC_LOG_BATCH_MAX 64
+#endif
+
+#if !defined(TC_LOG_BATCH_BYTES)
+#define TC_LOG_BATCH_BYTES (16 * 1024)
+#endif
+
+#if !defined(TC_LOG_SINKS_MAX)
+#define TC_LOG_SINKS_MAX 8 // sinks active at once, see tc::log::add_sink()
+#endif
+
+// Mapped diagnostic context (TC_LOG_SCOPE_FIELD): fields active at once per thread, and bytes for their text.
+#if !defined(TC_LOG_CONTEXT_FIELDS)
+#define TC_LOG_CONTEXT_FIELDS 16
+#endif
+
+#if !defined(TC_LOG_CONTEXT_BYTES)
+#define TC_LOG_CONTEXT_BYTES 512
+#endif
+
+// Repeat collapsing (tc::log::set_dedup): runs tracked at once per thread (a power of two), and the bytes of
+// message plus context kept for each; longer records are never collapsed.
+#if !defined(TC_LOG_DEDUP_SLOTS)
+#define TC_LOG_DEDUP_SLOTS 16
+#endif
+
+#if !defined(TC_LOG_DEDUP_BYTES)
+#define TC_LOG_DEDUP_BYTES 512
+#endif
+
+// Use membarrier(2) (Linux) so sink-table readers need no hardware fence; 0 falls back to fences on both sides.
+#if !defined(TC_LOG_USE_MEMBARRIER)
+#define TC_LOG_USE_MEMBARRIER 1
+#endif
+
+// Opt-in per translation unit: give every TC_LOG_* statement a static site that can be listed and switched on or
+// off at runtime (see "Log sites"). The macros then expand to statements rather than expressions. Static keys
+// need sites, so TC_LOG_STATIC_KEYS=1 turns them on unless TC_LOG_SITES says otherwise.
+#if !defined(TC_LOG_SITES)
+#if defined(TC_LOG_STATIC_KEYS) && TC_LOG_STATIC_KEYS
+#define TC_LOG_SITES 1
+#else
+#define TC_LOG_SITES 0
+#endif
+#endif
+
+// Opt-in per translation unit: compile each TC_LOG_* site's first check to a nop that is patched into a jump while
+// the site or its level is enabled (x86-64 and AArch64 Linux; elsewhere the atomic check stays). See "Static keys".
+#if !defined(TC_LOG_STATIC_KEYS)
+#define TC_LOG_STATIC_KEYS 0
+#endif
+
+// ===================== Clock =====================
+// Log records and trace events are stamped with raw ticks from the cheapest monotonic source available: the CPU
+// cycle counter (rdtsc on x86 with an invariant TSC, cntvct_el0 on AArch64), else CLOCK_MONOTONIC_COARSE (Linux)
+// or steady_clock. Ticks become wall-clock time only when a record is formatted: the tick rate is measured against
+// CLOCK_MONOTONIC since startup, and the conversion is re-anchored to CLOCK_REALTIME whenever the last anchor is
+// more than TC_CLOCK_RECALIBRATE_MS old. TC_CLOCK_USE_TSC=0 never reads the cycle counter.
+#if !defined(TC_CLOCK_USE_TSC)
+#define TC_CLOCK_USE_TSC 1
+#endif
+
+#if !defined(TC_CLOCK_RECALIBRATE_MS)
+#define TC_CLOCK_RECALIBRATE_MS 1000
+#endif
+
+#if TC_CLOCK_USE_TSC && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TC_CLOCK_TSC 1
+#include <cpuid.h>
+#elif TC_CLOCK_USE_TSC && (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+#define TC_CLOCK_TSC 1
+#else
+#define TC_CLOCK_TSC 0
+#endif
+
+#if TC_POSIX
+#include <time.h>
+#endif
+
 namespace tc {
 namespace detail {
 
-inline void default_abort_noexcept(const char* file, int line, const char* func, const char* msg) {
-    std::fprintf(stderr, "[tc] fatal: exception thrown but exceptions are disabled\n  at %s:%d in %s\n  msg: %s\n",
-                 file ? file : "(unknown)", line, func ? func : "(unknown)", msg ? msg : "(none)");
-    std::fflush(stderr);
-    std::abort();
+enum class clock_source : std::uint8_t { cycle_counter, monotonic_coarse, steady };
+
+inline std::uint64_t read_cycle_counter() {
+#if TC_CLOCK_TSC && (defined(__x86_64__) || defined(__i386__))
+    std::uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return (static_cast<std::uint64_t>(hi) << 32) | lo;
+#elif TC_CLOCK_TSC
+    std::uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return 0;
+#endif
 }
 
-enum class log_level : int { trace = 0, debug = 1, info = 2, warn = 3, error = 4, off = 5 };
+// The cycle counter is only a clock if it ticks at a fixed rate through frequency changes and idle states (x86
+// "invariant TSC", CPUID 0x80000007 EDX bit 8). The AArch64 generic timer always does.
+inline bool cycle_counter_usable() {
+#if TC_CLOCK_TSC && (defined(__x86_64__) || defined(__i386__))
+    unsigned a = 0, b = 0, c = 0, d = 0;
+    return __get_cpuid(0x80000007u, &a, &b, &c, &d) != 0 && (d & (1u << 8)) != 0;
+#else
+    return TC_CLOCK_TSC != 0;
+#endif
+}
 
-using log_sink_t = void (*)(log_level, const char* file, int line, const char* func, const char* fmt, va_list ap);
+inline std::uint64_t steady_ns() {
+    using namespace std::chrono;
+    return static_cast<std::uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
 
-inline void default_stderr_sink(log_level lvl, const char* file, int line, const char* func, const char* fmt,
-                                va_list ap) {
-    const char* name = "LOG";
-    switch (lvl) {
-    case log_level::trace:
-        name = "TRACE";
-        break;
-    case log_level::debug:
-        name = "DEBUG";
-        break;
-    case log_level::info:
-        name = "INFO";
-        break;
-    case log_level::warn:
-        name = "WARN";
-        break;
-    case log_level::error:
-        name = "ERROR";
-        break;
-    case log_level::off:
-        name = "OFF";
-        break;
-    }
-    std::fprintf(stderr, "[%s] %s:%d %s: ", name, file ? file : "(unknown)", line, func ? func : "(unknown)");
-    std::vfprintf(stderr, fmt ? fmt : "(null)", ap);
-    std::fputc('\n', stderr);
+inline std::int64_t realtime_ns() {
+    using namespace std::chrono;
+    return static_cast<std::int64_t>(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
 }
 
-inline std::atomic<int>& runtime_log_level() {
-    auto initial = []() constexpr -> int {
-#if TC_DEBUG
-    return static_cast<int>(log_level::debug);
-#else
-    return static_cast<int>(log_level::info);
+inline std::uint64_t read_clock_ticks(clock_source src) {
+    if (src == clock_source::cycle_counter)
+        return read_cycle_counter();
+#if TC_POSIX && defined(CLOCK_MONOTONIC_COARSE)
+    if (src == clock_source::monotonic_coarse) {
+        timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u + static_cast<std::uint64_t>(ts.tv_nsec);
+    }
 #endif
-    }();
-    static std::atomic<int> lvl{initial};
-    return lvl;
+    return steady_ns();
 }
 
-inline std::atomic<log_sink_t>& runtime_sink() {
-    static std::atomic<log_sink_t> sink{&default_stderr_sink};
-    return sink;
-}
+// One reading of ticks, CLOCK_MONOTONIC and CLOCK_REALTIME, taken as close together as the best of a few tries.
+struct clock_sample {
+    std::uint64_t ticks;
+    std::uint64_t mono_ns;
+    std::int64_t unix_ns;
+};
 
-inline void set_log_level(log_level lvl) {
-    runtime_log_level().store(static_cast<int>(lvl), std::memory_order_relaxed);
+inline clock_sample take_clock_sample(clock_source src) {
+    clock_sample best{};
+    std::uint64_t best_gap = ~std::uint64_t{0};
+    for (int i = 0; i < 5; ++i) {
+        const std::uint64_t t0 = read_clock_ticks(src);
+        const std::uint64_t mono = steady_ns();
+        const std::int64_t unix_ns = realtime_ns();
+        const std::uint64_t t1 = read_clock_ticks(src);
+        if (t1 - t0 < best_gap) {
+            best_gap = t1 - t0;
+            best = {t0 + (t1 - t0) / 2, mono, unix_ns};
+        }
+    }
+    return best;
 }
 
-inline log_level get_log_level() {
-    return static_cast<log_level>(runtime_log_level().load(std::memory_order_relaxed));
+// The source is chosen, and the reference point for measuring the tick rate taken, on first use.
+struct clock_origin {
+    clock_source source;
+    clock_sample sample;
+};
+
+inline const clock_origin& this_process_clock() {
+    static const clock_origin origin = [] {
+        clock_source src = clock_source::steady;
+        if (cycle_counter_usable())
+            src = clock_source::cycle_counter;
+#if TC_POSIX && defined(CLOCK_MONOTONIC_COARSE)
+        else
+            src = clock_source::monotonic_coarse;
+#endif
+        return clock_origin{src, take_clock_sample(src)};
+    }();
+    return origin;
 }
 
-inline void set_log_sink(log_sink_t sink) {
-    runtime_sink().store(sink, std::memory_order_relaxed);
+inline std::uint64_t clock_ticks() {
+    return read_clock_ticks(this_process_clock().source);
 }
 
-inline log_sink_t get_log_sink() {
-    return runtime_sink().load(std::memory_order_relaxed);
+// unix_ns = base_unix_ns + (ticks - base_ticks) * ns_per_tick, published under a sequence lock: odd `seq` means an
+// update is in progress. `calibrations` is 0 until the first conversion calibrates.
+struct clock_calibration {
+    std::atomic<std::uint32_t> seq{0};
+    std::atomic<std::uint64_t> base_ticks{0};
+    std::atomic<std::int64_t> base_unix_ns{0};
+    std::atomic<double> ns_per_tick{1.0};
+    std::atomic<std::uint64_t> calibrations{0};
+    std::atomic<bool> updating{false};
+};
+
+inline clock_calibration& this_process_calibration() {
+    static clock_calibration cal;
+    return cal;
 }
 
-inline void vlog_dispatch(log_level lvl, const char* file, int line, const char* func, const char* fmt, va_list ap) {
-    if (static_cast<int>(lvl) < runtime_log_level().load(std::memory_order_relaxed))
+// Re-anchors the conversion at "now". The cycle counter's rate is measured over the whole time since startup (at
+// least 1 ms, spinning if the process is younger), so it gets more accurate the longer the process runs.
+inline void calibrate_clock() {
+    clock_calibration& cal = this_process_calibration();
+    if (cal.updating.exchange(true, std::memory_order_acquire)) {
+        // Another thread is already at it. A refresh can go on with the old anchor, but before the first
+        // calibration there is none yet: wait for it.
+        while (cal.calibrations.load(std::memory_order_acquire) == 0)
+            std::this_thread::yield();
         return;
-    auto* s = runtime_sink().load(std::memory_order_relaxed);
-    if (s)
-        s(lvl, file, line, func, fmt, ap);
+    }
+    const clock_origin& origin = this_process_clock();
+    clock_sample now = take_clock_sample(origin.source);
+    double ns_per_tick = 1.0;
+    if (origin.source == clock_source::cycle_counter) {
+        while (now.mono_ns - origin.sample.mono_ns < 1000000u || now.ticks == origin.sample.ticks)
+            now = take_clock_sample(origin.source);
+        ns_per_tick = static_cast<double>(now.mono_ns - origin.sample.mono_ns) /
+                      static_cast<double>(now.ticks - origin.sample.ticks);
+    } else if (origin.source == clock_source::monotonic_coarse) {
+        // Coarse ticks are CLOCK_MONOTONIC nanoseconds at lower resolution: anchor on the precise reading.
+        now.ticks = now.mono_ns;
+    }
+    const std::uint32_t s = cal.seq.load(std::memory_order_relaxed);
+    cal.seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    cal.base_ticks.store(now.ticks, std::memory_order_relaxed);
+    cal.base_unix_ns.store(now.unix_ns, std::memory_order_relaxed);
+    cal.ns_per_tick.store(ns_per_tick, std::memory_order_relaxed);
+    cal.seq.store(s + 2, std::memory_order_release);
+    cal.calibrations.fetch_add(1, std::memory_order_relaxed);
+    cal.updating.store(false, std::memory_order_release);
 }
 
-inline void logf(log_level lvl, const char* file, int line, const char* func, const char* fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-    vlog_dispatch(lvl, file, line, func, fmt, ap);
-    va_end(ap);
+inline std::int64_t clock_ticks_to_unix_ns(std::uint64_t ticks) {
+    clock_calibration& cal = this_process_calibration();
+    if (cal.calibrations.load(std::memory_order_acquire) == 0)
+        calibrate_clock();
+    bool refreshed = false;
+    for (;;) {
+        const std::uint32_t s = cal.seq.load(std::memory_order_acquire);
+        const std::uint64_t base = cal.base_ticks.load(std::memory_order_relaxed);
+        const std::int64_t unix_ns = cal.base_unix_ns.load(std::memory_order_relaxed);
+        const double ns_per_tick = cal.ns_per_tick.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((s & 1) != 0 || cal.seq.load(std::memory_order_relaxed) != s) {
+            std::this_thread::yield();
+            continue;
+        }
+        const std::int64_t delta = static_cast<std::int64_t>(ticks - base);
+        const auto elapsed = static_cast<std::int64_t>(static_cast<double>(delta) * ns_per_tick);
+        if (!refreshed && elapsed > std::int64_t{TC_CLOCK_RECALIBRATE_MS} * 1000000) {
+            refreshed = true;
+            calibrate_clock(); // stale anchor: refresh it, then convert against the new one
+            if (cal.seq.load(std::memory_order_acquire) != s)
+                continue;
+        }
+        return unix_ns + elapsed;
+    }
+}
+
+// The calibrated tick length, for turning tick differences into durations.
+inline double clock_ns_per_tick() {
+    clock_calibration& cal = this_process_calibration();
+    if (cal.calibrations.load(std::memory_order_acquire) == 0)
+        calibrate_clock();
+    return cal.ns_per_tick.load(std::memory_order_relaxed);
 }
 
 } // namespace detail
 } // namespace tc
 
-// ===================== Branch prediction hints =====================
-#if defined(__GNUC__) || defined(__clang__)
-#define TC_LIKELY(x) (__builtin_expect(!!(x), 1))
-#define TC_UNLIKELY(x) (__builtin_expect(!!(x), 0))
-#else
-#define TC_LIKELY(x) (x)
-#define TC_UNLIKELY(x) (x)
+// ===================== Tracing (recording) =====================
+// Opt-in timeline of TC_THROW, catch helpers, TC_GUARD, TC_LOG_* and TC_TRACE_SCOPE spans. Events are 48-byte
+// records appended to a per-thread ring (TC_TRACE_BUFFER_EVENTS entries, oldest overwritten) while
+// tc::trace::start() is active; tc::trace::write_chrome_json() exports them. TC_ENABLE_TRACING=0 compiles the
+// hooks out entirely.
+#if !defined(TC_ENABLE_TRACING)
+#define TC_ENABLE_TRACING 1
 #endif
 
-// ===================== noexcept helpers =====================
-#if TC_EXCEPTIONS_ENABLED
-#define TC_NOEXCEPT_IF_NOEXCEPTIONS /* nothing */
-#else
-#define TC_NOEXCEPT_IF_NOEXCEPTIONS noexcept
+#if !defined(TC_TRACE_BUFFER_EVENTS)
+#define TC_TRACE_BUFFER_EVENTS 4096 // per thread, power of two
 #endif
 
-// ===================== Abort and throw helpers =====================
-#if !defined(TC_ABORT)
-#define TC_ABORT(msg) ::tc::detail::default_abort_noexcept(__FILE__, __LINE__, __func__, (msg))
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #endif
 
-#if TC_EXCEPTIONS_ENABLED
-#define TC_THROW(ex) throw(ex)
-#define TC_RETHROW() throw
-#else
-// When exceptions are disabled, throwing is a fatal error by default.
-#define TC_THROW(ex) TC_ABORT("TC_THROW called with exceptions disabled")
-#define TC_RETHROW() TC_ABORT("TC_RETHROW called with exceptions disabled")
-#endif
+namespace tc {
+namespace detail {
 
-// ===================== try/catch macros =====================
-// These macros allow source to remain uniform across exception-enabled/disabled builds.
-// When exceptions are disabled, TC_TRY becomes if(true) and TC_CATCH* become else if(false),
-// effectively compiling out the catch handlers while preserving syntax and scopes.
+enum class trace_kind : std::uint8_t { throw_ = 0, catch_ = 1, guard = 2, log = 3, scope = 4 };
 
-#if TC_EXCEPTIONS_ENABLED
+struct trace_event {
+    std::uint64_t ts; // clock ticks, see clock_ticks()
+    const char* name; // static or process-lifetime string
+    const char* file;
+    std::uint32_t line;
+    std::uint32_t tid;
+    trace_kind kind;
+    char phase; // Chrome trace-event phase: 'B', 'E' or 'i'
+    std::uint16_t arg;
+};
 
-#define TC_TRY try
-#define TC_CATCH(T, n) catch (T n)
-#define TC_CATCH_ALL() catch (...)
+// One ring entry, written only by the owning thread and read concurrently by the exporter. Every field is a relaxed
+// atomic and `seq` brackets the writes: odd (2i + 1) while event i is being stored, 2i + 2 once it is complete. A
+// reader that sees the same complete value before and after copying the fields has a consistent copy of event i.
+struct trace_slot {
+    std::atomic<std::uint64_t> seq{0};
+    std::atomic<std::uint64_t> ts{0};
+    std::atomic<const char*> name{nullptr};
+    std::atomic<const char*> file{nullptr};
+    std::atomic<std::uint64_t> where{0}; // line << 32 | tid
+    std::atomic<std::uint32_t> what{0};  // kind << 24 | phase << 16 | arg
+};
+
+struct trace_buffer {
+    std::atomic<std::uint64_t> head{0}; // total events written; slot = head % TC_TRACE_BUFFER_EVENTS
+    std::atomic<bool> in_use{true};
+    std::uint32_t tid = 0;
+    trace_buffer* next = nullptr;
+    trace_slot events[TC_TRACE_BUFFER_EVENTS];
+};
 
+inline void trace_store(trace_slot& s, std::uint64_t i, const trace_event& e) {
+    s.seq.store(2 * i + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.ts.store(e.ts, std::memory_order_relaxed);
+    s.name.store(e.name, std::memory_order_relaxed);
+    s.file.store(e.file, std::memory_order_relaxed);
+    s.where.store(static_cast<std::uint64_t>(e.line) << 32 | e.tid, std::memory_order_relaxed);
+    const auto phase = static_cast<std::uint32_t>(static_cast<unsigned char>(e.phase));
+    s.what.store(static_cast<std::uint32_t>(e.kind) << 24 | phase << 16 | e.arg, std::memory_order_relaxed);
+    s.seq.store(2 * i + 2, std::memory_order_release);
+}
+
+// Copies event i out of its slot; false if the slot no longer (or does not yet) holds it in full.
+inline bool trace_load(const trace_slot& s, std::uint64_t i, trace_event& e) {
+    const std::uint64_t want = 2 * i + 2;
+    if (s.seq.load(std::memory_order_acquire) != want)
+        return false;
+    e.ts = s.ts.load(std::memory_order_relaxed);
+    e.name = s.name.load(std::memory_order_relaxed);
+    e.file = s.file.load(std::memory_order_relaxed);
+    const std::uint64_t where = s.where.load(std::memory_order_relaxed);
+    const std::uint32_t what = s.what.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s.seq.load(std::memory_order_relaxed) != want)
+        return false;
+    e.line = static_cast<std::uint32_t>(where >> 32);
+    e.tid = static_cast<std::uint32_t>(where);
+    e.kind = static_cast<trace_kind>(what >> 24);
+    e.phase = static_cast<char>((what >> 16) & 0xff);
+    e.arg = static_cast<std::uint16_t>(what);
+    return true;
+}
+
+inline std::atomic<bool>& trace_enabled_flag() {
+    static std::atomic<bool> on{false};
+    return on;
+}
+
+inline std::atomic<trace_buffer*>& trace_buffers() {
+    static std::atomic<trace_buffer*> head{nullptr};
+    return head;
+}
+
+inline std::uint32_t trace_thread_id() {
+#if defined(__linux__)
+    return static_cast<std::uint32_t>(::syscall(SYS_gettid));
 #else
+    static std::atomic<std::uint32_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
 
-#define TC_TRY if (true)
-#define TC_CATCH(T, n) else if (false)
-#define TC_CATCH_ALL() else if (false)
+// Buffers are never freed: a thread's buffer is released at thread exit and adopted by the next new thread, so
+// exported events keep the tid they were recorded with.
+inline trace_buffer* acquire_trace_buffer() {
+    for (trace_buffer* b = trace_buffers().load(std::memory_order_acquire); b != nullptr; b = b->next) {
+        bool idle = false;
+        if (b->in_use.compare_exchange_strong(idle, true, std::memory_order_acq_rel))
+            return b;
+    }
+    auto* b = new trace_buffer();
+    b->next = trace_buffers().load(std::memory_order_relaxed);
+    while (!trace_buffers().compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return b;
+}
 
+struct trace_thread_state {
+    trace_buffer* buf = nullptr;
+    ~trace_thread_state() {
+        if (buf != nullptr)
+            buf->in_use.store(false, std::memory_order_release);
+    }
+};
+
+inline void trace_record_slow(trace_kind kind, char phase, const char* name, const char* file, int line,
+                              std::uint16_t arg) {
+    static thread_local trace_thread_state state;
+    if (state.buf == nullptr) {
+        state.buf = acquire_trace_buffer();
+        state.buf->tid = trace_thread_id();
+    }
+    trace_buffer* b = state.buf;
+    const std::uint64_t h = b->head.load(std::memory_order_relaxed);
+    trace_store(b->events[h & (TC_TRACE_BUFFER_EVENTS - 1)], h,
+                {clock_ticks(), name, file, static_cast<std::uint32_t>(line), b->tid, kind, phase, arg});
+    b->head.store(h + 1, std::memory_order_release);
+}
+
+inline void trace_record(trace_kind kind, char phase, const char* name, const char* file, int line,
+                         std::uint16_t arg = 0) {
+#if TC_ENABLE_TRACING
+    if (trace_enabled_flag().load(std::memory_order_relaxed))
+        trace_record_slow(kind, phase, name, file, line, arg);
+#else
+    (void)kind;
+    (void)phase;
+    (void)name;
+    (void)file;
+    (void)line;
+    (void)arg;
 #endif
+}
 
-// ===================== Logging macros (leveled + compatibility) =====================
-#if !defined(TC_ENABLE_ERROR_LOGGING)
-#define TC_ENABLE_ERROR_LOGGING 1
+inline bool trace_active() {
+#if TC_ENABLE_TRACING
+    return trace_enabled_flag().load(std::memory_order_relaxed);
+#else
+    return false;
 #endif
+}
 
-// Level macros. Note: avoid name clash with TC_DEBUG macro.
-#define TC_LOG_TRACE(...) ::tc::detail::logf(::tc::detail::log_level::trace, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define TC_LOG_DEBUG(...) ::tc::detail::logf(::tc::detail::log_level::debug, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define TC_LOG_INFO(...) ::tc::detail::logf(::tc::detail::log_level::info, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define TC_LOG_WARN(...) ::tc::detail::logf(::tc::detail::log_level::warn, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define TC_LOG_ERROR(...) ::tc::detail::logf(::tc::detail::log_level::error, __FILE__, __LINE__, __func__, __VA_ARGS__)
+struct trace_scope {
+    const char* name;
+    const char* file;
+    int line;
+    trace_scope(const char* n, const char* f, int l) : name(n), file(f), line(l) {
+        trace_record(trace_kind::scope, 'B', name, file, line);
+    }
+    ~trace_scope() {
+        trace_record(trace_kind::scope, 'E', name, file, line);
+    }
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+};
 
-// Compatibility aliases
-#if TC_ENABLE_LOGGING
-#define TC_WARN(...) TC_LOG_WARN(__VA_ARGS__)
+} // namespace detail
+} // namespace tc
+
+// ===================== USDT probes =====================
+// SystemTap/USDT static probes (tc:throw, tc:rethrow, tc:catch, tc:guard_fail, tc:log) emitted as .note.stapsdt
+// entries without depending on <sys/sdt.h>, so perf, bpftrace and stap can attach to them. An unattached probe is
+// a single nop; probe arguments are what the site already has in registers. Linux x86-64/AArch64 with GCC/Clang;
+// define TC_ENABLE_USDT=0 to omit them.
+#if !defined(TC_ENABLE_USDT)
+#if defined(__linux__) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__aarch64__))
+#define TC_ENABLE_USDT 1
 #else
-#define TC_WARN(...) ((void)0)
+#define TC_ENABLE_USDT 0
+#endif
 #endif
 
-#if TC_ENABLE_ERROR_LOGGING
-#define TC_ERROR(...) TC_LOG_ERROR(__VA_ARGS__)
+namespace tc {
+namespace detail {
+
+#if TC_ENABLE_USDT
+// Argument size as encoded in the note: negative for signed types.
+template <class T> struct usdt_arg_size {
+    static constexpr int value = (std::is_signed<T>::value ? -1 : 1) * static_cast<int>(sizeof(T));
+};
+
+#define TC_USDT_NOTE(name, args)                                                                                       \
+    "990: nop\n"                                                                                                       \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                                                      \
+    ".balign 4\n"                                                                                                      \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                                                                 \
+    "991: .asciz \"stapsdt\"\n"                                                                                        \
+    "992: .balign 4\n"                                                                                                 \
+    "993: .8byte 990b\n"                                                                                               \
+    ".8byte _.stapsdt.base\n"                                                                                          \
+    ".8byte 0\n"                                                                                                       \
+    ".asciz \"tc\"\n"                                                                                                  \
+    ".asciz \"" name "\"\n"                                                                                            \
+    ".asciz \"" args "\"\n"                                                                                            \
+    "994: .balign 4\n"                                                                                                 \
+    ".popsection\n"                                                                                                    \
+    ".ifndef _.stapsdt.base\n"                                                                                         \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"                                            \
+    ".weak _.stapsdt.base\n"                                                                                           \
+    ".hidden _.stapsdt.base\n"                                                                                         \
+    "_.stapsdt.base: .space 1\n"                                                                                       \
+    ".size _.stapsdt.base, 1\n"                                                                                        \
+    ".popsection\n"                                                                                                    \
+    ".endif\n"
+
+#define TC_USDT_OPERAND(n, x)                                                                                          \
+    [_tc_s##n] "n"(-::tc::detail::usdt_arg_size<decltype(x)>::value), [_tc_a##n] "nor"(x)
+
+#define TC_USDT_ARGS2 "%n[_tc_s1]@%[_tc_a1] %n[_tc_s2]@%[_tc_a2]"
+#define TC_USDT_ARGS4 TC_USDT_ARGS2 " %n[_tc_s3]@%[_tc_a3] %n[_tc_s4]@%[_tc_a4]"
+
+inline void usdt_throw(const char* file, int line) {
+    __asm__ __volatile__(TC_USDT_NOTE("throw", TC_USDT_ARGS2) : : TC_USDT_OPERAND(1, file), TC_USDT_OPERAND(2, line));
+}
+inline void usdt_rethrow(const char* file, int line) {
+    __asm__ __volatile__(TC_USDT_NOTE("rethrow", TC_USDT_ARGS2) : : TC_USDT_OPERAND(1, file), TC_USDT_OPERAND(2, line));
+}
+inline void usdt_catch(const char* file, int line) {
+    __asm__ __volatile__(TC_USDT_NOTE("catch", TC_USDT_ARGS2) : : TC_USDT_OPERAND(1, file), TC_USDT_OPERAND(2, line));
+}
+inline void usdt_guard_fail(const char* file, int line) {
+    __asm__ __volatile__(TC_USDT_NOTE("guard_fail", TC_USDT_ARGS2) : : TC_USDT_OPERAND(1, file),
+                         TC_USDT_OPERAND(2, line));
+}
+// tc:log(level, file, line, fmt)
+inline void usdt_log(int level, const char* file, int line, const char* fmt) {
+    __asm__ __volatile__(TC_USDT_NOTE("log", TC_USDT_ARGS4) : : TC_USDT_OPERAND(1, level), TC_USDT_OPERAND(2, file),
+                         TC_USDT_OPERAND(3, line), TC_USDT_OPERAND(4, fmt));
+}
 #else
-#define TC_ERROR(...) ((void)0)
+inline void usdt_throw(const char*, int) {}
+inline void usdt_rethrow(const char*, int) {}
+inline void usdt_catch(const char*, int) {}
+inline void usdt_guard_fail(const char*, int) {}
+inline void usdt_log(int, const char*, int, const char*) {}
+#endif
+
+} // namespace detail
+} // namespace tc
+
+// ===================== Fatal handler chain =====================
+// Handlers registered with tc::fatal::add_handler() run once, highest priority first, before the process dies on
+// a TC fatal path: TC_THROW/TC_RETHROW/TC_ABORT in no-exception builds, the terminate handler and (opt-in) the
+// crash reporter. Use them to flush async log buffers, metrics and trace rings. Registration is lock-free over a
+// fixed table of TC_FATAL_HANDLERS_MAX slots.
+#if !defined(TC_FATAL_HANDLERS_MAX)
+#define TC_FATAL_HANDLERS_MAX 16
 #endif
 
-// Runtime log control API (header-only; inline via namespace tc::detail)
 namespace tc {
-namespace log {
-using level = ::tc::detail::log_level;
-inline void set_level(level v) {
-    ::tc::detail::set_log_level(v);
+namespace fatal {
+enum class reason : int { abort = 0, noexcept_throw = 1, noexcept_rethrow = 2, terminate = 3, signal = 4 };
+
+struct context {
+    reason why;
+    const char* file; // may be null
+    int line;
+    const char* func; // may be null
+    const char* msg;  // may be null
+    int signal;       // signal number for reason::signal, else 0
+};
+
+using handler_t = void (*)(const context& ctx, void* user);
+} // namespace fatal
+
+namespace detail {
+
+struct fatal_slot {
+    enum : int { free_ = 0, busy = 1, ready = 2 };
+    std::atomic<int> state{free_};
+    std::atomic<fatal::handler_t> fn{nullptr};
+    std::atomic<void*> user{nullptr};
+    std::atomic<int> priority{0};
+};
+
+struct fatal_registry {
+    fatal_slot slots[TC_FATAL_HANDLERS_MAX];
+    std::atomic<bool> ran{false};
+};
+
+inline fatal_registry& fatal_handlers() {
+    static fatal_registry r;
+    return r;
 }
-inline level get_level() {
-    return ::tc::detail::get_log_level();
+
+inline int add_fatal_handler(fatal::handler_t fn, void* user, int priority) {
+    auto& r = fatal_handlers();
+    for (int i = 0; i < TC_FATAL_HANDLERS_MAX; ++i) {
+        int expected = fatal_slot::free_;
+        if (r.slots[i].state.compare_exchange_strong(expected, fatal_slot::busy, std::memory_order_acquire)) {
+            r.slots[i].fn.store(fn, std::memory_order_relaxed);
+            r.slots[i].user.store(user, std::memory_order_relaxed);
+            r.slots[i].priority.store(priority, std::memory_order_relaxed);
+            r.slots[i].state.store(fatal_slot::ready, std::memory_order_release);
+            return i + 1;
+        }
+    }
+    return 0;
 }
-using sink_t = ::tc::detail::log_sink_t;
-inline void set_sink(sink_t s) {
-    ::tc::detail::set_log_sink(s);
+
+inline bool remove_fatal_handler(int id) {
+    if (id <= 0 || id > TC_FATAL_HANDLERS_MAX)
+        return false;
+    int expected = fatal_slot::ready;
+    return fatal_handlers().slots[id - 1].state.compare_exchange_strong(expected, fatal_slot::free_,
+                                                                        std::memory_order_acq_rel);
 }
-inline sink_t get_sink() {
-    return ::tc::detail::get_log_sink();
+
+// Runs the chain once per process; re-entrant or concurrent fatal paths return immediately.
+inline void run_fatal_handlers(const fatal::context& ctx) {
+    auto& r = fatal_handlers();
+    if (r.ran.exchange(true, std::memory_order_acq_rel))
+        return;
+    struct entry {
+        fatal::handler_t fn;
+        void* user;
+        int priority;
+    } order[TC_FATAL_HANDLERS_MAX];
+    int n = 0;
+    for (auto& slot : r.slots) {
+        if (slot.state.load(std::memory_order_acquire) != fatal_slot::ready)
+            continue;
+        entry e{slot.fn.load(std::memory_order_relaxed), slot.user.load(std::memory_order_relaxed),
+                slot.priority.load(std::memory_order_relaxed)};
+        int j = n++;
+        for (; j > 0 && order[j - 1].priority < e.priority; --j)
+            order[j] = order[j - 1];
+        order[j] = e;
+    }
+    for (int i = 0; i < n; ++i)
+        if (order[i].fn != nullptr)
+            order[i].fn(ctx, order[i].user);
+}
+
+// Unique addresses let default_abort_noexcept tell TC_THROW from TC_RETHROW while TC_ABORT keeps taking a string.
+inline constexpr char noexcept_throw_msg[] = "TC_THROW called with exceptions disabled";
+inline constexpr char noexcept_rethrow_msg[] = "TC_RETHROW called with exceptions disabled";
+
+} // namespace detail
+
+namespace fatal {
+// Register `fn` to run before abort; higher `priority` runs first. Returns an id for remove_handler(), or 0 if all
+// TC_FATAL_HANDLERS_MAX slots are taken. Handlers must not throw.
+inline int add_handler(handler_t fn, void* user = nullptr, int priority = 0) {
+    return ::tc::detail::add_fatal_handler(fn, user, priority);
+}
+inline bool remove_handler(int id) {
+    return ::tc::detail::remove_fatal_handler(id);
+}
+// Run the chain now (at most once per process), e.g. from a custom TC_ABORT or signal handler.
+inline void run_handlers(const context& ctx) {
+    ::tc::detail::run_fatal_handlers(ctx);
+}
+} // namespace fatal
+} // namespace tc
+
+namespace tc {
+namespace detail {
+
+// Async-signal-safe text building for fatal paths: fixed buffers, no locale, no stdio locks.
+struct safe_buffer {
+    char* data;
+    std::size_t cap;
+    std::size_t len = 0;
+
+    safe_buffer& str(const char* s) {
+        for (s = s ? s : "(null)"; *s != '\0' && len < cap; ++s)
+            data[len++] = *s;
+        return *this;
+    }
+    safe_buffer& mem(const char* s, std::size_t n) {
+        n = std::min(n, cap - len);
+        std::memcpy(data + len, s, n);
+        len += n;
+        return *this;
+    }
+    safe_buffer& u64(std::uint64_t v, unsigned base = 10, int min_digits = 1) {
+        char tmp[24];
+        int n = 0;
+        do {
+            tmp[n++] = "0123456789abcdef"[v % base];
+            v /= base;
+        } while ((v != 0 || n < min_digits) && n < static_cast<int>(sizeof(tmp)));
+        while (n > 0 && len < cap)
+            data[len++] = tmp[--n];
+        return *this;
+    }
+    safe_buffer& i64(std::int64_t v) {
+        if (v < 0) {
+            str("-");
+            return u64(0 - static_cast<std::uint64_t>(v));
+        }
+        return u64(static_cast<std::uint64_t>(v));
+    }
+    safe_buffer& hex(std::uint64_t v) {
+        return str("0x").u64(v, 16, 16);
+    }
+};
+
+inline void safe_write(int fd, const char* data, std::size_t len) {
+#if TC_POSIX
+    while (len > 0) {
+        const ssize_t n = ::write(fd, data, len);
+        if (n <= 0)
+            return;
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+#else
+    std::fwrite(data, 1, len, fd == 2 ? stderr : stdout);
+    std::fflush(fd == 2 ? stderr : stdout);
+#endif
+}
+
+// Last TC_ABORT site, kept for crash reporters (see tc/crash_reporter.hpp).
+struct abort_context {
+    std::atomic<const char*> file{nullptr};
+    std::atomic<int> line{0};
+    std::atomic<const char*> func{nullptr};
+    std::atomic<const char*> msg{nullptr};
+};
+
+inline abort_context& last_abort_context() {
+    static abort_context ctx;
+    return ctx;
+}
+
+[[noreturn]] inline void default_abort_noexcept(const char* file, int line, const char* func, const char* msg) {
+    abort_context& ctx = last_abort_context();
+    ctx.file.store(file, std::memory_order_relaxed);
+    ctx.line.store(line, std::memory_order_relaxed);
+    ctx.func.store(func, std::memory_order_relaxed);
+    ctx.msg.store(msg, std::memory_order_release);
+
+    const fatal::reason why = msg == noexcept_throw_msg     ? fatal::reason::noexcept_throw
+                              : msg == noexcept_rethrow_msg ? fatal::reason::noexcept_rethrow
+                                                            : fatal::reason::abort;
+    run_fatal_handlers({why, file, line, func, msg, 0});
+
+    char buf[1024];
+    safe_buffer out{buf, sizeof(buf)};
+    out.str("[tc] fatal: exception thrown but exceptions are disabled\n  at ")
+        .str(file ? file : "(unknown)")
+        .str(":")
+        .i64(line)
+        .str(" in ")
+        .str(func ? func : "(unknown)")
+        .str("\n  msg: ")
+        .str(msg ? msg : "(none)")
+        .str("\n");
+    safe_write(2, buf, out.len);
+    std::abort();
+}
+
+enum class log_level : int { trace = 0, debug = 1, info = 2, warn = 3, error = 4, off = 5 };
+
+using log_sink_t = void (*)(log_level, const char* file, int line, const char* func, const char* fmt, va_list ap);
+
+inline const char* log_level_tag(log_level lvl) {
+    switch (lvl) {
+    case log_level::trace:
+        return "TRACE";
+    case log_level::debug:
+        return "DEBUG";
+    case log_level::info:
+        return "INFO";
+    case log_level::warn:
+        return "WARN";
+    case log_level::error:
+        return "ERROR";
+    case log_level::off:
+        return "OFF";
+    }
+    return "LOG";
+}
+
+// Mapped diagnostic context: the TC_LOG_SCOPE_FIELD fields active on this thread, innermost last. A field is
+// rendered once when its scope is entered, as logfmt for text lines and as JSON for KV records, so each log call
+// only copies finished text. Both buffers hold a separator before every field (" k=v", ",\"k\":v").
+struct log_context {
+    static_assert(TC_LOG_CONTEXT_BYTES < 65536, "TC_LOG_CONTEXT_BYTES must fit the 16-bit field marks");
+
+    std::uint16_t text_marks[TC_LOG_CONTEXT_FIELDS]; // text_len and json_len before field i was pushed
+    std::uint16_t json_marks[TC_LOG_CONTEXT_FIELDS];
+    std::size_t count = 0;
+    std::size_t text_len = 0;
+    std::size_t json_len = 0;
+    char text[TC_LOG_CONTEXT_BYTES];
+    char json[TC_LOG_CONTEXT_BYTES];
+
+    // "k=v k2=v2", or empty.
+    std::string_view view() const {
+        return text_len == 0 ? std::string_view() : std::string_view(text + 1, text_len - 1);
+    }
+
+    // Copies only the part in use.
+    void assign(const log_context& o) {
+        count = o.count;
+        text_len = o.text_len;
+        json_len = o.json_len;
+        std::memcpy(text_marks, o.text_marks, count * sizeof(text_marks[0]));
+        std::memcpy(json_marks, o.json_marks, count * sizeof(json_marks[0]));
+        std::memcpy(text, o.text, text_len);
+        std::memcpy(json, o.json, json_len);
+    }
+};
+
+inline log_context& this_thread_log_context() {
+    static thread_local log_context ctx;
+    return ctx;
+}
+
+inline void default_stderr_sink(log_level lvl, const char* file, int line, const char* func, const char* fmt,
+                                va_list ap) {
+    std::fprintf(stderr, "[%s] %s:%d %s: ", log_level_tag(lvl), file ? file : "(unknown)", line,
+                 func ? func : "(unknown)");
+    std::vfprintf(stderr, fmt ? fmt : "(null)", ap);
+    const std::string_view ctx = this_thread_log_context().view();
+    if (!ctx.empty()) {
+        std::fputc(' ', stderr);
+        std::fwrite(ctx.data(), 1, ctx.size(), stderr);
+    }
+    std::fputc('\n', stderr);
+}
+
+// A fully formatted record as seen by v2 sinks. `payload` and `context` are only valid for the duration of the
+// sink call; `file` and `func` point at string literals.
+struct log_record {
+    log_level level;
+    int line;
+    const char* file;
+    const char* func;
+    std::uint64_t timestamp; // raw clock ticks, see tc::log::timestamp_to_unix_ns()
+    std::uint64_t thread_id;
+    std::string_view payload;
+    std::string_view context{}; // the logging thread's TC_LOG_SCOPE_FIELD fields as logfmt, "req=42 tenant=acme"
+    // Set on a tc::log::set_dedup() summary: it stands for `repeats` copies of an earlier record that were
+    // suppressed; `first_timestamp` is that record's timestamp and `timestamp` the last copy's.
+    std::uint32_t repeats = 0;
+    std::uint64_t first_timestamp = 0;
+};
+
+// " (repeated N times in S s)" for a dedup summary, "" otherwise; returns its length.
+inline std::size_t format_repeat_note(const log_record& r, char* buf, std::size_t cap) {
+    if (r.repeats == 0 || cap == 0) {
+        if (cap != 0)
+            buf[0] = '\0';
+        return 0;
+    }
+    const std::int64_t ns = clock_ticks_to_unix_ns(r.timestamp) - clock_ticks_to_unix_ns(r.first_timestamp);
+    const int n = std::snprintf(buf, cap, " (repeated %u times in %.3f s)", static_cast<unsigned>(r.repeats),
+                                static_cast<double>(ns) / 1e9);
+    return n < 0 ? 0 : std::min(static_cast<std::size_t>(n), cap - 1);
+}
+
+using record_sink_t = void (*)(void* ctx, const log_record* records, std::size_t count);
+
+// Upper bound on what append_record_line() writes for `r`: the variable fields plus the tag, line number,
+// separators, newline and a repeat note (which format_repeat_note() caps at 64 bytes).
+inline std::size_t record_line_bound(const log_record& r) {
+    return r.payload.size() + r.context.size() + std::strlen(r.file ? r.file : "(unknown)") +
+           std::strlen(r.func ? r.func : "(unknown)") + 128;
+}
+
+// The default text layout, "[LEVEL] file:line func: payload context\n", for sinks that write records out as text.
+// A line cut short by a full buffer still ends with '\n', so the next line starts on its own.
+inline void append_record_line(safe_buffer& out, const log_record& r) {
+    out.str("[").str(log_level_tag(r.level)).str("] ").str(r.file ? r.file : "(unknown)").str(":").i64(r.line);
+    out.str(" ").str(r.func ? r.func : "(unknown)").str(": ").mem(r.payload.data(), r.payload.size());
+    if (r.repeats != 0) {
+        char note[64];
+        out.mem(note, format_repeat_note(r, note, sizeof(note)));
+    }
+    if (!r.context.empty())
+        out.str(" ").mem(r.context.data(), r.context.size());
+    out.str("\n");
+    if (out.len == out.cap && out.cap != 0)
+        out.data[out.cap - 1] = '\n';
+}
+
+// One registered sink. `legacy` sinks (set_sink/add_sink(sink_t)) get the caller's fmt/va_list directly; v2
+// sinks get records, `batch` at a time when batch > 1.
+struct sink_entry {
+    int id;
+    int min_level;
+    record_sink_t fn;
+    void* ctx;
+    std::size_t batch;
+    log_sink_t legacy;
+};
+
+// Immutable once published. Registration copies the current table, edits the copy and swaps it in with a CAS;
+// `min_level` and `batch` are precomputed so dispatch does not have to walk the entries to filter.
+struct sink_table {
+    sink_entry entries[TC_LOG_SINKS_MAX];
+    int count = 0;
+    int min_level = static_cast<int>(log_level::off);       // lowest level any sink accepts
+    int batch_min_level = static_cast<int>(log_level::off); // lowest level any batching sink accepts
+    std::size_t batch = 0;                                  // smallest batch size among batching sinks
+    sink_table* retired_next = nullptr;
+
+    void recompute() {
+        min_level = batch_min_level = static_cast<int>(log_level::off);
+        batch = 0;
+        for (int i = 0; i < count; ++i) {
+            const sink_entry& e = entries[i];
+            min_level = std::min(min_level, e.min_level);
+            if (e.batch > 1) {
+                batch_min_level = std::min(batch_min_level, e.min_level);
+                batch = batch == 0 ? e.batch : std::min(batch, e.batch);
+            }
+        }
+    }
+};
+
+// Statically allocated, so it is the one table that is never freed.
+inline sink_table* initial_sink_table() {
+    static sink_table initial = [] {
+        sink_table t;
+        t.entries[0] = {1, static_cast<int>(log_level::trace), nullptr, nullptr, 1, &default_stderr_sink};
+        t.count = 1;
+        t.recompute();
+        return t;
+    }();
+    return &initial;
+}
+
+inline std::atomic<sink_table*>& runtime_sinks() {
+    static std::atomic<sink_table*> current{initial_sink_table()};
+    return current;
+}
+
+inline std::atomic<int>& sink_ids() {
+    static std::atomic<int> next{2};
+    return next;
+}
+
+// Quiescence tracking for sink tables (epoch-based, in the style of userspace RCU). Each thread owns a reader
+// slot that holds the global epoch it saw on entering a read section, or 0 while outside. A writer unlinks a
+// table, bumps the epoch and waits until every slot is 0 or newer: from then on nobody can still be inside a
+// sink reached through the old table. Readers only store to their own cache line. On Linux, membarrier(2) lets
+// writers pay for the store-load ordering, so the reader side needs only a compiler barrier.
+struct alignas(64) log_reader_slot {
+    std::atomic<std::uint64_t> epoch{0};
+    std::atomic<bool> in_use{true};
+    log_reader_slot* next = nullptr;
+    unsigned nesting = 0; // owner thread only
+    bool light = false;   // writers issue membarrier(2) on this slot's behalf
+};
+
+inline std::atomic<std::uint64_t>& log_epoch() {
+    static std::atomic<std::uint64_t> epoch{1};
+    return epoch;
+}
+
+inline std::atomic<log_reader_slot*>& log_reader_slots() {
+    static std::atomic<log_reader_slot*> head{nullptr};
+    return head;
+}
+
+inline bool log_membarrier_ready() {
+#if TC_LOG_USE_MEMBARRIER && defined(__linux__) && defined(SYS_membarrier)
+    static const bool ok = [] {
+        constexpr int query = 0, private_expedited = 1 << 3, register_private_expedited = 1 << 4;
+        const long cmds = ::syscall(SYS_membarrier, query, 0);
+        return cmds > 0 && (cmds & private_expedited) != 0 &&
+               ::syscall(SYS_membarrier, register_private_expedited, 0) == 0;
+    }();
+    return ok;
+#else
+    return false;
+#endif
+}
+
+inline void log_writer_fence() {
+#if TC_LOG_USE_MEMBARRIER && defined(__linux__) && defined(SYS_membarrier)
+    if (log_membarrier_ready() && ::syscall(SYS_membarrier, 1 << 3 /* PRIVATE_EXPEDITED */, 0) == 0)
+        return;
+#endif
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+// Slots are never freed: a thread's slot is released at thread exit and adopted by the next new thread.
+inline log_reader_slot* acquire_log_reader_slot() {
+    const bool light = log_membarrier_ready();
+    for (log_reader_slot* s = log_reader_slots().load(std::memory_order_acquire); s != nullptr; s = s->next) {
+        bool expected = false;
+        if (s->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            s->light = light;
+            return s;
+        }
+    }
+    auto* s = new log_reader_slot;
+    s->light = light;
+    s->next = log_reader_slots().load(std::memory_order_relaxed);
+    while (!log_reader_slots().compare_exchange_weak(s->next, s, std::memory_order_release,
+                                                     std::memory_order_relaxed)) {
+    }
+    return s;
+}
+
+struct log_reader_handle {
+    log_reader_slot* slot = acquire_log_reader_slot();
+    ~log_reader_handle() {
+        slot->in_use.store(false, std::memory_order_release);
+    }
+};
+
+inline log_reader_slot& this_thread_log_reader() {
+    static thread_local log_reader_handle handle;
+    return *handle.slot;
+}
+
+struct sink_read_guard {
+    log_reader_slot& r = this_thread_log_reader();
+
+    sink_read_guard() {
+        if (r.nesting++ == 0) {
+            r.epoch.store(log_epoch().load(std::memory_order_acquire), std::memory_order_relaxed);
+            if (r.light)
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            else
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+    ~sink_read_guard() {
+        if (--r.nesting == 0)
+            r.epoch.store(0, std::memory_order_release);
+    }
+    sink_read_guard(const sink_read_guard&) = delete;
+    sink_read_guard& operator=(const sink_read_guard&) = delete;
+};
+
+// Returns once every read section that could have reached something unlinked before the call has ended. The
+// calling thread's own section (a sink reconfiguring logging) is skipped, since waiting on it would deadlock.
+inline void wait_for_log_readers() {
+    log_writer_fence();
+    const std::uint64_t target = log_epoch().fetch_add(1, std::memory_order_seq_cst) + 1;
+    const log_reader_slot* self = &this_thread_log_reader();
+    for (log_reader_slot* s = log_reader_slots().load(std::memory_order_acquire); s != nullptr; s = s->next) {
+        if (s == self)
+            continue;
+        for (;;) {
+            const std::uint64_t e = s->epoch.load(std::memory_order_acquire);
+            if (e == 0 || e >= target)
+                break;
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline std::atomic<sink_table*>& retired_sink_tables() {
+    static std::atomic<sink_table*> head{nullptr};
+    return head;
+}
+
+inline void retire_sink_table(sink_table* t) {
+    auto& head = retired_sink_tables();
+    t->retired_next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(t->retired_next, t, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+// Frees every retired table after a grace period. Inside a read section the calling thread may itself still be
+// walking one of them, so the tables stay queued for the next writer.
+inline void reclaim_sink_tables() {
+    if (this_thread_log_reader().nesting != 0)
+        return;
+    sink_table* list = retired_sink_tables().exchange(nullptr, std::memory_order_acq_rel);
+    wait_for_log_readers();
+    while (list != nullptr) {
+        sink_table* next = list->retired_next;
+        delete list;
+        list = next;
+    }
+}
+
+constexpr int default_log_level() {
+#if TC_DEBUG
+    return static_cast<int>(log_level::debug);
+#else
+    return static_cast<int>(log_level::info);
+#endif
+}
+
+inline std::atomic<int>& runtime_log_level() {
+    static std::atomic<int> lvl{default_log_level()};
+    return lvl;
+}
+
+// max(global level, lowest level any sink accepts): the single check every TC_LOG_* call makes first. Constant
+// initialized, like runtime_log_level(), so reading it needs no guard check.
+inline std::atomic<int>& log_dispatch_threshold() {
+    static std::atomic<int> thr{default_log_level()};
+    return thr;
+}
+
+// Re-derives the threshold until neither input changed underneath, so racing updates cannot leave it stale.
+inline void refresh_log_threshold() {
+    for (;;) {
+        const int lvl = runtime_log_level().load(std::memory_order_seq_cst);
+        int sinks;
+        sink_table* t;
+        {
+            sink_read_guard g;
+            t = runtime_sinks().load(std::memory_order_seq_cst);
+            sinks = t->min_level;
+        }
+        log_dispatch_threshold().store(std::max(lvl, sinks), std::memory_order_seq_cst);
+        if (runtime_log_level().load(std::memory_order_seq_cst) == lvl &&
+            runtime_sinks().load(std::memory_order_seq_cst) == t)
+            return;
+    }
+}
+
+// Re-patches TC_LOG_STATIC_KEYS sites after a level or site change; defined with the log sites.
+inline void update_log_site_keys();
+
+inline void set_log_level(log_level lvl) {
+    runtime_log_level().store(static_cast<int>(lvl), std::memory_order_seq_cst);
+    refresh_log_threshold();
+    update_log_site_keys();
+}
+
+inline log_level get_log_level() {
+    return static_cast<log_level>(runtime_log_level().load(std::memory_order_relaxed));
+}
+
+// The calling thread's tc::log::scoped_thread_level, or -1. When set it replaces both the global level and the
+// dispatch threshold for this thread; each sink's own minimum level still applies.
+inline int& this_thread_log_level() {
+    static thread_local int lvl = -1;
+    return lvl;
+}
+
+// Lowest level any scoped_thread_level has asked for. Static keys stay patched in down to it, so entering an
+// override is only expensive the first time a thread goes below the global level.
+inline std::atomic<int>& log_key_thread_floor() {
+    static std::atomic<int> lvl{static_cast<int>(log_level::off)};
+    return lvl;
+}
+
+inline void lower_log_key_thread_floor(int lvl) {
+    int cur = log_key_thread_floor().load(std::memory_order_relaxed);
+    if (lvl >= cur)
+        return;
+    while (lvl < cur && !log_key_thread_floor().compare_exchange_weak(cur, lvl, std::memory_order_relaxed)) {
+    }
+    update_log_site_keys();
+}
+
+// Copy-on-write update: `edit` mutates a private copy of the current table and returns false to abort.
+template <class Edit> bool update_sinks(Edit&& edit) {
+    auto& cur = runtime_sinks();
+    auto* next = new sink_table;
+    for (;;) {
+        sink_table* seen;
+        {
+            sink_read_guard g;
+            seen = cur.load(std::memory_order_acquire);
+            *next = *seen;
+        }
+        next->retired_next = nullptr;
+        if (!edit(*next)) {
+            delete next;
+            return false;
+        }
+        next->recompute();
+        if (cur.compare_exchange_strong(seen, next, std::memory_order_seq_cst)) {
+            if (seen != initial_sink_table())
+                retire_sink_table(seen);
+            break;
+        }
+    }
+    refresh_log_threshold();
+    reclaim_sink_tables();
+    return true;
+}
+
+inline std::uint64_t log_timestamp() {
+    return clock_ticks();
+}
+
+inline std::uint64_t log_thread_id() {
+    static thread_local const std::uint64_t id = trace_thread_id();
+    return id;
+}
+
+// Hands queued records to every batching sink, each filtered to the levels it accepts. `lowest` is the lowest
+// level among `recs`; sinks accepting it get the array as is.
+inline void deliver_batched(const sink_table* t, const log_record* recs, std::size_t n, int lowest) {
+    for (int i = 0; i < t->count; ++i) {
+        const sink_entry& e = t->entries[i];
+        if (e.fn == nullptr || e.batch <= 1)
+            continue;
+        if (e.min_level <= lowest) {
+            e.fn(e.ctx, recs, n);
+            continue;
+        }
+        log_record kept[TC_LOG_BATCH_MAX];
+        std::size_t k = 0;
+        for (std::size_t j = 0; j < n; ++j) {
+            if (static_cast<int>(recs[j].level) >= e.min_level)
+                kept[k++] = recs[j];
+        }
+        if (k > 0)
+            e.fn(e.ctx, kept, k);
+    }
+}
+
+// Per-thread batch for sinks registered with batch > 1. Payloads are copied into `arena`; the batch is delivered
+// to the batching sinks current when it fills up, on an error record, on tc::log::flush(), at thread exit and
+// from the fatal handler chain.
+struct log_batch {
+    log_record records[TC_LOG_BATCH_MAX];
+    char arena[TC_LOG_BATCH_BYTES];
+    std::size_t count = 0;
+    std::size_t used = 0;
+    int lowest = static_cast<int>(log_level::off);
+    bool flushing = false;
+
+    // Touch the reader slot first so it is destroyed after this batch's final flush at thread exit.
+    log_batch() {
+        (void)this_thread_log_reader();
+    }
+    ~log_batch() {
+        flush();
+    }
+
+    void flush() {
+        if (count == 0 || flushing)
+            return;
+        flushing = true;
+        {
+            sink_read_guard g;
+            deliver_batched(runtime_sinks().load(std::memory_order_acquire), records, count, lowest);
+        }
+        count = 0;
+        used = 0;
+        lowest = static_cast<int>(log_level::off);
+        flushing = false;
+    }
+
+    // False if the record cannot be queued (too large, or a sink is logging from inside flush()).
+    bool push(const log_record& rec) {
+        const std::size_t size = rec.payload.size() + rec.context.size();
+        if (flushing || size > sizeof(arena))
+            return false;
+        if (count == TC_LOG_BATCH_MAX || used + size > sizeof(arena))
+            flush();
+        records[count] = rec;
+        records[count].payload = copy(rec.payload);
+        records[count].context = copy(rec.context);
+        lowest = std::min(lowest, static_cast<int>(rec.level));
+        ++count;
+        return true;
+    }
+
+    std::string_view copy(std::string_view s) {
+        std::memcpy(arena + used, s.data(), s.size());
+        used += s.size();
+        return std::string_view(arena + used - s.size(), s.size());
+    }
+};
+
+inline log_batch& this_thread_log_batch() {
+    static thread_local log_batch batch;
+    return batch;
+}
+
+inline void fatal_flush_log_batch(const fatal::context&, void*) {
+    this_thread_log_batch().flush();
+}
+
+// Log governor (tc::log::set_governor): budgets for records and payload bytes per second, and a limit on a sink's
+// queue depth, applied to records that passed the level check. Time is cut into windows. Within a window, records
+// past a budget are dropped; when a window ends, the thread that notices picks the level floor for the next one:
+// the lowest level whose demand (records offered at it and above during the window) fits the budgets, one level
+// higher while the queue probe reports more than its limit. The floor rises at once and comes down one level per
+// window. Records below the floor or over budget are dropped, or kept one in `sample_one_in`; errors always pass.
+struct log_governor {
+    static constexpr int levels = static_cast<int>(log_level::error) + 1;
+
+    std::atomic<bool> active{false};
+    std::atomic<std::uint64_t> window_ns{1000000000};
+    std::atomic<std::uint64_t> summary_ns{10000000000};
+    std::atomic<std::uint64_t> max_records{0}; // per window, 0: no budget
+    std::atomic<std::uint64_t> max_bytes{0};   // per window, 0: no budget
+    std::atomic<std::uint32_t> sample_one_in{0};
+    std::atomic_flag probe_lock = ATOMIC_FLAG_INIT; // guards the three probe fields
+    std::size_t (*queue_depth)(void*) = nullptr;
+    void* queue_ctx = nullptr;
+    std::size_t max_queue_depth = 0;
+
+    std::atomic<std::uint64_t> window_start{0};
+    std::atomic<std::uint64_t> offered[levels]{}; // this window, per level
+    std::atomic<std::uint64_t> passed{0};         // this window
+    std::atomic<std::uint64_t> bytes{0};          // this window
+    std::atomic<int> floor{static_cast<int>(log_level::trace)};
+    std::atomic<std::uint64_t> sample_seq{0};
+    std::atomic<std::size_t> last_depth{0};
+
+    std::atomic<std::uint64_t> last_summary{0};
+    std::atomic<std::uint64_t> dropped[levels]{}; // since the last summary, per level
+    std::atomic<std::uint64_t> sampled{0};        // since the last summary
+    std::atomic<std::uint64_t> dropped_total{0};
+    std::atomic<std::uint64_t> summaries{0};
+};
+
+inline log_governor& this_process_log_governor() {
+    static log_governor g;
+    return g;
+}
+
+class log_governor_probe_guard {
+  public:
+    explicit log_governor_probe_guard(log_governor& g) : g_(g) {
+        while (g_.probe_lock.test_and_set(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+    ~log_governor_probe_guard() {
+        g_.probe_lock.clear(std::memory_order_release);
+    }
+    log_governor_probe_guard(const log_governor_probe_guard&) = delete;
+    log_governor_probe_guard& operator=(const log_governor_probe_guard&) = delete;
+
+  private:
+    log_governor& g_;
+};
+
+// Set while the governor's own summary is being logged, so it is never throttled.
+inline bool& log_governor_reporting() {
+    static thread_local bool reporting = false;
+    return reporting;
+}
+
+struct log_governor_summary {
+    std::uint64_t dropped[log_governor::levels];
+    std::uint64_t sampled;
+    std::uint64_t elapsed_ns;
+    int floor;
+};
+
+// Logs the summary as a warning; defined after logf().
+inline void log_governor_report(const log_governor_summary& s);
+
+// Closes the current window if it is over: picks the next floor and, once per summary interval, reports drops.
+inline void log_governor_roll(log_governor& g, std::uint64_t now) {
+    std::uint64_t start = g.window_start.load(std::memory_order_relaxed);
+    if (now - start < g.window_ns.load(std::memory_order_relaxed) ||
+        !g.window_start.compare_exchange_strong(start, now, std::memory_order_relaxed))
+        return;
+    const std::uint64_t max_records = g.max_records.load(std::memory_order_relaxed);
+    const std::uint64_t max_bytes = g.max_bytes.load(std::memory_order_relaxed);
+    const std::uint64_t passed = g.passed.exchange(0, std::memory_order_relaxed);
+    const std::uint64_t bytes = g.bytes.exchange(0, std::memory_order_relaxed);
+    const std::uint64_t bytes_per_record = passed == 0 ? 0 : bytes / passed;
+    constexpr int error = static_cast<int>(log_level::error);
+
+    int fit = error;
+    std::uint64_t demand = g.offered[error].exchange(0, std::memory_order_relaxed);
+    bool fits = true;
+    for (int l = error - 1; l >= 0; --l) {
+        demand += g.offered[l].exchange(0, std::memory_order_relaxed);
+        fits = fits && (max_records == 0 || demand <= max_records) &&
+               (max_bytes == 0 || demand * bytes_per_record <= max_bytes);
+        if (fits)
+            fit = l;
+    }
+    const int floor = g.floor.load(std::memory_order_relaxed);
+    int next = fit < floor ? std::max(fit, floor - 1) : fit;
+    {
+        log_governor_probe_guard lock(g);
+        if (g.queue_depth != nullptr && g.max_queue_depth != 0) {
+            const std::size_t depth = g.queue_depth(g.queue_ctx);
+            g.last_depth.store(depth, std::memory_order_relaxed);
+            if (depth > g.max_queue_depth)
+                next = std::max(next, std::min(floor + 1, error));
+            else if (depth > g.max_queue_depth / 2)
+                next = std::max(next, floor);
+        }
+    }
+    g.floor.store(next, std::memory_order_relaxed);
+
+    const std::uint64_t last = g.last_summary.load(std::memory_order_relaxed);
+    if (now - last < g.summary_ns.load(std::memory_order_relaxed))
+        return;
+    g.last_summary.store(now, std::memory_order_relaxed);
+    log_governor_summary sum{};
+    std::uint64_t any = sum.sampled = g.sampled.exchange(0, std::memory_order_relaxed);
+    for (int l = 0; l < log_governor::levels; ++l)
+        any += sum.dropped[l] = g.dropped[l].exchange(0, std::memory_order_relaxed);
+    if (any == 0)
+        return;
+    sum.elapsed_ns = now - last;
+    sum.floor = next;
+    g.summaries.fetch_add(1, std::memory_order_relaxed);
+    log_governor_report(sum);
+}
+
+// Whether a record at `lvl` may go out at time `now` (steady nanoseconds).
+inline bool log_governor_admit_at(log_level lvl, std::uint64_t now) {
+    log_governor& g = this_process_log_governor();
+    log_governor_roll(g, now);
+    const int l = std::min(static_cast<int>(lvl), static_cast<int>(log_level::error));
+    g.offered[l].fetch_add(1, std::memory_order_relaxed);
+    if (lvl < log_level::error) {
+        const std::uint64_t max_records = g.max_records.load(std::memory_order_relaxed);
+        const std::uint64_t max_bytes = g.max_bytes.load(std::memory_order_relaxed);
+        const bool over = (max_records != 0 && g.passed.load(std::memory_order_relaxed) >= max_records) ||
+                          (max_bytes != 0 && g.bytes.load(std::memory_order_relaxed) >= max_bytes);
+        if (over || l < g.floor.load(std::memory_order_relaxed)) {
+            const std::uint32_t n = g.sample_one_in.load(std::memory_order_relaxed);
+            if (n == 0 || g.sample_seq.fetch_add(1, std::memory_order_relaxed) % n != 0) {
+                g.dropped[l].fetch_add(1, std::memory_order_relaxed);
+                g.dropped_total.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            g.sampled.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    g.passed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+inline bool log_governor_admit(log_level lvl) {
+    if (!this_process_log_governor().active.load(std::memory_order_relaxed) || log_governor_reporting())
+        return true;
+    return log_governor_admit_at(lvl, steady_ns());
+}
+
+// Counts the payload bytes of a record the governor let through.
+inline void log_governor_charge(std::size_t bytes) {
+    log_governor& g = this_process_log_governor();
+    if (g.active.load(std::memory_order_relaxed))
+        g.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// Hands `rec` to the v2 sinks in `t` that accept its level: unbatched ones directly, batching ones through the
+// calling thread's batch. Called inside a sink_read_guard.
+inline void deliver_log_record(const sink_table* t, const log_record& rec) {
+    const int lvl = static_cast<int>(rec.level);
+    for (int i = 0; i < t->count; ++i) {
+        const sink_entry& e = t->entries[i];
+        if (e.fn != nullptr && e.batch <= 1 && lvl >= e.min_level)
+            e.fn(e.ctx, &rec, 1);
+    }
+    if (t->batch == 0 || lvl < t->batch_min_level)
+        return;
+    log_batch& batch = this_thread_log_batch();
+    if (!batch.push(rec)) {
+        batch.flush();
+        deliver_batched(t, &rec, 1, lvl);
+        return;
+    }
+    if (batch.count >= t->batch || rec.level >= log_level::error)
+        batch.flush();
+}
+
+// Calls the legacy (fmt/va_list) sinks in `t` that accept `lvl`. Called inside a sink_read_guard.
+inline void call_legacy_sinks(const sink_table* t, log_level lvl, const char* file, int line, const char* func,
+                              const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    for (int i = 0; i < t->count; ++i) {
+        const sink_entry& e = t->entries[i];
+        if (e.legacy != nullptr && static_cast<int>(lvl) >= e.min_level) {
+            va_list copy;
+            va_copy(copy, ap);
+            e.legacy(lvl, file, line, func, fmt, copy);
+            va_end(copy);
+        }
+    }
+    va_end(ap);
+}
+
+inline std::size_t format_log_message(char* buf, std::size_t cap, const char* fmt, va_list ap) {
+    const int n = std::vsnprintf(buf, cap, fmt ? fmt : "(null)", ap);
+    return n < 0 ? 0 : std::min(static_cast<std::size_t>(n), cap - 1);
+}
+
+// Repeat collapsing (tc::log::set_dedup). Each thread keeps up to TC_LOG_DEDUP_SLOTS runs, found by a hash of
+// the site, level, message and context; a new run takes a free slot or the oldest run's. The first record of a
+// run goes out; copies within the window after it are only counted, and the run is closed by one summary record
+// (log_record::repeats) when a copy arrives after the window, when another run takes its slot, when a periodic
+// sweep finds it expired, on tc::log::flush() and at thread exit. A run with no copies closes silently.
+inline std::atomic<std::uint64_t>& log_dedup_window_ns() {
+    static std::atomic<std::uint64_t> ns{0};
+    return ns;
+}
+
+struct log_dedup_counters {
+    std::atomic<std::uint64_t> suppressed{0};
+    std::atomic<std::uint64_t> summaries{0};
+};
+
+inline log_dedup_counters& this_process_log_dedup_counters() {
+    static log_dedup_counters c;
+    return c;
+}
+
+struct log_dedup_slot {
+    std::uint64_t hash = 0; // 0: free
+    const char* file = nullptr;
+    const char* func = nullptr;
+    int line = 0;
+    log_level level = log_level::trace;
+    std::uint64_t first = 0;   // ticks of the record that went out
+    std::int64_t first_ns = 0; // the same as Unix nanoseconds, for the window check
+    std::uint64_t last = 0;    // ticks of the latest copy
+    std::uint32_t repeats = 0; // copies suppressed so far
+    std::uint32_t payload_len = 0;
+    std::uint32_t context_len = 0;
+    char text[TC_LOG_DEDUP_BYTES]; // payload, then context
+};
+
+inline std::uint64_t log_dedup_hash(const char* file, int line, log_level lvl, std::string_view payload,
+                                    std::string_view context) {
+    std::uint64_t h = 14695981039346656037ull; // FNV-1a
+    const auto mix = [&h](const char* p, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+            h = (h ^ static_cast<unsigned char>(p[i])) * 1099511628211ull;
+    };
+    mix(payload.data(), payload.size());
+    mix("\n", 1);
+    mix(context.data(), context.size());
+    h ^= reinterpret_cast<std::uintptr_t>(file) * 0x9e3779b97f4a7c15ull;
+    h ^= (static_cast<std::uint64_t>(line) << 8 | static_cast<std::uint64_t>(lvl)) * 0xc2b2ae3d27d4eb4full;
+    return h == 0 ? 1 : h;
+}
+
+struct log_dedup_table {
+    log_dedup_slot slots[TC_LOG_DEDUP_SLOTS];
+    std::size_t sweep = 0;
+    bool emitting = false;
+
+    static_assert((TC_LOG_DEDUP_SLOTS & (TC_LOG_DEDUP_SLOTS - 1)) == 0, "TC_LOG_DEDUP_SLOTS must be a power of two");
+
+    // Touch the batch first so it is destroyed after this table's final summaries are queued into it.
+    log_dedup_table() {
+        (void)this_thread_log_batch();
+    }
+    ~log_dedup_table() {
+        flush();
+    }
+
+    void flush() {
+        for (log_dedup_slot& s : slots)
+            close(s);
+    }
+
+    // Emits the summary of the run in `s`, if it has copies, and frees the slot.
+    void close(log_dedup_slot& s) {
+        if (s.hash != 0 && s.repeats != 0 && !emitting) {
+            emitting = true; // a sink logging from inside the summary is not deduplicated
+            summarize(s);
+            emitting = false;
+        }
+        s.hash = 0;
+    }
+
+    static void summarize(const log_dedup_slot& s) {
+        this_process_log_dedup_counters().summaries.fetch_add(1, std::memory_order_relaxed);
+        if (!log_governor_admit(s.level))
+            return;
+        const std::string_view payload(s.text, s.payload_len);
+        const std::string_view context(s.text + s.payload_len, s.context_len);
+        const log_record rec{s.level, s.line, s.file, s.func, s.last, log_thread_id(), payload, context, s.repeats,
+                             s.first};
+        char note[64];
+        const std::size_t note_len = format_repeat_note(rec, note, sizeof(note));
+        log_governor_charge(rec.payload.size() + note_len);
+        sink_read_guard g;
+        const sink_table* t = runtime_sinks().load(std::memory_order_acquire);
+        call_legacy_sinks(t, s.level, s.file, s.line, s.func, "%.*s%s", static_cast<int>(rec.payload.size()),
+                          rec.payload.data(), note);
+        deliver_log_record(t, rec);
+    }
+
+    // True if the record, logged at `now` (ticks), is a copy within the window of a run already logged; it is
+    // then only counted.
+    bool suppress(log_level lvl, const char* file, int line, const char* func, std::string_view payload,
+                  std::uint64_t now, std::uint64_t window_ns) {
+        if (emitting)
+            return false;
+        const std::string_view context = this_thread_log_context().view();
+        const std::int64_t now_ns = clock_ticks_to_unix_ns(now);
+        const auto expired = [&](const log_dedup_slot& s) {
+            return static_cast<std::uint64_t>(now_ns - s.first_ns) > window_ns;
+        };
+        log_dedup_slot& swept = slots[sweep++ & (TC_LOG_DEDUP_SLOTS - 1)];
+        if (swept.hash != 0 && expired(swept))
+            close(swept);
+        if (payload.size() + context.size() > TC_LOG_DEDUP_BYTES)
+            return false;
+
+        const std::uint64_t h = log_dedup_hash(file, line, lvl, payload, context);
+        log_dedup_slot* victim = &slots[0];
+        for (log_dedup_slot& s : slots) {
+            if (s.hash == h && s.file == file && s.line == line && s.level == lvl && s.payload_len == payload.size() &&
+                s.context_len == context.size() && std::memcmp(s.text, payload.data(), payload.size()) == 0 &&
+                std::memcmp(s.text + payload.size(), context.data(), context.size()) == 0) {
+                if (!expired(s)) {
+                    ++s.repeats;
+                    s.last = now;
+                    this_process_log_dedup_counters().suppressed.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                victim = &s;
+                break;
+            }
+            if (victim->hash != 0 && (s.hash == 0 || s.first_ns < victim->first_ns))
+                victim = &s;
+        }
+        log_dedup_slot& s = *victim;
+        close(s);
+        s.hash = h;
+        s.file = file;
+        s.func = func;
+        s.line = line;
+        s.level = lvl;
+        s.first = s.last = now;
+        s.first_ns = now_ns;
+        s.repeats = 0;
+        s.payload_len = static_cast<std::uint32_t>(payload.size());
+        s.context_len = static_cast<std::uint32_t>(context.size());
+        std::memcpy(s.text, payload.data(), payload.size());
+        std::memcpy(s.text + payload.size(), context.data(), context.size());
+        return false;
+    }
+};
+
+inline log_dedup_table& this_thread_log_dedup() {
+    static thread_local log_dedup_table table;
+    return table;
+}
+
+// The level check TC_LOG_* makes before anything else.
+inline bool log_level_enabled(log_level lvl) {
+    const int thread_lvl = this_thread_log_level();
+    return static_cast<int>(lvl) >=
+           (thread_lvl < 0 ? log_dispatch_threshold().load(std::memory_order_relaxed) : thread_lvl);
+}
+
+// Hands a record that passed the level check to the sinks (each still applies its own minimum level).
+inline void vlog_deliver(log_level lvl, const char* file, int line, const char* func, const char* fmt, va_list ap) {
+    char msg[TC_LOG_MESSAGE_MAX];
+    std::size_t len = 0;
+    std::uint64_t ts = 0;
+    const std::uint64_t dedup_ns = log_dedup_window_ns().load(std::memory_order_relaxed);
+    if (dedup_ns != 0) { // needs the message (and its timestamp) before any sink sees it
+        ts = log_timestamp();
+        va_list copy;
+        va_copy(copy, ap);
+        len = format_log_message(msg, sizeof(msg), fmt, copy);
+        va_end(copy);
+        if (this_thread_log_dedup().suppress(lvl, file, line, func, std::string_view(msg, len), ts, dedup_ns))
+            return;
+    }
+    if (!log_governor_admit(lvl))
+        return;
+    usdt_log(static_cast<int>(lvl), file, line, fmt);
+    trace_record(trace_kind::log, 'i', fmt, file, line, static_cast<std::uint16_t>(lvl));
+
+    sink_read_guard g;
+    const sink_table* t = runtime_sinks().load(std::memory_order_acquire);
+    bool wants_record = false;
+    for (int i = 0; i < t->count; ++i) {
+        const sink_entry& e = t->entries[i];
+        if (static_cast<int>(lvl) < e.min_level)
+            continue;
+        if (e.legacy != nullptr) {
+            va_list copy;
+            va_copy(copy, ap);
+            e.legacy(lvl, file, line, func, fmt, copy);
+            va_end(copy);
+        } else {
+            wants_record = true;
+        }
+    }
+    if (!wants_record) {
+        log_governor_charge(dedup_ns != 0 ? len : fmt ? std::strlen(fmt) : 0);
+        return;
+    }
+
+    if (dedup_ns == 0) {
+        ts = log_timestamp();
+        len = format_log_message(msg, sizeof(msg), fmt, ap);
+    }
+    log_governor_charge(len);
+    const log_record rec{lvl, line, file, func, ts, log_thread_id(), std::string_view(msg, len),
+                         this_thread_log_context().view()};
+    deliver_log_record(t, rec);
+}
+
+inline void vlog_dispatch(log_level lvl, const char* file, int line, const char* func, const char* fmt, va_list ap) {
+    if (log_level_enabled(lvl))
+        vlog_deliver(lvl, file, line, func, fmt, ap);
+}
+
+inline void flush_log_batches_on_fatal() {
+    static const int id = add_fatal_handler(&fatal_flush_log_batch, nullptr, 100);
+    (void)id;
+}
+
+// Registers `e` (its id is assigned here); returns the id, or 0 when all TC_LOG_SINKS_MAX slots are taken.
+inline int add_log_sink(sink_entry e) {
+    e.batch = std::min<std::size_t>(std::max<std::size_t>(e.batch, 1), TC_LOG_BATCH_MAX);
+    if (e.batch > 1)
+        flush_log_batches_on_fatal();
+    e.id = sink_ids().fetch_add(1, std::memory_order_relaxed);
+    const bool ok = update_sinks([&](sink_table& t) {
+        if (t.count == TC_LOG_SINKS_MAX)
+            return false;
+        t.entries[t.count++] = e;
+        return true;
+    });
+    return ok ? e.id : 0;
+}
+
+inline bool remove_log_sink(int id) {
+    this_thread_log_batch().flush();
+    return update_sinks([&](sink_table& t) {
+        for (int i = 0; i < t.count; ++i) {
+            if (t.entries[i].id == id) {
+                for (int j = i + 1; j < t.count; ++j)
+                    t.entries[j - 1] = t.entries[j];
+                --t.count;
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+inline bool set_log_sink_level(int id, log_level lvl) {
+    return update_sinks([&](sink_table& t) {
+        for (int i = 0; i < t.count; ++i) {
+            if (t.entries[i].id == id) {
+                t.entries[i].min_level = static_cast<int>(lvl);
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+// Replaces every registered sink with `e` (or with nothing when it has neither fn nor legacy set). Returns the
+// previous sole legacy sink, as get_log_sink() would have.
+inline log_sink_t replace_log_sinks(sink_entry e) {
+    this_thread_log_batch().flush();
+    e.batch = std::min<std::size_t>(std::max<std::size_t>(e.batch, 1), TC_LOG_BATCH_MAX);
+    if (e.batch > 1)
+        flush_log_batches_on_fatal();
+    e.id = sink_ids().fetch_add(1, std::memory_order_relaxed);
+    log_sink_t previous = nullptr;
+    update_sinks([&](sink_table& t) {
+        previous = t.count == 1 ? t.entries[0].legacy : nullptr;
+        t.count = 0;
+        if (e.fn != nullptr || e.legacy != nullptr)
+            t.entries[t.count++] = e;
+        return true;
+    });
+    return previous;
+}
+
+// Swaps the callback and context of sink `id` in place, keeping its level, batch size and position.
+inline bool replace_log_sink(int id, record_sink_t fn, void* ctx) {
+    this_thread_log_batch().flush();
+    return update_sinks([&](sink_table& t) {
+        for (int i = 0; i < t.count; ++i) {
+            if (t.entries[i].id == id && t.entries[i].legacy == nullptr) {
+                t.entries[i].fn = fn;
+                t.entries[i].ctx = ctx;
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+inline void set_log_sink(log_sink_t sink) {
+    replace_log_sinks({0, static_cast<int>(log_level::trace), nullptr, nullptr, 1, sink});
+}
+
+// The legacy sink when it is the only one registered, nullptr otherwise.
+inline log_sink_t get_log_sink() {
+    sink_read_guard g;
+    const sink_table* t = runtime_sinks().load(std::memory_order_acquire);
+    return t->count == 1 ? t->entries[0].legacy : nullptr;
+}
+
+inline void logf(log_level lvl, const char* file, int line, const char* func, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vlog_dispatch(lvl, file, line, func, fmt, ap);
+    va_end(ap);
+}
+
+} // namespace detail
+} // namespace tc
+
+// ===================== Branch prediction hints =====================
+#if defined(__GNUC__) || defined(__clang__)
+#define TC_LIKELY(x) (__builtin_expect(!!(x), 1))
+#define TC_UNLIKELY(x) (__builtin_expect(!!(x), 0))
+#else
+#define TC_LIKELY(x) (x)
+#define TC_UNLIKELY(x) (x)
+#endif
+
+// ===================== noexcept helpers =====================
+#if TC_EXCEPTIONS_ENABLED
+#define TC_NOEXCEPT_IF_NOEXCEPTIONS /* nothing */
+#else
+#define TC_NOEXCEPT_IF_NOEXCEPTIONS noexcept
+#endif
+
+// ===================== Abort and throw helpers =====================
+// TC_ON_NOEXCEPT_THROW(file, line, func, msg), if defined, replaces the default handler behind TC_ABORT.
+#if !defined(TC_ABORT)
+#if defined(TC_ON_NOEXCEPT_THROW)
+#define TC_ABORT(msg) TC_ON_NOEXCEPT_THROW(__FILE__, __LINE__, __func__, (msg))
+#else
+#define TC_ABORT(msg) ::tc::detail::default_abort_noexcept(__FILE__, __LINE__, __func__, (msg))
+#endif
+#endif
+
+#if TC_EXCEPTIONS_ENABLED
+// Both stay throw-expressions (usable as an operand of ?:); the probes run while the operand is evaluated.
+#define TC_THROW(ex) throw ::tc::detail::on_throw(__FILE__, __LINE__, (ex))
+#define TC_RETHROW() throw ::tc::detail::on_rethrow(__FILE__, __LINE__)
+#else
+// When exceptions are disabled, throwing is a fatal error by default.
+#define TC_THROW(ex) TC_ABORT(::tc::detail::noexcept_throw_msg)
+#define TC_RETHROW() TC_ABORT(::tc::detail::noexcept_rethrow_msg)
+#endif
+
+// ===================== try/catch macros =====================
+// These macros allow source to remain uniform across exception-enabled/disabled builds.
+// When exceptions are disabled, TC_TRY becomes if(true) and TC_CATCH* become else if(false),
+// effectively compiling out the catch handlers while preserving syntax and scopes.
+
+#if TC_EXCEPTIONS_ENABLED
+
+#define TC_TRY try
+#define TC_CATCH(T, n) catch (T n)
+#define TC_CATCH_ALL() catch (...)
+
+#else
+
+#define TC_TRY if (true)
+#define TC_CATCH(T, n) else if (false)
+#define TC_CATCH_ALL() else if (false)
+
+#endif
+
+// ===================== Logging macros (leveled + compatibility) =====================
+#if !defined(TC_ENABLE_ERROR_LOGGING)
+#define TC_ENABLE_ERROR_LOGGING 1
+#endif
+
+// Level macros. Note: avoid name clash with TC_DEBUG macro. Each is a void expression, or with TC_LOG_SITES=1 one
+// statement that only evaluates its arguments when the record is going to be logged (see "Log sites").
+#define TC_LOG_TRACE(...) TC_LOG_SITE_(trace, __VA_ARGS__)
+#define TC_LOG_DEBUG(...) TC_LOG_SITE_(debug, __VA_ARGS__)
+#define TC_LOG_INFO(...) TC_LOG_SITE_(info, __VA_ARGS__)
+#define TC_LOG_WARN(...) TC_LOG_SITE_(warn, __VA_ARGS__)
+#define TC_LOG_ERROR(...) TC_LOG_SITE_(error, __VA_ARGS__)
+
+// Compatibility aliases
+#if TC_ENABLE_LOGGING
+#define TC_WARN(...) TC_LOG_WARN(__VA_ARGS__)
+#else
+#define TC_WARN(...) ((void)0)
+#endif
+
+#if TC_ENABLE_ERROR_LOGGING
+#define TC_ERROR(...) TC_LOG_ERROR(__VA_ARGS__)
+#else
+#define TC_ERROR(...) ((void)0)
+#endif
+
+// Runtime log control API (header-only; inline via namespace tc::detail)
+namespace tc {
+namespace log {
+using level = ::tc::detail::log_level;
+inline void set_level(level v) {
+    ::tc::detail::set_log_level(v);
+}
+inline level get_level() {
+    return ::tc::detail::get_log_level();
+}
+
+// Logs the calling thread at `v` instead of the global level until the end of the scope, e.g. debug for one
+// request under investigation while every other thread stays at info (or quieter than the global level). Sinks
+// still drop records below their own minimum level. Scopes nest; the previous override comes back on exit.
+class scoped_thread_level {
+  public:
+    explicit scoped_thread_level(level v) : prev_(::tc::detail::this_thread_log_level()) {
+        ::tc::detail::lower_log_key_thread_floor(static_cast<int>(v));
+        ::tc::detail::this_thread_log_level() = static_cast<int>(v);
+    }
+    ~scoped_thread_level() {
+        ::tc::detail::this_thread_log_level() = prev_;
+    }
+    scoped_thread_level(const scoped_thread_level&) = delete;
+    scoped_thread_level& operator=(const scoped_thread_level&) = delete;
+
+  private:
+    int prev_;
+};
+
+// The level the calling thread logs at: its scoped_thread_level if one is active, otherwise get_level().
+inline level effective_level() {
+    const int v = ::tc::detail::this_thread_log_level();
+    return v < 0 ? get_level() : static_cast<level>(v);
+}
+using sink_t = ::tc::detail::log_sink_t;
+// Replaces all registered sinks with `s` (nullptr: none).
+inline void set_sink(sink_t s) {
+    ::tc::detail::set_log_sink(s);
+}
+// The legacy sink when it is the only one registered, nullptr otherwise.
+inline sink_t get_sink() {
+    return ::tc::detail::get_log_sink();
+}
+
+// v2 sinks receive formatted records instead of fmt/va_list, so they can be stored, fanned out or handed to
+// another thread. With batch > 1 each thread queues up to `batch` records (capped at TC_LOG_BATCH_MAX) and
+// delivers them in one call; error records, flush(), thread exit and the fatal handler chain drain the queue.
+using record = ::tc::detail::log_record;
+using record_sink_t = ::tc::detail::record_sink_t;
+
+// Replaces all registered sinks with this one.
+inline void set_record_sink(record_sink_t fn, void* ctx = nullptr, std::size_t batch = 1) {
+    ::tc::detail::replace_log_sinks({0, static_cast<int>(level::trace), fn, ctx, batch, nullptr});
+}
+
+// Fan-out: up to TC_LOG_SINKS_MAX sinks, each receiving records at or above `min`. Returns an id for
+// remove_sink()/set_sink_level(), or 0 when the table is full. Registration is lock-free and copy-on-write.
+inline int add_sink(record_sink_t fn, void* ctx = nullptr, level min = level::trace, std::size_t batch = 1) {
+    return ::tc::detail::add_log_sink({0, static_cast<int>(min), fn, ctx, batch, nullptr});
+}
+inline int add_sink(sink_t fn, level min = level::trace) {
+    return ::tc::detail::add_log_sink({0, static_cast<int>(min), nullptr, nullptr, 1, fn});
+}
+inline bool remove_sink(int id) {
+    return ::tc::detail::remove_log_sink(id);
+}
+inline bool set_sink_level(int id, level min) {
+    return ::tc::detail::set_log_sink_level(id, min);
+}
+
+// Hot swap. Every registration call (set_sink, add_sink, remove_sink, ...) returns only after all calls still
+// running through the replaced table have finished, so the old sink's state can be destroyed right afterwards.
+// These return the previous sink, or swap sink `id`'s callback in place. Records still queued in another
+// thread's batch go to the sinks registered when that batch is flushed.
+inline sink_t replace_sink(sink_t s) {
+    return ::tc::detail::replace_log_sinks({0, static_cast<int>(level::trace), nullptr, nullptr, 1, s});
+}
+inline bool replace_sink(int id, record_sink_t fn, void* ctx = nullptr) {
+    return ::tc::detail::replace_log_sink(id, fn, ctx);
+}
+
+// Delivers the calling thread's queued records, and closes its set_dedup() runs with their summaries. Call from
+// each logging thread before destroying a sink's context.
+inline void flush() {
+    if (::tc::detail::log_dedup_window_ns().load(std::memory_order_relaxed) != 0)
+        ::tc::detail::this_thread_log_dedup().flush();
+    ::tc::detail::this_thread_log_batch().flush();
+}
+
+// Collapses repeats: a TC_LOG_* record identical to one the same thread logged from the same site (same level,
+// message and context) less than `window_ms` earlier is suppressed and counted, and the run ends with one record
+// carrying the count (record::repeats, record::first_timestamp; text sinks append "(repeated N times in S s)").
+// 0, the default, turns it off. TC_LOG_*_KV records are not collapsed.
+inline void set_dedup(unsigned window_ms) {
+    ::tc::detail::log_dedup_window_ns().store(std::uint64_t{window_ms} * 1000000, std::memory_order_relaxed);
+}
+
+struct dedup_stats {
+    std::uint64_t suppressed; // copies not logged
+    std::uint64_t summaries;  // runs closed with a repeat count
+};
+
+inline dedup_stats get_dedup_stats() {
+    const auto& c = ::tc::detail::this_process_log_dedup_counters();
+    return {c.suppressed.load(std::memory_order_relaxed), c.summaries.load(std::memory_order_relaxed)};
+}
+
+// Converts record::timestamp (raw clock ticks) to nanoseconds since the Unix epoch. Meant for sinks at formatting
+// time; the first call calibrates the tick rate, and calls refresh the calibration when it is
+// TC_CLOCK_RECALIBRATE_MS old.
+inline std::uint64_t timestamp_to_unix_ns(std::uint64_t ts) {
+    return static_cast<std::uint64_t>(::tc::detail::clock_ticks_to_unix_ns(ts));
+}
+
+struct clock_info {
+    const char* source;         // "tsc", "cntvct", "monotonic_coarse" or "steady_clock"
+    double ns_per_tick;         // as of the last calibration
+    std::uint64_t calibrations; // how many times the conversion has been anchored
+};
+
+inline clock_info get_clock_info() {
+    using namespace ::tc::detail;
+    const char* name = "steady_clock";
+    switch (this_process_clock().source) {
+    case clock_source::cycle_counter:
+#if defined(__aarch64__)
+        name = "cntvct";
+#else
+        name = "tsc";
+#endif
+        break;
+    case clock_source::monotonic_coarse:
+        name = "monotonic_coarse";
+        break;
+    case clock_source::steady:
+        break;
+    }
+    clock_calibration& cal = this_process_calibration();
+    return {name, cal.ns_per_tick.load(std::memory_order_relaxed), cal.calibrations.load(std::memory_order_relaxed)};
+}
+
+// Re-anchors the tick conversion to CLOCK_REALTIME now, e.g. right after the wall clock was stepped.
+inline void recalibrate_clock() {
+    ::tc::detail::calibrate_clock();
+}
+
+// Ready-made v2 sink: the default stderr format, one write(2) per batch.
+inline void stderr_record_sink(void*, const record* recs, std::size_t n) {
+    using namespace ::tc::detail;
+    char buf[2 * TC_LOG_MESSAGE_MAX + TC_LOG_CONTEXT_BYTES + 1024];
+    safe_buffer out{buf, sizeof(buf)};
+    for (std::size_t i = 0; i < n; ++i) {
+        const record& r = recs[i];
+        if (out.len > 0 && out.len + record_line_bound(r) > out.cap) {
+            safe_write(2, out.data, out.len);
+            out.len = 0;
+        }
+        append_record_line(out, r);
+    }
+    safe_write(2, out.data, out.len);
+}
+} // namespace log
+} // namespace tc
+
+// ===================== Log governor =====================
+namespace tc {
+namespace detail {
+inline void log_governor_report(const log_governor_summary& s) {
+    using ull = unsigned long long;
+    log_governor_reporting() = true;
+    logf(log_level::warn, __FILE__, __LINE__, "log_governor",
+         "log governor: dropped %llu records in %.1f s (trace %llu, debug %llu, info %llu, warn %llu), sampled %llu; "
+         "level floor %s",
+         static_cast<ull>(s.dropped[0] + s.dropped[1] + s.dropped[2] + s.dropped[3] + s.dropped[4]),
+         static_cast<double>(s.elapsed_ns) / 1e9, static_cast<ull>(s.dropped[0]), static_cast<ull>(s.dropped[1]),
+         static_cast<ull>(s.dropped[2]), static_cast<ull>(s.dropped[3]), static_cast<ull>(s.sampled),
+         log_level_tag(static_cast<log_level>(s.floor)));
+    log_governor_reporting() = false;
+}
+} // namespace detail
+
+namespace log {
+// Storm protection for TC_LOG_* and TC_LOG_*_KV, off until set_governor() is called. Budgets are per second and
+// enforced per window; 0 means no budget. `queue_depth(queue_ctx)` is polled once per window, e.g.
+// &tc::shm::producer::queue_depth. Errors are never dropped. While anything is dropped, a warning summarizing it is
+// logged at most once per `summary_ms`.
+struct governor_config {
+    std::uint64_t records_per_sec = 0;
+    std::uint64_t bytes_per_sec = 0; // formatted payload bytes
+    std::size_t (*queue_depth)(void* ctx) = nullptr;
+    void* queue_ctx = nullptr;
+    std::size_t max_queue_depth = 0;
+    unsigned sample_one_in = 0; // keep every Nth record the governor would drop; 0 drops them all
+    unsigned window_ms = 1000;
+    unsigned summary_ms = 10000;
+};
+
+// Starts (or reconfigures) the governor with a fresh window, no floor and nothing left to summarize.
+inline void set_governor(const governor_config& c) {
+    auto& g = ::tc::detail::this_process_log_governor();
+    const std::uint64_t window_ms = std::max(c.window_ms, 1u);
+    const auto per_window = [&](std::uint64_t per_sec) {
+        return per_sec == 0 ? 0 : std::max<std::uint64_t>(per_sec * window_ms / 1000, 1);
+    };
+    g.active.store(false, std::memory_order_relaxed);
+    {
+        ::tc::detail::log_governor_probe_guard lock(g);
+        g.queue_depth = c.queue_depth;
+        g.queue_ctx = c.queue_ctx;
+        g.max_queue_depth = c.max_queue_depth;
+    }
+    g.window_ns.store(window_ms * 1000000, std::memory_order_relaxed);
+    g.summary_ns.store(std::uint64_t{c.summary_ms} * 1000000, std::memory_order_relaxed);
+    g.max_records.store(per_window(c.records_per_sec), std::memory_order_relaxed);
+    g.max_bytes.store(per_window(c.bytes_per_sec), std::memory_order_relaxed);
+    g.sample_one_in.store(c.sample_one_in, std::memory_order_relaxed);
+    g.window_start.store(0, std::memory_order_relaxed);
+    g.last_summary.store(0, std::memory_order_relaxed);
+    g.passed.store(0, std::memory_order_relaxed);
+    g.bytes.store(0, std::memory_order_relaxed);
+    g.sampled.store(0, std::memory_order_relaxed);
+    for (int l = 0; l < ::tc::detail::log_governor::levels; ++l) {
+        g.offered[l].store(0, std::memory_order_relaxed);
+        g.dropped[l].store(0, std::memory_order_relaxed);
+    }
+    g.floor.store(static_cast<int>(level::trace), std::memory_order_relaxed);
+    g.active.store(true, std::memory_order_seq_cst);
+}
+
+// Turns the governor off; records are no longer counted.
+inline void clear_governor() {
+    ::tc::detail::this_process_log_governor().active.store(false, std::memory_order_seq_cst);
+}
+
+struct governor_stats {
+    bool active;
+    level floor;                  // records below it are being dropped (trace: none)
+    std::uint64_t dropped;        // since the process started
+    std::uint64_t summaries;      // summary warnings logged
+    std::size_t last_queue_depth; // as of the last window
+};
+
+inline governor_stats get_governor_stats() {
+    const auto& g = ::tc::detail::this_process_log_governor();
+    return {g.active.load(std::memory_order_relaxed), static_cast<level>(g.floor.load(std::memory_order_relaxed)),
+            g.dropped_total.load(std::memory_order_relaxed), g.summaries.load(std::memory_order_relaxed),
+            g.last_depth.load(std::memory_order_relaxed)};
+}
+} // namespace log
+} // namespace tc
+
+// ===================== Sink metrics =====================
+// Counters buffered sinks (tc/async_sink.hpp) keep for tc::log::stats(). The blocks form a process-wide list and
+// are never freed: a sink takes one, reusing a released block when it can, and releases it when destroyed, so the
+// list can be read without locks while sinks come and go.
+namespace tc {
+namespace detail {
+struct sink_metrics {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<bool> in_use{true};
+    sink_metrics* next = nullptr;
+
+    std::atomic<std::uint64_t> enqueued{0};
+    std::atomic<std::uint64_t> dropped{0};     // new records rejected while full
+    std::atomic<std::uint64_t> overwritten{0}; // queued records discarded to make room
+    std::atomic<std::uint64_t> spilled{0};     // records written synchronously to a fallback instead
+    std::atomic<std::uint64_t> blocked{0};     // times a producer waited for room
+    std::atomic<std::uint64_t> truncated{0};   // records cut to fit a queue cell, counted when drained
+    std::atomic<std::uint64_t> depth{0};       // queued records, as of the last enqueue
+    std::atomic<std::uint64_t> high_water{0};
+    std::atomic<std::uint64_t> drained{0};      // records handed to the downstream sink
+    std::atomic<std::uint64_t> drain_ns{0};     // total enqueue-to-delivery time of drained records
+    std::atomic<std::uint64_t> drain_max_ns{0}; // longest of them
+    std::atomic<std::uint64_t> sink_ns{0};      // total time spent in the downstream sink
+
+    void reset() {
+        for (auto* c : {&enqueued, &dropped, &overwritten, &spilled, &blocked, &truncated, &depth, &high_water,
+                        &drained, &drain_ns, &drain_max_ns, &sink_ns})
+            c->store(0, std::memory_order_relaxed);
+    }
+
+    static void raise(std::atomic<std::uint64_t>& max, std::uint64_t v) {
+        std::uint64_t cur = max.load(std::memory_order_relaxed);
+        while (v > cur && !max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+        }
+    }
+
+    void note_depth(std::uint64_t d) {
+        depth.store(d, std::memory_order_relaxed);
+        raise(high_water, d);
+    }
+
+    void note_drained(std::uint64_t n, std::uint64_t latency_ns, std::uint64_t latency_max_ns, std::uint64_t spent_ns) {
+        drained.fetch_add(n, std::memory_order_relaxed);
+        drain_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+        raise(drain_max_ns, latency_max_ns);
+        sink_ns.fetch_add(spent_ns, std::memory_order_relaxed);
+    }
+};
+
+inline std::atomic<sink_metrics*>& sink_metrics_list() {
+    static std::atomic<sink_metrics*> head{nullptr};
+    return head;
+}
+
+inline sink_metrics* acquire_sink_metrics(const char* name) {
+    for (sink_metrics* m = sink_metrics_list().load(std::memory_order_acquire); m != nullptr; m = m->next) {
+        bool used = false;
+        if (!m->in_use.load(std::memory_order_relaxed) &&
+            m->in_use.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+            m->reset();
+            m->name.store(name, std::memory_order_release);
+            return m;
+        }
+    }
+    auto* m = new sink_metrics;
+    m->name.store(name, std::memory_order_relaxed);
+    m->next = sink_metrics_list().load(std::memory_order_relaxed);
+    while (!sink_metrics_list().compare_exchange_weak(m->next, m, std::memory_order_release,
+                                                      std::memory_order_relaxed)) {
+    }
+    return m;
+}
+
+inline void release_sink_metrics(sink_metrics* m) {
+    if (m != nullptr)
+        m->in_use.store(false, std::memory_order_release);
+}
+} // namespace detail
+
+namespace log {
+// A snapshot of one buffered sink's counters, or of all of them added up (stats()).
+struct sink_stats {
+    const char* name = nullptr;
+    std::uint64_t enqueued = 0;
+    std::uint64_t dropped = 0;     // new records rejected while full (overflow::drop_newest)
+    std::uint64_t overwritten = 0; // queued records discarded to make room (overflow::overwrite_oldest)
+    std::uint64_t spilled = 0;     // records written synchronously to the fallback (overflow::spill)
+    std::uint64_t blocked = 0;     // times a producer waited for room (overflow::block)
+    std::uint64_t truncated = 0;   // records longer than TC_ASYNC_RECORD_BYTES, cut and marked "[truncated]"
+    std::uint64_t depth = 0;       // queued records as of the last enqueue
+    std::uint64_t high_water = 0;  // most records ever queued at once (the largest of any sink for stats())
+    std::uint64_t drained = 0;     // records handed to the downstream sink
+    double drain_latency_ns = 0;   // mean time from enqueue to delivery
+    std::uint64_t drain_latency_max_ns = 0;
+    double sink_ns_per_record = 0; // mean time the downstream sink spent per record
+};
+
+inline sink_stats snapshot_sink_stats(const ::tc::detail::sink_metrics& m) {
+    sink_stats r;
+    r.name = m.name.load(std::memory_order_acquire);
+    r.enqueued = m.enqueued.load(std::memory_order_relaxed);
+    r.dropped = m.dropped.load(std::memory_order_relaxed);
+    r.overwritten = m.overwritten.load(std::memory_order_relaxed);
+    r.spilled = m.spilled.load(std::memory_order_relaxed);
+    r.blocked = m.blocked.load(std::memory_order_relaxed);
+    r.truncated = m.truncated.load(std::memory_order_relaxed);
+    r.depth = m.depth.load(std::memory_order_relaxed);
+    r.high_water = m.high_water.load(std::memory_order_relaxed);
+    r.drained = m.drained.load(std::memory_order_relaxed);
+    r.drain_latency_max_ns = m.drain_max_ns.load(std::memory_order_relaxed);
+    if (r.drained != 0) {
+        r.drain_latency_ns =
+            static_cast<double>(m.drain_ns.load(std::memory_order_relaxed)) / static_cast<double>(r.drained);
+        r.sink_ns_per_record =
+            static_cast<double>(m.sink_ns.load(std::memory_order_relaxed)) / static_cast<double>(r.drained);
+    }
+    return r;
+}
+
+// Calls f(const sink_stats&) for every live buffered sink.
+template <class F> void for_each_sink_stats(F&& f) {
+    for (auto* m = ::tc::detail::sink_metrics_list().load(std::memory_order_acquire); m != nullptr; m = m->next) {
+        if (m->in_use.load(std::memory_order_acquire))
+            f(snapshot_sink_stats(*m));
+    }
+}
+
+// All live buffered sinks together: counters added up, high_water and drain_latency_max_ns the largest, means
+// weighted by records drained.
+inline sink_stats stats() {
+    sink_stats all;
+    all.name = "all";
+    double drain_ns = 0, sink_ns = 0;
+    for_each_sink_stats([&](const sink_stats& s) {
+        all.enqueued += s.enqueued;
+        all.dropped += s.dropped;
+        all.overwritten += s.overwritten;
+        all.spilled += s.spilled;
+        all.blocked += s.blocked;
+        all.truncated += s.truncated;
+        all.depth += s.depth;
+        all.high_water = std::max(all.high_water, s.high_water);
+        all.drained += s.drained;
+        all.drain_latency_max_ns = std::max(all.drain_latency_max_ns, s.drain_latency_max_ns);
+        drain_ns += s.drain_latency_ns * static_cast<double>(s.drained);
+        sink_ns += s.sink_ns_per_record * static_cast<double>(s.drained);
+    });
+    if (all.drained != 0) {
+        all.drain_latency_ns = drain_ns / static_cast<double>(all.drained);
+        all.sink_ns_per_record = sink_ns / static_cast<double>(all.drained);
+    }
+    return all;
+}
+} // namespace log
+} // namespace tc
+
+// ===================== Structured key-value logging =====================
+// TC_LOG_INFO_KV("msg", "user", id, "latency_us", t) encodes typed fields straight into a thread-local buffer as
+// one logfmt or JSON line and hands it to the KV sink as (level, data, len). No heap allocation; records longer
+// than TC_KV_BUFFER_SIZE drop the fields that do not fit and are marked truncated.
+#if !defined(TC_KV_BUFFER_SIZE)
+#define TC_KV_BUFFER_SIZE 2048
+#endif
+
+namespace tc {
+namespace log {
+enum class kv_format : int { logfmt = 0, json = 1 };
+} // namespace log
+
+namespace detail {
+
+using kv_sink_t = void (*)(log_level lvl, const char* data, std::size_t len);
+
+// Records end with '\n'.
+inline void default_kv_sink(log_level, const char* data, std::size_t len) {
+    std::fwrite(data, 1, len, stderr);
+}
+
+inline std::atomic<kv_sink_t>& runtime_kv_sink() {
+    static std::atomic<kv_sink_t> sink{&default_kv_sink};
+    return sink;
+}
+
+inline std::atomic<int>& runtime_kv_format() {
+    static std::atomic<int> fmt{static_cast<int>(log::kv_format::logfmt)};
+    return fmt;
+}
+
+// Offset of the first byte in [s, s+n) that needs escaping: control bytes, '"' and '\\', plus ' ' and '=' for
+// logfmt. Scans eight bytes per step with SWAR bit tricks; bytes >= 0x80 (UTF-8) pass through.
+inline std::size_t kv_find_special(const char* s, std::size_t n, bool logfmt) {
+    constexpr std::uint64_t ones = 0x0101010101010101ull;
+    constexpr std::uint64_t highs = 0x8080808080808080ull;
+    const std::uint64_t below = ones * (logfmt ? 0x21 : 0x20); // < '!' also catches ' ' for logfmt
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, s + i, 8);
+        const std::uint64_t q = w ^ (ones * '"');
+        const std::uint64_t b = w ^ (ones * '\\');
+        const std::uint64_t e = w ^ (ones * '=');
+        std::uint64_t hit = ((w - below) & ~w) | ((q - ones) & ~q) | ((b - ones) & ~b);
+        if (logfmt)
+            hit |= (e - ones) & ~e;
+        if (hit & highs)
+            break;
+    }
+    for (; i < n; ++i) {
+        const auto c = static_cast<unsigned char>(s[i]);
+        if (c < 0x20 || c == '"' || c == '\\' || (logfmt && (c == ' ' || c == '=')))
+            return i;
+    }
+    return n;
+}
+
+class kv_writer {
+  public:
+    kv_writer(char* buf, std::size_t cap, log::kv_format fmt) : buf_(buf), cap_(cap - reserve), fmt_(fmt) {}
+
+    bool json() const {
+        return fmt_ == log::kv_format::json;
+    }
+    std::size_t size() const {
+        return len_;
+    }
+
+    // Continues a record whose opening was written elsewhere: every field gets its leading separator.
+    void continuation() {
+        first_ = false;
+    }
+
+    // Appends fields rendered by a continuation writer of the same format; dropped as a whole if they do not fit.
+    void rendered(const char* s, std::size_t n) {
+        mark_ = len_;
+        raw(s, n);
+        end_field();
+    }
+
+    // Starts a field; on overflow the partial field is rolled back in end_field().
+    void begin_field(const char* key) {
+        mark_ = len_;
+        if (json()) {
+            raw(first_ ? "{" : ",", 1);
+            string(key, std::strlen(key), true);
+            raw(":", 1);
+        } else {
+            if (!first_)
+                raw(" ", 1);
+            raw(key, std::strlen(key));
+            raw("=", 1);
+        }
+    }
+    void end_field() {
+        if (overflow_) {
+            len_ = mark_;
+            overflow_ = false;
+            truncated_ = true;
+        } else {
+            first_ = false;
+        }
+    }
+
+    template <class T> void value(const T& v) {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same<U, bool>::value) {
+            v ? raw("true", 4) : raw("false", 5);
+        } else if constexpr (std::is_integral<U>::value) {
+            char tmp[24];
+            const auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+            raw(tmp, static_cast<std::size_t>(r.ptr - tmp));
+        } else if constexpr (std::is_floating_point<U>::value) {
+            floating(static_cast<double>(v));
+        } else if constexpr (std::is_enum<U>::value) {
+            value(static_cast<std::underlying_type_t<U>>(v));
+        } else if constexpr (std::is_same<U, std::nullptr_t>::value) {
+            json() ? raw("null", 4) : raw("\"\"", 2);
+        } else if constexpr (std::is_same<T, const char*>::value || std::is_same<T, char*>::value) {
+            value(std::string_view(v ? v : "(null)"));
+        } else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+            const std::string_view sv = v;
+            string(sv.data(), sv.size(), json());
+        } else {
+            static_assert(std::is_convertible<const T&, std::string_view>::value,
+                          "TC_LOG_*_KV values must be arithmetic, enum, bool or string-like");
+        }
+    }
+
+    // "file:line" without formatting through a temporary buffer.
+    void source(const char* file, int line) {
+        file = file ? file : "(unknown)";
+        const std::size_t n = std::strlen(file);
+        const bool quote = json() || kv_find_special(file, n, true) < n;
+        if (quote)
+            raw("\"", 1);
+        escaped(file, n);
+        raw(":", 1);
+        value(line);
+        if (quote)
+            raw("\"", 1);
+    }
+
+    // Closes the record; returns its length including the trailing newline.
+    std::size_t finish() {
+        cap_ += reserve;
+        if (truncated_) {
+            begin_field("truncated");
+            raw("true", 4);
+            end_field();
+        }
+        if (json())
+            raw(first_ ? "{}" : "}", first_ ? 2 : 1);
+        raw("\n", 1);
+        return len_;
+    }
+
+  private:
+    static constexpr std::size_t reserve = 24; // room for the truncation marker and the record terminator
+
+    void raw(const char* s, std::size_t n) {
+        if (overflow_ || len_ + n > cap_) {
+            overflow_ = true;
+            return;
+        }
+        std::memcpy(buf_ + len_, s, n);
+        len_ += n;
+    }
+
+    void floating(double d) {
+        if (d != d || d - d != 0) { // NaN or infinity
+            if (json())
+                raw("null", 4);
+            else
+                raw(d != d ? "NaN" : (d > 0 ? "+Inf" : "-Inf"), d != d ? 3 : 4);
+            return;
+        }
+        char tmp[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        const auto r = std::to_chars(tmp, tmp + sizeof(tmp), d);
+        raw(tmp, static_cast<std::size_t>(r.ptr - tmp));
+#else
+        const int n = std::snprintf(tmp, sizeof(tmp), "%.17g", d);
+        raw(tmp, n > 0 ? static_cast<std::size_t>(n) : 0);
+#endif
+    }
+
+    // JSON strings are always quoted; logfmt values only when they contain spaces, '=', quotes or controls.
+    void string(const char* s, std::size_t n, bool quote) {
+        if (!json() && (n == 0 || kv_find_special(s, n, true) < n))
+            quote = true;
+        if (quote)
+            raw("\"", 1);
+        escaped(s, n);
+        if (quote)
+            raw("\"", 1);
+    }
+
+    void escaped(const char* s, std::size_t n) {
+        const bool logfmt = !json();
+        std::size_t run = kv_find_special(s, n, logfmt);
+        while (n > 0) {
+            raw(s, run);
+            s += run;
+            n -= run;
+            if (n == 0)
+                break;
+            escape(static_cast<unsigned char>(*s));
+            ++s;
+            --n;
+            run = kv_find_special(s, n, logfmt);
+        }
+    }
+
+    void escape(unsigned char c) {
+        switch (c) {
+        case '"':
+            raw("\\\"", 2);
+            break;
+        case '\\':
+            raw("\\\\", 2);
+            break;
+        case '\n':
+            raw("\\n", 2);
+            break;
+        case '\r':
+            raw("\\r", 2);
+            break;
+        case '\t':
+            raw("\\t", 2);
+            break;
+        default:
+            if (c < 0x20) {
+                char tmp[7] = {'\\', 'u', '0', '0', "0123456789abcdef"[c >> 4], "0123456789abcdef"[c & 15], 0};
+                raw(tmp, 6);
+            } else {
+                raw(reinterpret_cast<const char*>(&c), 1); // ' ' or '=' inside a quoted logfmt value
+            }
+        }
+    }
+
+    char* buf_;
+    std::size_t cap_;
+    log::kv_format fmt_;
+    std::size_t len_ = 0;
+    std::size_t mark_ = 0;
+    bool first_ = true;
+    bool overflow_ = false;
+    bool truncated_ = false;
+};
+
+inline const char* kv_level_name(log_level lvl) {
+    static const char* const names[] = {"trace", "debug", "info", "warn", "error", "off"};
+    const int i = static_cast<int>(lvl);
+    return i >= 0 && i <= 5 ? names[i] : "log";
+}
+
+inline void kv_fields(kv_writer&) {}
+
+template <class V, class... Rest> void kv_fields(kv_writer& w, const char* key, const V& v, const Rest&... rest) {
+    w.begin_field(key);
+    w.value(v);
+    w.end_field();
+    kv_fields(w, rest...);
+}
+
+// KV records bypass the sink table, so only the global level (or the thread's override) applies.
+inline bool kv_level_enabled(log_level lvl) {
+    const int thread_lvl = this_thread_log_level();
+    return static_cast<int>(lvl) >= (thread_lvl < 0 ? runtime_log_level().load(std::memory_order_relaxed) : thread_lvl);
+}
+
+// One encoding buffer per thread, shared by every TC_LOG_*_KV instantiation.
+inline char* kv_buffer() {
+    static thread_local char buf[TC_KV_BUFFER_SIZE];
+    return buf;
+}
+
+template <class... KVs>
+void log_kv_deliver(log_level lvl, const char* file, int line, const char* msg, const KVs&... kvs) {
+    static_assert(sizeof...(KVs) % 2 == 0, "TC_LOG_*_KV expects a message followed by key, value pairs");
+    kv_sink_t sink = runtime_kv_sink().load(std::memory_order_relaxed);
+    if (sink == nullptr || !log_governor_admit(lvl))
+        return;
+    usdt_log(static_cast<int>(lvl), file, line, msg);
+    trace_record(trace_kind::log, 'i', msg, file, line, static_cast<std::uint16_t>(lvl));
+
+    char* buf = kv_buffer();
+    kv_writer w(buf, TC_KV_BUFFER_SIZE, static_cast<log::kv_format>(runtime_kv_format().load(std::memory_order_relaxed)));
+    kv_fields(w, "level", kv_level_name(lvl), "msg", msg);
+    w.begin_field("src");
+    w.source(file, line);
+    w.end_field();
+    const log_context& ctx = this_thread_log_context();
+    if (w.json())
+        w.rendered(ctx.json, ctx.json_len);
+    else
+        w.rendered(ctx.text, ctx.text_len);
+    kv_fields(w, kvs...);
+    const std::size_t len = w.finish();
+    log_governor_charge(len);
+    sink(lvl, buf, len);
+}
+
+template <class... KVs>
+void log_kv(log_level lvl, const char* file, int line, const char* func, const char* msg, const KVs&... kvs) {
+    (void)func;
+    if (kv_level_enabled(lvl))
+        log_kv_deliver(lvl, file, line, msg, kvs...);
+}
+
+} // namespace detail
+
+namespace log {
+using kv_sink_t = ::tc::detail::kv_sink_t;
+inline void set_kv_sink(kv_sink_t s) {
+    ::tc::detail::runtime_kv_sink().store(s, std::memory_order_relaxed);
+}
+inline kv_sink_t get_kv_sink() {
+    return ::tc::detail::runtime_kv_sink().load(std::memory_order_relaxed);
+}
+inline void set_kv_format(kv_format f) {
+    ::tc::detail::runtime_kv_format().store(static_cast<int>(f), std::memory_order_relaxed);
+}
+inline kv_format get_kv_format() {
+    return static_cast<kv_format>(::tc::detail::runtime_kv_format().load(std::memory_order_relaxed));
+}
+} // namespace log
+} // namespace tc
+
+// TC_LOG_KV_SITE_ is defined with the log sites below.
+#define TC_LOG_TRACE_KV(...) TC_LOG_KV_SITE_(trace, __VA_ARGS__)
+#define TC_LOG_DEBUG_KV(...) TC_LOG_KV_SITE_(debug, __VA_ARGS__)
+#define TC_LOG_INFO_KV(...) TC_LOG_KV_SITE_(info, __VA_ARGS__)
+#define TC_LOG_WARN_KV(...) TC_LOG_KV_SITE_(warn, __VA_ARGS__)
+#define TC_LOG_ERROR_KV(...) TC_LOG_KV_SITE_(error, __VA_ARGS__)
+
+// ===================== Log sites =====================
+// With TC_LOG_SITES=1, every TC_LOG_* and TC_LOG_*_KV statement owns a static log_site: its file, function, line and
+// level, plus a state byte the statement reads before anything else. Sites are constant-initialized and linked
+// into one list by static initializers, so every site compiled into the program (and into shared libraries loaded
+// so far) is listed from main() on, including sites that have not run yet. Switching a site works like Linux
+// dynamic_debug:
+//   tc::log::control_sites("file=net/*.cpp func=parse* +"); // these sites log whatever the level
+// A site that is `on` skips the global and per-thread level; each sink's minimum level still applies.
+namespace tc {
+namespace detail {
+
+enum class log_site_state : std::uint8_t { level = 0, on = 1, off = 2 };
+
+struct log_site {
+    const char* file;
+    const char* func;
+    int line;
+    log_level level;
+    std::atomic<log_site_state> state;
+    log_site* next;
+};
+
+inline std::atomic<log_site*>& log_site_list() {
+    static std::atomic<log_site*> head{nullptr};
+    return head;
+}
+
+inline bool register_log_site(log_site* s) {
+    auto& head = log_site_list();
+    s->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(s->next, s, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+#if defined(__linux__) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__aarch64__))
+#define TC_LOG_STATIC_KEYS_SUPPORTED 1
+// Hidden, so a static key can name its site as an assembler constant in position-independent code too.
+#define TC_LOG_SITE_VISIBILITY __attribute__((visibility("hidden")))
+#else
+#define TC_LOG_STATIC_KEYS_SUPPORTED 0
+#define TC_LOG_SITE_VISIBILITY
+#endif
+
+// The site of one TC_LOG_* statement; Tag is a local class the macro declares to describe it. Naming
+// `registered` instantiates its initializer, which runs with the other static initializers.
+template <class Tag> struct log_site_of {
+    TC_LOG_SITE_VISIBILITY static log_site site;
+    static const bool registered;
+};
+
+template <class Tag>
+log_site log_site_of<Tag>::site{Tag::file(), Tag::func(), Tag::line(), Tag::level(), {log_site_state::level}, nullptr};
+
+template <class Tag> const bool log_site_of<Tag>::registered = register_log_site(&log_site_of<Tag>::site);
+
+// ===================== Static keys =====================
+// With TC_LOG_STATIC_KEYS=1 (x86-64 and AArch64 Linux), a site starts with an asm goto: an 8-byte nop on x86-64
+// (4 bytes on AArch64) while the site cannot log, patched into a jump to the usual checks while it might. Each
+// such instruction has an entry in the tc_jump_table section (in the same COMDAT group as its function, so
+// discarded copies take their entries with them); every module registers its table from a static initializer.
+// A site's key is on when its state is `on`, or `level` with a level at or above the lower of the global level and
+// the lowest level any scoped_thread_level has used. Every site is compiled as the jump, and registration patches
+// the ones that are off into nops; updates are redone on set_level(), set_site_state() and when a thread override
+// first goes below the global level. Each store is one aligned 8- or 4-byte write made while the code page is
+// writable (its protection from /proc/self/maps is put back afterwards), and once a pass is done
+// membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE) makes every thread execute a core-serializing instruction
+// before it returns, so no thread keeps running a stale prefetch of the old instruction. Without that command
+// (Linux < 4.16), or where the page cannot be made writable, an instruction is left as it is: sites that were never
+// patched keep their jump and behave like the plain checks, and tc::log::get_static_key_stats() counts what could
+// not be patched.
+//
+// Known limitation on x86-64: the store happens while other threads may be executing the instruction. AArch64
+// explicitly allows concurrent modification between B and NOP, but the Intel SDM ("Handling Self- and
+// Cross-Modifying Code") makes no such promise. It only covers code that no other processor executes until it has
+// serialized after the write. The 8-byte slot never straddles a cache line or fetch block, so current cores fetch
+// either the old or the new instruction, but a fetch that mixed the two (a jmp opcode with nop displacement
+// bytes) would jump to a wrong address. The kernel avoids this with an int3 breakpoint protocol (text_poke_bp);
+// here it would take a process-wide SIGTRAP handler, which debuggers and other tools already rely on. Programs
+// that cannot accept the risk should change levels and site states only while no other thread logs, or leave
+// TC_LOG_STATIC_KEYS off on x86-64.
+struct log_jump_entry {
+    std::uintptr_t code;   // the patchable instruction
+    std::uintptr_t target; // where it jumps to when on
+    log_site* site;
+};
+
+#if TC_LOG_STATIC_KEYS_SUPPORTED
+} // namespace detail
+} // namespace tc
+
+extern "C" {
+extern ::tc::detail::log_jump_entry __start_tc_jump_table[] __attribute__((weak, visibility("hidden")));
+extern ::tc::detail::log_jump_entry __stop_tc_jump_table[] __attribute__((weak, visibility("hidden")));
+}
+
+namespace tc {
+namespace detail {
+
+struct log_jump_tables {
+    static constexpr int max = 64; // modules (executable, shared libraries) using static keys
+    int count = 0;
+    log_jump_entry* begin[max];
+    log_jump_entry* end[max];
+    std::size_t failed = 0; // entries the last update could not patch
+};
+
+inline log_jump_tables& log_jump_tables_registry() {
+    static log_jump_tables t;
+    return t;
+}
+
+inline std::atomic_flag& log_jump_patch_lock() {
+    static std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    return busy;
+}
+
+class log_jump_patch_guard {
+  public:
+    log_jump_patch_guard() {
+        while (log_jump_patch_lock().test_and_set(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+    ~log_jump_patch_guard() {
+        log_jump_patch_lock().clear(std::memory_order_release);
+    }
+    log_jump_patch_guard(const log_jump_patch_guard&) = delete;
+    log_jump_patch_guard& operator=(const log_jump_patch_guard&) = delete;
+};
+
+inline bool log_site_key_wanted(const log_site& s) {
+    const log_site_state st = s.state.load(std::memory_order_relaxed);
+    if (st != log_site_state::level)
+        return st == log_site_state::on;
+    const int floor = std::min(runtime_log_level().load(std::memory_order_relaxed),
+                               log_key_thread_floor().load(std::memory_order_relaxed));
+    return static_cast<int>(s.level) >= floor;
+}
+
+#if defined(__x86_64__)
+using log_jump_insn = std::uint64_t;
+
+inline bool log_jump_is_on(const log_jump_entry& e) {
+    return *reinterpret_cast<const unsigned char*>(e.code) == 0xe9;
+}
+
+// jmp rel32 followed by three int3, or the 8-byte nop `nopl 0x0(%rax,%rax,1)`.
+inline log_jump_insn log_jump_encode(const log_jump_entry& e, bool on) {
+    unsigned char b[8] = {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00};
+    if (on) {
+        const auto rel = static_cast<std::int32_t>(static_cast<std::intptr_t>(e.target - (e.code + 5)));
+        b[0] = 0xe9;
+        std::memcpy(b + 1, &rel, 4);
+        b[5] = b[6] = b[7] = 0xcc;
+    }
+    log_jump_insn v;
+    std::memcpy(&v, b, sizeof(v));
+    return v;
+}
+#else
+using log_jump_insn = std::uint32_t;
+
+inline bool log_jump_is_on(const log_jump_entry& e) {
+    return (*reinterpret_cast<const std::uint32_t*>(e.code) & 0xfc000000u) == 0x14000000u;
+}
+
+// b <target>, or nop.
+inline log_jump_insn log_jump_encode(const log_jump_entry& e, bool on) {
+    if (!on)
+        return 0xd503201fu;
+    const auto words = static_cast<std::int64_t>(e.target - e.code) / 4;
+    return 0x14000000u | (static_cast<std::uint32_t>(words) & 0x03ffffffu);
+}
+#endif
+
+// Registers for membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE) once; without it nothing is patched.
+inline bool log_jump_sync_core_ready() {
+#if defined(SYS_membarrier)
+    static const bool ok = [] {
+        constexpr int query = 0, sync_core = 1 << 5, register_sync_core = 1 << 6;
+        const long cmds = ::syscall(SYS_membarrier, query, 0);
+        return cmds > 0 && (cmds & sync_core) != 0 && ::syscall(SYS_membarrier, register_sync_core, 0) == 0;
+    }();
+    return ok;
+#else
+    return false;
+#endif
+}
+
+// Serializes the instruction stream of every thread of the process; true once they all have.
+inline bool log_jump_sync_cores() {
+#if defined(SYS_membarrier)
+    return ::syscall(SYS_membarrier, 1 << 5 /* PRIVATE_EXPEDITED_SYNC_CORE */, 0) == 0;
+#else
+    return false;
+#endif
+}
+
+// The protection of the mapping that holds `page`, from /proc/self/maps; -1 if it cannot be found.
+inline int log_jump_page_protection(std::uintptr_t page) {
+    std::FILE* maps = std::fopen("/proc/self/maps", "re");
+    if (maps == nullptr)
+        return -1;
+    int prot = -1;
+    bool line_start = true; // fgets() returns a line longer than the buffer in pieces
+    char line[256];
+    while (prot < 0 && std::fgets(line, sizeof(line), maps) != nullptr) {
+        unsigned long lo = 0, hi = 0;
+        char perms[5] = {};
+        if (line_start && std::sscanf(line, "%lx-%lx %4s", &lo, &hi, perms) == 3 && page >= lo && page < hi)
+            prot = (perms[0] == 'r' ? PROT_READ : 0) | (perms[1] == 'w' ? PROT_WRITE : 0) |
+                   (perms[2] == 'x' ? PROT_EXEC : 0);
+        line_start = std::strchr(line, '\n') != nullptr;
+    }
+    std::fclose(maps);
+    return prot;
+}
+
+// Brings every entry of one table in line with its site; returns how many could not be patched and sets `patched`
+// if any instruction changed. Called with the patch lock held.
+inline std::size_t patch_log_jump_table(log_jump_entry* begin, log_jump_entry* end, bool& patched) {
+    const bool can_patch = log_jump_sync_core_ready();
+    const auto page_size = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+    std::uintptr_t writable = 0; // the page made writable for the previous entry, if any
+    int writable_prot = 0;       // and the protection to give it back
+    std::size_t failed = 0;
+    for (log_jump_entry* e = begin; e != end; ++e) {
+        const bool on = log_site_key_wanted(*e->site);
+        if (log_jump_is_on(*e) == on)
+            continue;
+        const std::uintptr_t page = e->code & ~(page_size - 1);
+        if (page != writable) {
+            if (writable != 0)
+                ::mprotect(reinterpret_cast<void*>(writable), page_size, writable_prot);
+            writable = 0;
+            const int prot = can_patch ? log_jump_page_protection(page) : -1;
+            if (prot < 0 || ::mprotect(reinterpret_cast<void*>(page), page_size, prot | PROT_WRITE) != 0) {
+                ++failed;
+                continue;
+            }
+            writable = page;
+            writable_prot = prot;
+        }
+        __atomic_store_n(reinterpret_cast<log_jump_insn*>(e->code), log_jump_encode(*e, on), __ATOMIC_RELEASE);
+#if defined(__aarch64__)
+        __builtin___clear_cache(reinterpret_cast<char*>(e->code), reinterpret_cast<char*>(e->code + 4));
+#endif
+        patched = true;
+    }
+    if (writable != 0)
+        ::mprotect(reinterpret_cast<void*>(writable), page_size, writable_prot);
+    return failed;
+}
+
+inline void update_log_site_keys() {
+    log_jump_patch_guard g;
+    log_jump_tables& t = log_jump_tables_registry();
+    bool patched = false;
+    t.failed = 0;
+    for (int i = 0; i < t.count; ++i)
+        t.failed += patch_log_jump_table(t.begin[i], t.end[i], patched);
+    if (patched)
+        log_jump_sync_cores();
+}
+
+// Called from a static initializer in every translation unit built with TC_LOG_STATIC_KEYS=1.
+inline bool register_log_jump_table(log_jump_entry* begin, log_jump_entry* end) {
+    if (begin == nullptr || begin == end)
+        return false;
+    log_jump_patch_guard g;
+    log_jump_tables& t = log_jump_tables_registry();
+    for (int i = 0; i < t.count; ++i) {
+        if (t.begin[i] == begin)
+            return true;
+    }
+    if (t.count == log_jump_tables::max)
+        return false;
+    t.begin[t.count] = begin;
+    t.end[t.count] = end;
+    ++t.count;
+    bool patched = false;
+    t.failed += patch_log_jump_table(begin, end, patched); // turns off the sites below the current level
+    if (patched)
+        log_jump_sync_cores();
+    return true;
+}
+
+// The static key of the site Tag describes: false while its instruction is a nop. There is one instantiation per
+// site, so the asm operands are constants even where it is not inlined. It starts as the jump, so a site that is
+// never patched (before its module registers, or where patching is unavailable) runs the plain checks.
+template <class Tag> __attribute__((always_inline)) inline bool log_site_key() {
+#if defined(__x86_64__)
+    __asm__ goto(".p2align 3\n"
+                 "1: .byte 0xe9\n"
+                 ".long %l[on] - 1b - 5\n"
+                 ".byte 0xcc, 0xcc, 0xcc\n"
+                 ".pushsection tc_jump_table, \"aw?\"\n"
+                 ".balign 8\n"
+                 ".quad 1b, %l[on], %c0\n"
+                 ".popsection\n"
+                 :
+                 : "i"(&log_site_of<Tag>::site)
+                 :
+                 : on);
+#else
+    __asm__ goto("1: b %l[on]\n"
+                 ".pushsection tc_jump_table, \"aw?\"\n"
+                 ".balign 8\n"
+                 ".quad 1b, %l[on], %c0\n"
+                 ".popsection\n"
+                 :
+                 : "i"(&log_site_of<Tag>::site)
+                 :
+                 : on);
+#endif
+    return false;
+on:
+    return true;
+}
+
+// Whether any instruction of `s` is currently patched in.
+inline bool log_site_key_on(const log_site& s) {
+    log_jump_patch_guard g;
+    const log_jump_tables& t = log_jump_tables_registry();
+    for (int i = 0; i < t.count; ++i) {
+        for (const log_jump_entry* e = t.begin[i]; e != t.end[i]; ++e) {
+            if (e->site == &s && log_jump_is_on(*e))
+                return true;
+        }
+    }
+    return false;
+}
+#else
+inline void update_log_site_keys() {}
+#endif
+
+inline bool log_site_enabled(const log_site& s) {
+    const log_site_state st = s.state.load(std::memory_order_relaxed);
+    if (TC_LIKELY(st == log_site_state::level))
+        return log_level_enabled(s.level);
+    return st == log_site_state::on;
+}
+
+inline bool kv_site_enabled(const log_site& s) {
+    const log_site_state st = s.state.load(std::memory_order_relaxed);
+    if (TC_LIKELY(st == log_site_state::level))
+        return kv_level_enabled(s.level);
+    return st == log_site_state::on;
+}
+
+inline void logf_site(const log_site& s, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vlog_deliver(s.level, s.file, s.line, s.func, fmt, ap);
+    va_end(ap);
+}
+
+template <class... KVs> void log_kv_site(const log_site& s, const char* msg, const KVs&... kvs) {
+    log_kv_deliver(s.level, s.file, s.line, msg, kvs...);
+}
+
+// '*' matches any run of characters, '?' any single one.
+inline bool glob_match(const char* pat, const char* s) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*s != '\0') {
+        if (*pat == '*') {
+            star = pat++;
+            resume = s;
+        } else if (*pat == '?' || *pat == *s) {
+            ++pat;
+            ++s;
+        } else if (star != nullptr) {
+            pat = star + 1;
+            s = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pat == '*')
+        ++pat;
+    return *pat == '\0';
+}
+
+// Matches the full __FILE__ or its base name.
+inline bool site_file_matches(const char* glob, const char* file) {
+    const char* base = file;
+    for (const char* p = file; *p != '\0'; ++p) {
+        if (*p == '/' || *p == '\\')
+            base = p + 1;
+    }
+    return glob_match(glob, file) || glob_match(glob, base);
+}
+
+// "N", "A-B", or a glob over the decimal line number.
+inline bool site_line_matches(const char* spec, int line) {
+    char* end = nullptr;
+    const long first = std::strtol(spec, &end, 10);
+    if (end != spec && *end == '\0')
+        return line == first;
+    if (end != spec && *end == '-') {
+        const char* from = end + 1;
+        const long last = std::strtol(from, &end, 10);
+        if (end != from && *end == '\0')
+            return line >= first && line <= last;
+    }
+    char num[16];
+    std::snprintf(num, sizeof(num), "%d", line);
+    return glob_match(spec, num);
+}
+
+} // namespace detail
+
+namespace log {
+using site_state = ::tc::detail::log_site_state;
+
+// A TC_LOG_* statement as listed by for_each_site().
+struct site_info {
+    const char* file;
+    const char* func;
+    int line;
+    level lvl;
+    site_state state;
+};
+
+// Calls f(const site_info&) for every registered site, most recently registered first.
+template <class F> void for_each_site(F&& f) {
+    for (const auto* s = ::tc::detail::log_site_list().load(std::memory_order_acquire); s != nullptr; s = s->next)
+        f(site_info{s->file, s->func, s->line, s->level, s->state.load(std::memory_order_relaxed)});
+}
+
+// Puts every site whose file, function and line match into `st`: `on` logs regardless of level, `off` never logs,
+// `level` restores normal filtering. A null or "*" pattern matches everything; `file` matches the full __FILE__ or
+// its base name, `line` is "N", "A-B" or a glob. Returns the number of sites matched.
+inline std::size_t set_site_state(const char* file, const char* func, const char* line, site_state st) {
+    std::size_t n = 0;
+    for (auto* s = ::tc::detail::log_site_list().load(std::memory_order_acquire); s != nullptr; s = s->next) {
+        if ((file == nullptr || ::tc::detail::site_file_matches(file, s->file)) &&
+            (func == nullptr || ::tc::detail::glob_match(func, s->func)) &&
+            (line == nullptr || ::tc::detail::site_line_matches(line, s->line))) {
+            s->state.store(st, std::memory_order_relaxed);
+            ++n;
+        }
+    }
+    if (n != 0)
+        ::tc::detail::update_log_site_keys();
+    return n;
+}
+
+// TC_LOG_STATIC_KEYS instructions in this process: how many are patched in, and how many the last update could
+// not patch because membarrier(2) cannot serialize other threads or their code page could not be made writable.
+struct static_key_stats {
+    std::size_t entries = 0;
+    std::size_t on = 0;
+    std::size_t failed = 0;
+};
+
+inline static_key_stats get_static_key_stats() {
+    static_key_stats r;
+#if TC_LOG_STATIC_KEYS_SUPPORTED
+    ::tc::detail::log_jump_patch_guard g;
+    const auto& t = ::tc::detail::log_jump_tables_registry();
+    for (int i = 0; i < t.count; ++i) {
+        for (const auto* e = t.begin[i]; e != t.end[i]; ++e) {
+            ++r.entries;
+            r.on += ::tc::detail::log_jump_is_on(*e) ? 1 : 0;
+        }
+    }
+    r.failed = t.failed;
+#endif
+    return r;
+}
+
+// Text form of set_site_state() for admin endpoints and environment variables, in the style of dynamic_debug:
+//   "file=net/*.cpp func=parse* line=100-200 +"   + on, - off, = back to level filtering
+// Omitted keys match everything. Returns the number of sites matched, or -1 for a malformed spec.
+inline long control_sites(const char* spec) {
+    char file[256] = "", func[256] = "", line[64] = "";
+    char action = 0;
+    const char* p = spec;
+    for (;;) {
+        while (*p == ' ' || *p == '\t')
+            ++p;
+        if (*p == '\0')
+            break;
+        const char* end = p;
+        while (*end != '\0' && *end != ' ' && *end != '\t')
+            ++end;
+        const std::size_t len = static_cast<std::size_t>(end - p);
+        if (len == 1 && (*p == '+' || *p == '-' || *p == '=') && action == 0) {
+            action = *p;
+        } else {
+            const char* eq = static_cast<const char*>(std::memchr(p, '=', len));
+            if (eq == nullptr || eq == p)
+                return -1;
+            const std::string_view key(p, static_cast<std::size_t>(eq - p));
+            char* dst = key == "file" ? file : key == "func" ? func : key == "line" ? line : nullptr;
+            const std::size_t cap = key == "line" ? sizeof(line) : sizeof(file);
+            const std::size_t vlen = static_cast<std::size_t>(end - eq - 1);
+            if (dst == nullptr || vlen == 0 || vlen >= cap)
+                return -1;
+            std::memcpy(dst, eq + 1, vlen);
+            dst[vlen] = '\0';
+        }
+        p = end;
+    }
+    if (action == 0)
+        return -1;
+    const site_state st = action == '+' ? site_state::on : action == '-' ? site_state::off : site_state::level;
+    return static_cast<long>(set_site_state(file[0] ? file : nullptr, func[0] ? func : nullptr,
+                                            line[0] ? line : nullptr, st));
+}
+} // namespace log
+} // namespace tc
+
+#if TC_LOG_SITES && TC_LOG_STATIC_KEYS && TC_LOG_STATIC_KEYS_SUPPORTED
+#define TC_LOG_SITE_KEY_(tag) ::tc::detail::log_site_key<tag>()
+namespace {
+// This translation unit's module (executable or shared library) has a jump table to keep patched.
+[[maybe_unused]] const bool tc_log_jump_table_registered =
+    ::tc::detail::register_log_jump_table(__start_tc_jump_table, __stop_tc_jump_table);
+} // namespace
+#else
+#define TC_LOG_SITE_KEY_(tag) true
+#endif
+
+#if TC_LOG_SITES
+// Runs `call` (which names the site as _tc_site::site) when enabled(site) holds. A statement, since the site's
+// tag class needs a declaration; it declares nothing static, so it still compiles inside constexpr functions.
+#define TC_LOG_AT_SITE_(lvl, enabled, call)                                                                            \
+    do {                                                                                                               \
+        constexpr const char* _tc_site_func = __func__;                                                                \
+        struct _tc_site_tag {                                                                                          \
+            static constexpr const char* file() {                                                                      \
+                return __FILE__;                                                                                       \
+            }                                                                                                          \
+            static constexpr const char* func() {                                                                      \
+                return _tc_site_func;                                                                                  \
+            }                                                                                                          \
+            static constexpr int line() {                                                                              \
+                return __LINE__;                                                                                       \
+            }                                                                                                          \
+            static constexpr ::tc::detail::log_level level() {                                                         \
+                return ::tc::detail::log_level::lvl;                                                                   \
+            }                                                                                                          \
+        };                                                                                                             \
+        using _tc_site = ::tc::detail::log_site_of<_tc_site_tag>;                                                      \
+        (void)_tc_site::registered;                                                                                    \
+        if (TC_LOG_SITE_KEY_(_tc_site_tag) && enabled(_tc_site::site))                                                 \
+            call;                                                                                                      \
+    } while (0)
+#define TC_LOG_SITE_(lvl, ...)                                                                                         \
+    TC_LOG_AT_SITE_(lvl, ::tc::detail::log_site_enabled, ::tc::detail::logf_site(_tc_site::site, __VA_ARGS__))
+#define TC_LOG_KV_SITE_(lvl, ...)                                                                                      \
+    TC_LOG_AT_SITE_(lvl, ::tc::detail::kv_site_enabled, ::tc::detail::log_kv_site(_tc_site::site, __VA_ARGS__))
+#else
+#define TC_LOG_SITE_(lvl, ...)                                                                                         \
+    ::tc::detail::logf(::tc::detail::log_level::lvl, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define TC_LOG_KV_SITE_(lvl, ...)                                                                                      \
+    ::tc::detail::log_kv(::tc::detail::log_level::lvl, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#endif
+
+// ===================== Mapped diagnostic context =====================
+// TC_LOG_SCOPE_FIELD("req", id) adds a field to every record the current thread logs until the enclosing scope
+// ends: appended to text lines ("... msg req=42"), passed to v2 sinks as record::context and added to KV records
+// as a field. Scopes nest and must end in reverse order. Fields that do not fit in TC_LOG_CONTEXT_FIELDS /
+// TC_LOG_CONTEXT_BYTES are left out. tc::log::capture_context() and tc::log::scoped_context carry the fields over
+// to a task running on another thread. Nothing here allocates.
+namespace tc {
+namespace detail {
+
+template <class V> bool push_log_context(const char* key, const V& v) {
+    log_context& ctx = this_thread_log_context();
+    if (ctx.count == TC_LOG_CONTEXT_FIELDS)
+        return false;
+    char text[TC_LOG_CONTEXT_BYTES + 32];
+    char json[TC_LOG_CONTEXT_BYTES + 32];
+    kv_writer t(text, sizeof(text), log::kv_format::logfmt);
+    kv_writer j(json, sizeof(json), log::kv_format::json);
+    t.continuation();
+    j.continuation();
+    kv_fields(t, key, v);
+    kv_fields(j, key, v);
+    if (t.size() == 0 || j.size() == 0 || ctx.text_len + t.size() > sizeof(ctx.text) ||
+        ctx.json_len + j.size() > sizeof(ctx.json))
+        return false;
+    ctx.text_marks[ctx.count] = static_cast<std::uint16_t>(ctx.text_len);
+    ctx.json_marks[ctx.count] = static_cast<std::uint16_t>(ctx.json_len);
+    std::memcpy(ctx.text + ctx.text_len, text, t.size());
+    std::memcpy(ctx.json + ctx.json_len, json, j.size());
+    ctx.text_len += t.size();
+    ctx.json_len += j.size();
+    ++ctx.count;
+    return true;
+}
+
+inline void pop_log_context() {
+    log_context& ctx = this_thread_log_context();
+    if (ctx.count == 0)
+        return;
+    --ctx.count;
+    ctx.text_len = ctx.text_marks[ctx.count];
+    ctx.json_len = ctx.json_marks[ctx.count];
+}
+
+class log_context_scope {
+  public:
+    template <class V> log_context_scope(const char* key, const V& v) : pushed_(push_log_context(key, v)) {}
+    ~log_context_scope() {
+        if (pushed_)
+            pop_log_context();
+    }
+    log_context_scope(const log_context_scope&) = delete;
+    log_context_scope& operator=(const log_context_scope&) = delete;
+
+  private:
+    bool pushed_;
+};
+
+} // namespace detail
+
+namespace log {
+// The calling thread's fields as logfmt ("req=42 tenant=acme"), e.g. for a legacy sink_t.
+inline std::string_view context() {
+    return ::tc::detail::this_thread_log_context().view();
+}
+
+// A copy of one thread's fields (fixed size, no allocation), to be installed on another thread.
+class context_snapshot {
+  public:
+    std::string_view view() const {
+        return ctx_.view();
+    }
+
+  private:
+    friend context_snapshot capture_context();
+    friend class scoped_context;
+    ::tc::detail::log_context ctx_;
+};
+
+inline context_snapshot capture_context() {
+    context_snapshot s;
+    s.ctx_.assign(::tc::detail::this_thread_log_context());
+    return s;
+}
+
+// Replaces the calling thread's fields with a snapshot until the end of the scope, then puts the old ones back:
+//   auto ctx = tc::log::capture_context();
+//   pool.submit([ctx] { tc::log::scoped_context use(ctx); TC_LOG_INFO("running"); });
+class scoped_context {
+  public:
+    explicit scoped_context(const context_snapshot& s) {
+        ::tc::detail::log_context& cur = ::tc::detail::this_thread_log_context();
+        saved_.assign(cur);
+        cur.assign(s.ctx_);
+    }
+    ~scoped_context() {
+        ::tc::detail::this_thread_log_context().assign(saved_);
+    }
+    scoped_context(const scoped_context&) = delete;
+    scoped_context& operator=(const scoped_context&) = delete;
+
+  private:
+    ::tc::detail::log_context saved_;
+};
+} // namespace log
+} // namespace tc
+
+#define TC_LOG_SCOPE_FIELD(key, value)                                                                                 \
+    ::tc::detail::log_context_scope TC_CONCAT(_tc_log_field_, __LINE__)((key), (value))
+
+// ===================== Throw-site circuit breaker =====================
+// TC_THROW_OR_RETURN(ex, errval): throw `ex` via TC_THROW, unless this site has thrown more than the configured
+// threshold within the current window. A tripped site returns `errval` instead (counted and logged once per trip)
+// until the cool-down elapses, then goes back to throwing. Use `TC_THROW_OR_RETURN(ex, )` in void functions.
+// In no-exception builds the site always returns `errval`, since throwing would abort.
+namespace tc {
+namespace detail {
+
+struct breaker_config {
+    std::atomic<std::uint32_t> threshold{1000}; // throws per window; 0 disables the breaker
+    std::atomic<std::uint32_t> window_ms{1000};
+    std::atomic<std::uint32_t> cooldown_ms{5000};
+};
+
+struct breaker_counters {
+    std::atomic<std::uint64_t> trips{0};
+    std::atomic<std::uint64_t> suppressed{0};
+};
+
+inline breaker_config& runtime_breaker_config() {
+    static breaker_config cfg;
+    return cfg;
+}
+
+inline breaker_counters& runtime_breaker_counters() {
+    static breaker_counters c;
+    return c;
+}
+
+inline std::uint64_t breaker_now_ms() {
+    using namespace std::chrono;
+    // +1 keeps 0 free as the "closed" marker for open_until_ms.
+    return static_cast<std::uint64_t>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count()) + 1;
+}
+
+// Per-site state; constant-initialized so a function-local static needs no guard.
+struct throw_site_breaker {
+    std::atomic<std::uint64_t> window_start_ms{0};
+    std::atomic<std::uint32_t> window_count{0};
+    std::atomic<std::uint64_t> open_until_ms{0};
+    std::atomic<std::uint64_t> suppressed{0};
+
+    // Returns true if the caller should throw, false if it should take the error-code path.
+    bool allow_throw(const char* file, int line, const char* func) noexcept {
+        auto& cfg = runtime_breaker_config();
+        const std::uint32_t threshold = cfg.threshold.load(std::memory_order_relaxed);
+        if (threshold == 0)
+            return true;
+        const std::uint64_t now = breaker_now_ms();
+
+        std::uint64_t open = open_until_ms.load(std::memory_order_relaxed);
+        if (open != 0) {
+            if (now < open)
+                return suppress();
+            if (open_until_ms.compare_exchange_strong(open, 0, std::memory_order_relaxed)) {
+                window_start_ms.store(now, std::memory_order_relaxed);
+                window_count.store(0, std::memory_order_relaxed);
+                logf(log_level::info, file, line, func, "throw breaker closed after %llu suppressed throws",
+                     static_cast<unsigned long long>(suppressed.load(std::memory_order_relaxed)));
+            }
+        }
+
+        std::uint64_t start = window_start_ms.load(std::memory_order_relaxed);
+        if (now - start >= cfg.window_ms.load(std::memory_order_relaxed) &&
+            window_start_ms.compare_exchange_strong(start, now, std::memory_order_relaxed))
+            window_count.store(0, std::memory_order_relaxed);
+
+        if (window_count.fetch_add(1, std::memory_order_relaxed) < threshold)
+            return true;
+
+        const std::uint32_t cooldown = cfg.cooldown_ms.load(std::memory_order_relaxed);
+        std::uint64_t closed = 0;
+        if (open_until_ms.compare_exchange_strong(closed, now + cooldown, std::memory_order_relaxed)) {
+            runtime_breaker_counters().trips.fetch_add(1, std::memory_order_relaxed);
+            logf(log_level::warn, file, line, func,
+                 "throw breaker open: more than %u throws per %u ms, returning error code for %u ms", threshold,
+                 cfg.window_ms.load(std::memory_order_relaxed), cooldown);
+        }
+        return suppress();
+    }
+
+  private:
+    bool suppress() noexcept {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        runtime_breaker_counters().suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
+} // namespace detail
+
+namespace breaker {
+struct stats_t {
+    std::uint64_t trips;      // times any site switched to the error-code path
+    std::uint64_t suppressed; // throws replaced by an error-code return
+};
+// Trip a site once it throws more than `max_throws` within `window_ms`; 0 disables all breakers.
+inline void set_threshold(std::uint32_t max_throws, std::uint32_t window_ms) {
+    auto& cfg = ::tc::detail::runtime_breaker_config();
+    cfg.window_ms.store(window_ms, std::memory_order_relaxed);
+    cfg.threshold.store(max_throws, std::memory_order_relaxed);
+}
+inline void set_cooldown(std::uint32_t cooldown_ms) {
+    ::tc::detail::runtime_breaker_config().cooldown_ms.store(cooldown_ms, std::memory_order_relaxed);
+}
+inline stats_t stats() {
+    auto& c = ::tc::detail::runtime_breaker_counters();
+    return {c.trips.load(std::memory_order_relaxed), c.suppressed.load(std::memory_order_relaxed)};
+}
+} // namespace breaker
+} // namespace tc
+
+#if TC_EXCEPTIONS_ENABLED
+#define TC_THROW_OR_RETURN(ex, errval)                                                                                 \
+    do {                                                                                                               \
+        static ::tc::detail::throw_site_breaker _tc_brk;                                                               \
+        if (_tc_brk.allow_throw(__FILE__, __LINE__, __func__)) {                                                       \
+            TC_THROW(ex);                                                                                              \
+        }                                                                                                              \
+        return errval;                                                                                                 \
+    } while (0)
+#else
+#define TC_THROW_OR_RETURN(ex, errval)                                                                                 \
+    do {                                                                                                               \
+        ::tc::detail::runtime_breaker_counters().suppressed.fetch_add(1, std::memory_order_relaxed);                   \
+        return errval;                                                                                                 \
+    } while (0)
+#endif
+
+// ===================== Exception type names =====================
+// tc::type_name(ti) / tc::current_exception_type_name(): demangled type names, cached per type_info address in a
+// fixed lock-free table so abi::__cxa_demangle runs once per type. Returned strings live for the whole process.
+#if !defined(TC_HAVE_CXXABI)
+#if (defined(__GLIBCXX__) || defined(_LIBCPP_VERSION)) && __has_include(<cxxabi.h>)
+#define TC_HAVE_CXXABI 1
+#else
+#define TC_HAVE_CXXABI 0
+#endif
+#endif
+
+#if !defined(TC_TYPE_NAME_CACHE_SIZE)
+#define TC_TYPE_NAME_CACHE_SIZE 128 // power of two
+#endif
+
+#if TC_HAVE_CXXABI
+#include <cxxabi.h>
+#endif
+
+namespace tc {
+namespace detail {
+
+struct type_name_slot {
+    std::atomic<const std::type_info*> type{nullptr};
+    std::atomic<const char*> name{nullptr};
+};
+
+inline type_name_slot* type_name_cache() {
+    static type_name_slot slots[TC_TYPE_NAME_CACHE_SIZE];
+    return slots;
+}
+
+inline const char* demangle_uncached(const std::type_info& ti) {
+#if TC_HAVE_CXXABI
+    int status = 0;
+    char* out = abi::__cxa_demangle(ti.name(), nullptr, nullptr, &status);
+    if (status == 0 && out != nullptr)
+        return out;
+    std::free(out);
+#endif
+    return nullptr;
+}
+
+inline const char* type_name(const std::type_info& ti) {
+#if TC_HAVE_CXXABI
+    auto* slots = type_name_cache();
+    const auto h = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(&ti) >> 4) * 0x9E3779B97F4A7C15ull;
+    std::size_t idx = static_cast<std::size_t>(h >> 32) & (TC_TYPE_NAME_CACHE_SIZE - 1);
+    for (std::size_t i = 0; i < TC_TYPE_NAME_CACHE_SIZE; ++i, idx = (idx + 1) & (TC_TYPE_NAME_CACHE_SIZE - 1)) {
+        type_name_slot& slot = slots[idx];
+        const std::type_info* key = slot.type.load(std::memory_order_acquire);
+        // Claim an empty slot; if another thread wins, `key` receives its type.
+        if (key == nullptr &&
+            slot.type.compare_exchange_strong(key, &ti, std::memory_order_acq_rel, std::memory_order_acquire))
+            key = &ti;
+        if (key != &ti)
+            continue;
+        if (const char* name = slot.name.load(std::memory_order_acquire))
+            return name;
+        // First lookup of this type (or a concurrent one): demangle and publish; the loser frees its copy.
+        const char* mine = demangle_uncached(ti);
+        if (mine == nullptr)
+            mine = ti.name();
+        const char* expected = nullptr;
+        if (slot.name.compare_exchange_strong(expected, mine, std::memory_order_acq_rel, std::memory_order_acquire))
+            return mine;
+        if (mine != ti.name())
+            std::free(const_cast<char*>(mine));
+        return expected;
+    }
+#endif
+    // Cache full, or the name is already human-readable (MSVC).
+    return ti.name();
+}
+
+inline const char* current_exception_type_name() {
+#if TC_HAVE_CXXABI
+    if (const std::type_info* ti = abi::__cxa_current_exception_type())
+        return type_name(*ti);
+#endif
+    return "(none)";
+}
+
+// Dynamic type of a caught exception, as used by the TC_CATCH_STD_* helpers.
+template <class E> const char* caught_type_name(const E& e) {
+#if TC_HAVE_CXXABI
+    (void)e;
+    return current_exception_type_name();
+#else
+    return type_name(typeid(e));
+#endif
+}
+
+} // namespace detail
+
+using ::tc::detail::current_exception_type_name;
+using ::tc::detail::type_name;
+} // namespace tc
+
+// ===================== Exception type registry =====================
+// Maps the dynamic type of the in-flight exception to a user formatter so catch (...) handlers can describe
+// non-std exceptions. Lookup uses abi::__cxa_current_exception_type and a fixed open-addressing table keyed on
+// the type_info address: readers do acquire loads only, registration publishes entries with CAS. The formatter
+// reaches the object by rethrowing it into a `catch (const T&)` of the registered type.
+// Available with the Itanium C++ ABI (GCC/Clang with libstdc++ or libc++); elsewhere lookups always miss.
+#if !defined(TC_EXCEPTION_REGISTRY_SIZE)
+#define TC_EXCEPTION_REGISTRY_SIZE 64 // power of two
+#endif
+
+namespace tc {
+namespace detail {
+
+using erased_formatter_t = void (*)();
+using formatter_thunk_t = void (*)(erased_formatter_t fn, char* buf, std::size_t cap);
+
+struct exception_formatter_entry {
+    const std::type_info* type;
+    erased_formatter_t fn;
+    formatter_thunk_t thunk;
+};
+
+// Called from inside a handler: rethrows the exception being handled and catches it as T to reach the object.
+template <class T> void exception_formatter_thunk(erased_formatter_t fn, char* buf, std::size_t cap) {
+#if TC_EXCEPTIONS_ENABLED
+    try {
+        throw;
+    } catch (const T& e) {
+        reinterpret_cast<void (*)(const T&, char*, std::size_t)>(fn)(e, buf, cap);
+    } catch (...) {
+    }
+#else
+    (void)fn;
+    (void)buf;
+    (void)cap;
+#endif
+}
+
+inline std::atomic<const exception_formatter_entry*>* exception_registry() {
+    static std::atomic<const exception_formatter_entry*> slots[TC_EXCEPTION_REGISTRY_SIZE] = {};
+    return slots;
+}
+
+inline std::size_t exception_registry_index(const std::type_info* ti) {
+    const auto h = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(ti) >> 4) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(h >> 32) & (TC_EXCEPTION_REGISTRY_SIZE - 1);
+}
+
+// Inserts or replaces the entry for entry->type. Replaced entries are leaked: readers may still hold them.
+inline bool exception_registry_insert(const exception_formatter_entry* entry) {
+    auto* slots = exception_registry();
+    std::size_t idx = exception_registry_index(entry->type);
+    for (std::size_t i = 0; i < TC_EXCEPTION_REGISTRY_SIZE; ++i, idx = (idx + 1) & (TC_EXCEPTION_REGISTRY_SIZE - 1)) {
+        const exception_formatter_entry* cur = slots[idx].load(std::memory_order_acquire);
+        while (cur == nullptr || cur->type == entry->type) {
+            if (slots[idx].compare_exchange_weak(cur, entry, std::memory_order_acq_rel, std::memory_order_acquire))
+                return true;
+        }
+    }
+    return false;
+}
+
+inline const exception_formatter_entry* exception_registry_find(const std::type_info* ti) {
+    auto* slots = exception_registry();
+    std::size_t idx = exception_registry_index(ti);
+    for (std::size_t i = 0; i < TC_EXCEPTION_REGISTRY_SIZE; ++i, idx = (idx + 1) & (TC_EXCEPTION_REGISTRY_SIZE - 1)) {
+        const exception_formatter_entry* e = slots[idx].load(std::memory_order_acquire);
+        if (e == nullptr)
+            break;
+        if (e->type == ti)
+            return e;
+    }
+    // type_info addresses are not unique across shared objects: fall back to a name comparison. Nothing is cached
+    // here, so a lookup never allocates (it may run while memory is exhausted, e.g. for std::bad_alloc).
+    for (std::size_t i = 0; i < TC_EXCEPTION_REGISTRY_SIZE; ++i) {
+        const exception_formatter_entry* e = slots[i].load(std::memory_order_acquire);
+        if (e != nullptr && *e->type == *ti)
+            return e;
+    }
+    return nullptr;
+}
+
+// Formats the exception currently being handled; returns false if there is none or its type is not registered.
+inline bool format_current_exception(char* buf, std::size_t cap) {
+#if TC_EXCEPTIONS_ENABLED && TC_HAVE_CXXABI
+    const std::type_info* ti = abi::__cxa_current_exception_type();
+    if (ti == nullptr || cap == 0)
+        return false;
+    const exception_formatter_entry* e = exception_registry_find(ti);
+    if (e == nullptr)
+        return false;
+    buf[0] = '\0';
+    e->thunk(e->fn, buf, cap);
+    return true;
+#else
+    (void)buf;
+    (void)cap;
+    return false;
+#endif
+}
+
+// Text used by the TC_CATCH_ALL_* helpers; points into a thread-local buffer.
+inline const char* describe_current_exception() {
+    static thread_local char buf[256];
+    if (format_current_exception(buf, sizeof(buf)))
+        return buf;
+#if TC_EXCEPTIONS_ENABLED && TC_HAVE_CXXABI
+    if (abi::__cxa_current_exception_type() != nullptr) {
+        std::snprintf(buf, sizeof(buf), "unknown exception of type %s", current_exception_type_name());
+        return buf;
+    }
+#endif
+    return "unknown exception";
+}
+
+} // namespace detail
+
+// Register `fn` to describe exceptions whose dynamic type is exactly T, e.g.
+//   tc::register_exception_formatter<LegacyError>(
+//       [](const LegacyError& e, char* buf, std::size_t n) { std::snprintf(buf, n, "LegacyError %d", e.code); });
+// Returns false if the registry is full or the platform lacks the Itanium C++ ABI.
+template <class T> bool register_exception_formatter(void (*fn)(const T&, char*, std::size_t)) {
+#if TC_EXCEPTIONS_ENABLED && TC_HAVE_CXXABI
+    return ::tc::detail::exception_registry_insert(new ::tc::detail::exception_formatter_entry{
+        &typeid(T), reinterpret_cast<::tc::detail::erased_formatter_t>(fn),
+        &::tc::detail::exception_formatter_thunk<T>});
+#else
+    (void)fn;
+    return false;
+#endif
+}
+
+using ::tc::detail::format_current_exception;
+} // namespace tc
+
+// ===================== Tracing (export) =====================
+// tc::trace::start()/stop() toggle recording; write_chrome_json() emits the Chrome trace-event JSON format, which
+// chrome://tracing and ui.perfetto.dev both load. Export can run while other threads keep recording: events
+// overwritten during the copy are skipped.
+#if !defined(TC_RTTI_ENABLED)
+#if defined(__cpp_rtti) || defined(__GXX_RTTI) || defined(_CPPRTTI)
+#define TC_RTTI_ENABLED 1
+#else
+#define TC_RTTI_ENABLED 0
+#endif
+#endif
+
+#if TC_ENABLE_TRACING && defined(_WIN32)
+#include <process.h>
+#endif
+
+namespace tc {
+namespace detail {
+
+template <class T> void trace_throw(const char* file, int line) {
+    if (trace_active()) {
+#if TC_RTTI_ENABLED
+        trace_record_slow(trace_kind::throw_, 'i', type_name(typeid(T)), file, line, 0);
+#else
+        trace_record_slow(trace_kind::throw_, 'i', "throw", file, line, 0);
+#endif
+    }
+}
+
+// Operand of TC_THROW: records the throw, then yields the exception unchanged.
+template <class T> T&& on_throw(const char* file, int line, T&& ex) {
+    usdt_throw(file, line);
+    trace_throw<typename std::decay<T>::type>(file, line);
+    return static_cast<T&&>(ex);
+}
+
+#if TC_EXCEPTIONS_ENABLED
+// Operand of TC_RETHROW: records the rethrow, then rethrows the exception being handled from here, so the enclosing
+// throw-expression never completes.
+[[noreturn]] inline int on_rethrow(const char* file, int line) {
+    usdt_rethrow(file, line);
+    throw;
+}
+#endif
+
+inline void trace_catch(const char* file, int line) {
+    if (trace_active())
+        trace_record_slow(trace_kind::catch_, 'i', current_exception_type_name(), file, line, 0);
+}
+
+inline std::atomic<std::uint64_t>& trace_epoch() {
+    static std::atomic<std::uint64_t> since{0};
+    return since;
+}
+
+inline void trace_write_json_string(std::FILE* out, const char* s) {
+    std::fputc('"', out);
+    for (; s != nullptr && *s != '\0'; ++s) {
+        const auto c = static_cast<unsigned char>(*s);
+        if (c == '"' || c == '\\')
+            std::fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            std::fprintf(out, "\\u%04x", c);
+        else
+            std::fputc(c, out);
+    }
+    std::fputc('"', out);
+}
+
+inline const char* trace_category(trace_kind k) {
+    switch (k) {
+    case trace_kind::throw_:
+        return "tc.throw";
+    case trace_kind::catch_:
+        return "tc.catch";
+    case trace_kind::guard:
+        return "tc.guard";
+    case trace_kind::log:
+        return "tc.log";
+    case trace_kind::scope:
+        return "tc.scope";
+    }
+    return "tc";
+}
+
+inline void trace_write_event(std::FILE* out, const trace_event& e, long pid, bool first) {
+    std::fprintf(out, "%s\n{\"name\":", first ? "" : ",");
+    trace_write_json_string(out, e.name);
+    const auto ns = static_cast<std::uint64_t>(clock_ticks_to_unix_ns(e.ts));
+    std::fprintf(out, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%ld,\"tid\":%lu",
+                 trace_category(e.kind), e.phase, static_cast<unsigned long long>(ns / 1000),
+                 static_cast<unsigned long long>(ns % 1000), pid, static_cast<unsigned long>(e.tid));
+    if (e.phase == 'i')
+        std::fputs(",\"s\":\"t\"", out);
+    std::fputs(",\"args\":{\"file\":", out);
+    trace_write_json_string(out, e.file);
+    std::fprintf(out, ",\"line\":%lu", static_cast<unsigned long>(e.line));
+    if (e.kind == trace_kind::log)
+        std::fprintf(out, ",\"level\":%u", static_cast<unsigned>(e.arg));
+    else if (e.kind == trace_kind::guard && e.phase == 'E')
+        std::fprintf(out, ",\"ok\":%s", e.arg ? "true" : "false");
+    std::fputs("}}", out);
+}
+
+} // namespace detail
+
+namespace trace {
+inline void start() {
+    ::tc::detail::trace_enabled_flag().store(true, std::memory_order_relaxed);
+}
+inline void stop() {
+    ::tc::detail::trace_enabled_flag().store(false, std::memory_order_relaxed);
+}
+inline bool enabled() {
+    return ::tc::detail::trace_active();
+}
+// Hide everything recorded so far from later exports.
+inline void clear() {
+    ::tc::detail::trace_epoch().store(::tc::detail::clock_ticks(), std::memory_order_relaxed);
+}
+// Writes {"traceEvents":[...]} to `out`; returns the number of events written.
+inline std::size_t write_chrome_json(std::FILE* out) {
+    using namespace ::tc::detail;
+#if TC_ENABLE_TRACING && defined(_WIN32)
+    const long pid = static_cast<long>(_getpid());
+#elif TC_ENABLE_TRACING && TC_POSIX
+    const long pid = static_cast<long>(getpid());
+#else
+    const long pid = 1;
+#endif
+    const std::uint64_t since = trace_epoch().load(std::memory_order_relaxed);
+    std::size_t n = 0;
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+    for (trace_buffer* b = trace_buffers().load(std::memory_order_acquire); b != nullptr; b = b->next) {
+        const std::uint64_t head = b->head.load(std::memory_order_acquire);
+        const std::uint64_t begin = head > TC_TRACE_BUFFER_EVENTS ? head - TC_TRACE_BUFFER_EVENTS : 0;
+        for (std::uint64_t i = begin; i < head; ++i) {
+            // Once head - i reaches the ring size the owner may be overwriting the slot; skip it without reading.
+            if (b->head.load(std::memory_order_acquire) - i >= TC_TRACE_BUFFER_EVENTS)
+                continue;
+            trace_event e;
+            // The owner may have lapped this slot while we copied it.
+            if (!trace_load(b->events[i & (TC_TRACE_BUFFER_EVENTS - 1)], i, e))
+                continue;
+            if (e.ts < since)
+                continue;
+            trace_write_event(out, e, pid, n == 0);
+            ++n;
+        }
+    }
+    std::fputs("\n]}\n", out);
+    return n;
+}
+} // namespace trace
+} // namespace tc
+
+#define TC_CONCAT_IMPL(a, b) a##b
+#define TC_CONCAT(a, b) TC_CONCAT_IMPL(a, b)
+
+// TC_TRACE_SCOPE("name"): record a begin/end span for the enclosing scope.
+#if TC_ENABLE_TRACING
+#define TC_TRACE_SCOPE(name) ::tc::detail::trace_scope TC_CONCAT(_tc_trace_scope_, __LINE__)((name), __FILE__, __LINE__)
+#else
+#define TC_TRACE_SCOPE(name) ((void)0)
+#endif
+
+// ===================== Terminate handler =====================
+// tc::install_terminate_handler(): on std::terminate, log the in-flight exception (type and what()) at error level
+// tagged with the failing thread's id and name, run the tc::fatal chain so async sinks get flushed, then abort. The
+// handler calls logf() itself rather than TC_LOG_ERROR: this inline function must expand the same in every
+// translation unit, whatever TC_LOG_SITES each one was built with.
+#if TC_POSIX && (defined(__linux__) || defined(__APPLE__))
+#include <pthread.h>
+#endif
+
+namespace tc {
+namespace detail {
+
+// OS thread id (Linux) or a process-local sequence number, plus the thread name where available.
+inline void describe_this_thread(unsigned long* id, char* name, std::size_t cap) {
+#if defined(__linux__)
+    *id = static_cast<unsigned long>(::syscall(SYS_gettid));
+#else
+    static std::atomic<unsigned long> next{1};
+    static thread_local unsigned long mine = next.fetch_add(1, std::memory_order_relaxed);
+    *id = mine;
+#endif
+    name[0] = '\0';
+#if TC_POSIX && (defined(__linux__) || defined(__APPLE__))
+    if (pthread_getname_np(pthread_self(), name, cap) != 0)
+        name[0] = '\0';
+#else
+    (void)cap;
+#endif
+}
+
+[[noreturn]] inline void terminate_handler() {
+    static std::atomic<bool> entered{false};
+    if (entered.exchange(true))
+        std::abort(); // terminate from within a fatal handler
+
+    unsigned long tid = 0;
+    char thread_name[64];
+    describe_this_thread(&tid, thread_name, sizeof(thread_name));
+
+    char msg[512];
+    const std::exception_ptr p = std::current_exception();
+    if (p) {
+        const char* what = describe_current_exception();
+#if TC_EXCEPTIONS_ENABLED
+        TC_TRY {
+            std::rethrow_exception(p);
+        }
+        TC_CATCH(const std::exception&, e) {
+            what = e.what();
+        }
+        TC_CATCH_ALL() {
+        }
+#endif
+        std::snprintf(msg, sizeof(msg), "uncaught %s: %s", current_exception_type_name(), what);
+    } else {
+        std::snprintf(msg, sizeof(msg), "called without an active exception");
+    }
+    logf(log_level::error, __FILE__, __LINE__, __func__, "terminate on thread %lu (%s): %s", tid,
+         thread_name[0] ? thread_name : "unnamed", msg);
+
+    run_fatal_handlers({fatal::reason::terminate, nullptr, 0, nullptr, msg, 0});
+    std::abort();
+}
+
+} // namespace detail
+
+// Install the tc terminate handler; returns the previous one.
+inline std::terminate_handler install_terminate_handler() {
+    return std::set_terminate(&::tc::detail::terminate_handler);
 }
-} // namespace log
 } // namespace tc
 
 // ===================== Convenience wrap macros (optional) =====================
@@ -262,6 +4004,7 @@ inline sink_t get_sink() {
 // Returns true if ran without exception; false if caught. In no-exception builds it's always true.
 #define TC_GUARD(expr)                                                                                                 \
     ([&]() TC_NOEXCEPT_IF_NOEXCEPTIONS -> bool {                                                                       \
+        ::tc::detail::trace_record(::tc::detail::trace_kind::guard, 'B', "TC_GUARD", __FILE__, __LINE__);              \
         bool ok = true;                                                                                                \
         TC_TRY {                                                                                                       \
             (void)(expr);                                                                                              \
@@ -272,6 +4015,9 @@ inline sink_t get_sink() {
         TC_CATCH_ALL() {                                                                                               \
             ok = false;                                                                                                \
         }                                                                                                              \
+        if (!ok)                                                                                                       \
+            ::tc::detail::usdt_guard_fail(__FILE__, __LINE__);                                                         \
+        ::tc::detail::trace_record(::tc::detail::trace_kind::guard, 'E', "TC_GUARD", __FILE__, __LINE__, ok);          \
         return ok;                                                                                                     \
     }())
 
@@ -279,30 +4025,42 @@ inline sink_t get_sink() {
 #if TC_EXCEPTIONS_ENABLED
 #define TC_CATCH_STD_WARN()                                                                                            \
     TC_CATCH(const std::exception&, _tc_e) {                                                                           \
-        TC_WARN("exception: %s", _tc_e.what());                                                                        \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_WARN("%s: %s", ::tc::detail::caught_type_name(_tc_e), _tc_e.what());                                        \
     }
 #define TC_CATCH_STD_ERROR()                                                                                           \
     TC_CATCH(const std::exception&, _tc_e) {                                                                           \
-        TC_ERROR("exception: %s", _tc_e.what());                                                                       \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_ERROR("%s: %s", ::tc::detail::caught_type_name(_tc_e), _tc_e.what());                                       \
     }
 #else
 #define TC_CATCH_STD_WARN()                                                                                            \
     TC_CATCH(const std::exception&, _tc_unused) {                                                                      \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
         TC_WARN("exception handler (no-exceptions build)");                                                            \
     }
 #define TC_CATCH_STD_ERROR()                                                                                           \
     TC_CATCH(const std::exception&, _tc_unused) {                                                                      \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
         TC_ERROR("exception handler (no-exceptions build)");                                                           \
     }
 #endif
 
 #define TC_CATCH_ALL_WARN()                                                                                            \
     TC_CATCH_ALL() {                                                                                                   \
-        TC_WARN("unknown exception");                                                                                  \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_WARN("%s", ::tc::detail::describe_current_exception());                                                     \
     }
 #define TC_CATCH_ALL_ERROR()                                                                                           \
     TC_CATCH_ALL() {                                                                                                   \
-        TC_ERROR("unknown exception");                                                                                 \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_ERROR("%s", ::tc::detail::describe_current_exception());                                                    \
     }
 
 // Variants that allow custom user body to run inside the catch block.
@@ -315,28 +4073,36 @@ inline sink_t get_sink() {
 #if TC_EXCEPTIONS_ENABLED
 #define TC_CATCH_STD_WARN_DO(BODY)                                                                                     \
     TC_CATCH(const std::exception&, _tc_e) {                                                                           \
-        TC_WARN("exception: %s", _tc_e.what());                                                                        \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_WARN("%s: %s", ::tc::detail::caught_type_name(_tc_e), _tc_e.what());                                        \
         do {                                                                                                           \
             BODY;                                                                                                      \
         } while (0);                                                                                                   \
     }
 #define TC_CATCH_STD_ERROR_DO(BODY)                                                                                    \
     TC_CATCH(const std::exception&, _tc_e) {                                                                           \
-        TC_ERROR("exception: %s", _tc_e.what());                                                                       \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_ERROR("%s: %s", ::tc::detail::caught_type_name(_tc_e), _tc_e.what());                                       \
         do {                                                                                                           \
             BODY;                                                                                                      \
         } while (0);                                                                                                   \
     }
 #define TC_CATCH_STD_WARN_AS(NAME, BODY)                                                                               \
     TC_CATCH(const std::exception&, NAME) {                                                                            \
-        TC_WARN("exception: %s", NAME.what());                                                                         \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_WARN("%s: %s", ::tc::detail::caught_type_name(NAME), NAME.what());                                          \
         do {                                                                                                           \
             BODY;                                                                                                      \
         } while (0);                                                                                                   \
     }
 #define TC_CATCH_STD_ERROR_AS(NAME, BODY)                                                                              \
     TC_CATCH(const std::exception&, NAME) {                                                                            \
-        TC_ERROR("exception: %s", NAME.what());                                                                        \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_ERROR("%s: %s", ::tc::detail::caught_type_name(NAME), NAME.what());                                         \
         do {                                                                                                           \
             BODY;                                                                                                      \
         } while (0);                                                                                                   \
@@ -344,6 +4110,8 @@ inline sink_t get_sink() {
 #else
 #define TC_CATCH_STD_WARN_DO(BODY)                                                                                     \
     TC_CATCH(const std::exception&, _tc_unused) {                                                                      \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
         TC_WARN("exception handler (no-exceptions build)");                                                            \
         do {                                                                                                           \
             BODY;                                                                                                      \
@@ -351,6 +4119,8 @@ inline sink_t get_sink() {
     }
 #define TC_CATCH_STD_ERROR_DO(BODY)                                                                                    \
     TC_CATCH(const std::exception&, _tc_unused) {                                                                      \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
         TC_ERROR("exception handler (no-exceptions build)");                                                           \
         do {                                                                                                           \
             BODY;                                                                                                      \
@@ -358,6 +4128,8 @@ inline sink_t get_sink() {
     }
 #define TC_CATCH_STD_WARN_AS(NAME, BODY)                                                                               \
     TC_CATCH(const std::exception&, NAME) {                                                                            \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
         const std::exception& NAME = *static_cast<const std::exception*>(nullptr);                                     \
         TC_WARN("exception handler (no-exceptions build)");                                                            \
         do {                                                                                                           \
@@ -366,6 +4138,8 @@ inline sink_t get_sink() {
     }
 #define TC_CATCH_STD_ERROR_AS(NAME, BODY)                                                                              \
     TC_CATCH(const std::exception&, NAME) {                                                                            \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
         const std::exception& NAME = *static_cast<const std::exception*>(nullptr);                                     \
         TC_ERROR("exception handler (no-exceptions build)");                                                           \
         do {                                                                                                           \
@@ -376,14 +4150,18 @@ inline sink_t get_sink() {
 
 #define TC_CATCH_ALL_WARN_DO(BODY)                                                                                     \
     TC_CATCH_ALL() {                                                                                                   \
-        TC_WARN("unknown exception");                                                                                  \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_WARN("%s", ::tc::detail::describe_current_exception());                                                     \
         do {                                                                                                           \
             BODY;                                                                                                      \
         } while (0);                                                                                                   \
     }
 #define TC_CATCH_ALL_ERROR_DO(BODY)                                                                                    \
     TC_CATCH_ALL() {                                                                                                   \
-        TC_ERROR("unknown exception");                                                                                 \
+        ::tc::detail::usdt_catch(__FILE__, __LINE__);                                                                  \
+        ::tc::detail::trace_catch(__FILE__, __LINE__);                                                                 \
+        TC_ERROR("%s", ::tc::detail::describe_current_exception());                                                    \
         do {                                                                                                           \
             BODY;                                                                                                      \
         } while (0);                                                                                                   \
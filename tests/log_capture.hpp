@@ -0,0 +1,67 @@
+// tests/log_capture.hpp
+// Record sink and fixture shared by the logging tests. LogCaptureTest routes every record to `cap` at the level it
+// is given and puts the previous sink and level back afterwards; a test's own fixture derives from it and adds only
+// its feature's setup and teardown.
+#pragma once
+
+#include "../include/tc/try_catch.hpp"
+#include <gtest/gtest.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// What a record sink saw, copied out of the call (payload and context are only valid during it).
+struct CapturedRecord {
+    ::tc::log::level level;
+    int line;
+    std::uint64_t timestamp;
+    std::uint64_t thread_id;
+    std::uint32_t repeats;
+    std::uint64_t first_timestamp;
+    std::string payload;
+    std::string context;
+};
+
+struct LogCapture {
+    std::mutex mu;
+    std::vector<std::size_t> calls; // records per sink call
+    std::vector<CapturedRecord> records;
+    std::vector<std::string> payloads;
+    std::vector<std::string> contexts;
+
+    static void sink(void* ctx, const ::tc::log::record* recs, std::size_t n) {
+        auto* self = static_cast<LogCapture*>(ctx);
+        std::lock_guard<std::mutex> lock(self->mu);
+        self->calls.push_back(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            const ::tc::log::record& r = recs[i];
+            self->records.push_back({r.level, r.line, r.timestamp, r.thread_id, r.repeats, r.first_timestamp,
+                                     std::string(r.payload), std::string(r.context)});
+            self->payloads.emplace_back(r.payload);
+            self->contexts.emplace_back(r.context);
+        }
+    }
+
+    std::size_t count(::tc::log::level lvl) {
+        std::lock_guard<std::mutex> lock(mu);
+        std::size_t n = 0;
+        for (const auto& r : records)
+            n += r.level == lvl ? 1 : 0;
+        return n;
+    }
+};
+
+struct LogCaptureTest : ::testing::Test {
+    explicit LogCaptureTest(::tc::log::level lvl = ::tc::log::level::trace)
+        : prev_sink(::tc::log::get_sink()), prev_level(::tc::log::get_level()) {
+        ::tc::log::set_level(lvl);
+        ::tc::log::set_record_sink(&LogCapture::sink, &cap);
+    }
+    ~LogCaptureTest() override {
+        ::tc::log::set_sink(prev_sink);
+        ::tc::log::set_level(prev_level);
+    }
+    ::tc::log::sink_t prev_sink;
+    ::tc::log::level prev_level;
+    LogCapture cap;
+};
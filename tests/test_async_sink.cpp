@@ -0,0 +1,280 @@
+#include "../include/tc/async_sink.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+// A downstream sink that can be held shut, so the queue fills up behind the drain thread.
+struct Gate {
+    std::mutex mu;
+    std::condition_variable cv;
+    bool open = true;
+    int entered = 0;
+    std::vector<std::string> payloads;
+    std::vector<std::thread::id> threads;
+
+    static void sink(void* ctx, const ::tc::log::record* recs, std::size_t n) {
+        auto* self = static_cast<Gate*>(ctx);
+        std::unique_lock<std::mutex> lock(self->mu);
+        ++self->entered;
+        self->cv.notify_all();
+        self->cv.wait(lock, [&] { return self->open; });
+        for (std::size_t i = 0; i < n; ++i) {
+            self->payloads.emplace_back(recs[i].payload);
+            self->threads.push_back(std::this_thread::get_id());
+        }
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mu);
+        open = false;
+    }
+    void release() {
+        std::lock_guard<std::mutex> lock(mu);
+        open = true;
+        cv.notify_all();
+    }
+    void wait_entered(int n) {
+        std::unique_lock<std::mutex> lock(mu);
+        cv.wait(lock, [&] { return entered >= n; });
+    }
+    std::vector<std::string> taken() {
+        std::lock_guard<std::mutex> lock(mu);
+        return payloads;
+    }
+};
+
+struct Fallback {
+    std::vector<std::string> payloads;
+    std::vector<std::thread::id> threads;
+
+    static void sink(void* ctx, const ::tc::log::record* recs, std::size_t n) {
+        auto* self = static_cast<Fallback*>(ctx);
+        for (std::size_t i = 0; i < n; ++i) {
+            self->payloads.emplace_back(recs[i].payload);
+            self->threads.push_back(std::this_thread::get_id());
+        }
+    }
+};
+
+void push(::tc::async::buffered_sink& out, const std::string& payload) {
+    const ::tc::log::record rec{::tc::log::level::info, 1, "a.cpp", "f", ::tc::detail::clock_ticks(), 1, payload};
+    out.push(rec);
+}
+
+std::vector<std::string> numbered(const char* prefix, int from, int to) {
+    std::vector<std::string> v;
+    for (int i = from; i < to; ++i)
+        v.push_back(prefix + std::to_string(i));
+    return v;
+}
+
+// One record held inside the downstream sink, then `count` more: only `capacity` of them fit in the queue.
+void fill_behind_held_record(Gate& gate, ::tc::async::buffered_sink& out, int count) {
+    gate.close();
+    push(out, "held");
+    gate.wait_entered(1);
+    for (int i = 0; i < count; ++i)
+        push(out, "r" + std::to_string(i));
+}
+
+::tc::async::options small(::tc::async::overflow policy, const char* name) {
+    ::tc::async::options opt;
+    opt.capacity = 8;
+    opt.policy = policy;
+    opt.name = name;
+    return opt;
+}
+} // namespace
+
+TEST(AsyncSink, DeliversInOrderFromTheDrainThread) {
+    Gate gate;
+    {
+        ::tc::async::buffered_sink out(&Gate::sink, &gate);
+        const auto prev_sink = ::tc::log::get_sink();
+        const auto prev_level = ::tc::log::get_level();
+        ::tc::log::set_level(::tc::log::level::info);
+        ::tc::log::set_record_sink(&::tc::async::buffered_sink::sink, &out);
+        for (int i = 0; i < 1000; ++i)
+            TC_LOG_INFO("r%d", i);
+        ::tc::log::set_sink(prev_sink);
+        ::tc::log::set_level(prev_level);
+        out.flush();
+        EXPECT_EQ(gate.taken(), numbered("r", 0, 1000));
+        const auto st = out.stats();
+        EXPECT_EQ(st.enqueued, 1000u);
+        EXPECT_EQ(st.drained, 1000u);
+        EXPECT_EQ(st.dropped, 0u);
+    }
+    for (const auto& id : gate.threads)
+        ASSERT_NE(id, std::this_thread::get_id());
+}
+
+TEST(AsyncSink, LongestLogRecordFitsWholeAndLongerOnesAreMarked) {
+    Gate gate;
+    {
+        ::tc::async::buffered_sink out(&Gate::sink, &gate);
+        const std::string longest(TC_LOG_MESSAGE_MAX - 1, 'm');
+        push(out, longest);
+        push(out, std::string(TC_ASYNC_RECORD_BYTES + 100, 'x'));
+        out.flush();
+        const auto got = gate.taken();
+        ASSERT_EQ(got.size(), 2u);
+        EXPECT_EQ(got[0], longest);
+        EXPECT_EQ(got[1].size(), static_cast<std::size_t>(TC_ASYNC_RECORD_BYTES));
+        EXPECT_EQ(got[1].substr(got[1].size() - 11), "[truncated]");
+        EXPECT_EQ(out.stats().truncated, 1u);
+    }
+}
+
+TEST(AsyncSink, DropNewestRejectsWhenFull) {
+    Gate gate;
+    ::tc::async::buffered_sink out(&Gate::sink, &gate, small(::tc::async::overflow::drop_newest, "drop"));
+    fill_behind_held_record(gate, out, 20);
+    EXPECT_EQ(out.stats().dropped, 12u);
+    EXPECT_EQ(out.stats().high_water, 8u);
+    gate.release();
+    out.flush();
+    auto want = numbered("r", 0, 8);
+    want.insert(want.begin(), "held");
+    EXPECT_EQ(gate.taken(), want);
+}
+
+TEST(AsyncSink, OverwriteOldestKeepsTheNewest) {
+    Gate gate;
+    ::tc::async::buffered_sink out(&Gate::sink, &gate, small(::tc::async::overflow::overwrite_oldest, "overwrite"));
+    fill_behind_held_record(gate, out, 20);
+    EXPECT_EQ(out.stats().overwritten, 12u);
+    gate.release();
+    out.flush();
+    auto want = numbered("r", 12, 20);
+    want.insert(want.begin(), "held");
+    EXPECT_EQ(gate.taken(), want);
+    EXPECT_EQ(out.stats().dropped, 0u);
+}
+
+TEST(AsyncSink, SpillWritesSynchronouslyToTheFallback) {
+    Gate gate;
+    Fallback fb;
+    auto opt = small(::tc::async::overflow::spill, "spill");
+    opt.fallback = &Fallback::sink;
+    opt.fallback_ctx = &fb;
+    ::tc::async::buffered_sink out(&Gate::sink, &gate, opt);
+    fill_behind_held_record(gate, out, 20);
+    EXPECT_EQ(fb.payloads, numbered("r", 8, 20));
+    for (const auto& id : fb.threads)
+        EXPECT_EQ(id, std::this_thread::get_id());
+    EXPECT_EQ(out.stats().spilled, 12u);
+    gate.release();
+    out.flush();
+    EXPECT_EQ(gate.taken().size(), 9u);
+}
+
+TEST(AsyncSink, BlockWaitsForRoom) {
+    Gate gate;
+    ::tc::async::buffered_sink out(&Gate::sink, &gate, small(::tc::async::overflow::block, "block"));
+    std::atomic<bool> done{false};
+    std::thread producer([&] {
+        fill_behind_held_record(gate, out, 20);
+        done = true;
+    });
+    while (out.stats().blocked == 0)
+        std::this_thread::yield();
+    EXPECT_FALSE(done.load());
+    gate.release();
+    producer.join();
+    out.flush();
+    auto want = numbered("r", 0, 20);
+    want.insert(want.begin(), "held");
+    EXPECT_EQ(gate.taken(), want);
+    EXPECT_EQ(out.stats().dropped, 0u);
+    EXPECT_GT(out.stats().drain_latency_max_ns, 0u);
+}
+
+TEST(AsyncSink, StatsCoverEveryLiveSink) {
+    Gate a, b;
+    ::tc::async::options oa, ob;
+    oa.name = "stats-a";
+    ob.name = "stats-b";
+    const auto before = ::tc::log::stats();
+    {
+        ::tc::async::buffered_sink sa(&Gate::sink, &a, oa);
+        ::tc::async::buffered_sink sb(&Gate::sink, &b, ob);
+        for (int i = 0; i < 10; ++i)
+            push(sa, "a");
+        for (int i = 0; i < 5; ++i)
+            push(sb, "b");
+        sa.flush();
+        sb.flush();
+        const auto all = ::tc::log::stats();
+        EXPECT_EQ(all.enqueued - before.enqueued, 15u);
+        EXPECT_EQ(all.drained - before.drained, 15u);
+        EXPECT_GE(all.sink_ns_per_record, 0.0);
+        std::vector<std::string> names;
+        ::tc::log::for_each_sink_stats([&](const ::tc::log::sink_stats& s) { names.emplace_back(s.name); });
+        EXPECT_NE(std::find(names.begin(), names.end(), "stats-a"), names.end());
+        EXPECT_NE(std::find(names.begin(), names.end(), "stats-b"), names.end());
+    }
+    bool listed = false;
+    ::tc::log::for_each_sink_stats([&](const ::tc::log::sink_stats& s) {
+        listed = listed || std::string(s.name) == "stats-a";
+    });
+    EXPECT_FALSE(listed); // released with its sink
+}
+
+TEST(AsyncSink, PerCpuRingsTakeRecordsBeforeTheSharedQueue) {
+    Gate gate;
+    auto opt = small(::tc::async::overflow::drop_newest, "per-cpu");
+    opt.per_cpu = true;
+    opt.per_cpu_capacity = 16;
+    ::tc::async::buffered_sink out(&Gate::sink, &gate, opt);
+    if (!out.per_cpu())
+        GTEST_SKIP() << "rseq is not available";
+    // 16 ring cells on this thread's CPU plus 8 in the shared queue: nothing is dropped.
+    fill_behind_held_record(gate, out, 20);
+    EXPECT_EQ(out.stats().dropped, 0u);
+    gate.release();
+    out.flush();
+    auto want = numbered("r", 0, 20);
+    want.insert(want.begin(), "held");
+    EXPECT_EQ(gate.taken(), want);
+    EXPECT_EQ(out.stats().enqueued, 21u);
+    EXPECT_GT(out.memory_bytes(), 16u * 8u);
+}
+
+TEST(AsyncSink, PerCpuDeliversEveryRecordOnceAndInOrderPerThread) {
+    Gate gate;
+    ::tc::async::options opt;
+    opt.per_cpu = true;
+    opt.per_cpu_capacity = 32;
+    opt.capacity = 64;
+    opt.name = "per-cpu-contended";
+    ::tc::async::buffered_sink out(&Gate::sink, &gate, opt);
+    constexpr int threads = 4, per_thread = 5000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < per_thread; ++i)
+                push(out, std::to_string(t) + ":" + std::to_string(i));
+        });
+    for (auto& w : workers)
+        w.join();
+    out.flush();
+    const auto got = gate.taken();
+    ASSERT_EQ(got.size(), static_cast<std::size_t>(threads * per_thread));
+    // Records move between the rings and the shared queue as they fill up; each thread's still arrive in order.
+    std::vector<int> next(threads, 0);
+    for (const auto& p : got) {
+        const auto colon = p.find(':');
+        const int t = std::stoi(p.substr(0, colon));
+        ASSERT_EQ(std::stoi(p.substr(colon + 1)), next[t]) << "thread " << t;
+        ++next[t];
+    }
+    EXPECT_EQ(out.stats().dropped, 0u);
+    EXPECT_EQ(out.stats().enqueued, static_cast<std::uint64_t>(threads * per_thread));
+}
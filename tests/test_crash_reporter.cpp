@@ -0,0 +1,129 @@
+#include "../include/tc/crash_reporter.hpp"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#if TC_POSIX
+namespace {
+std::string crash_path() {
+    return testing::TempDir() + "tc_crash_report.txt";
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+[[noreturn]] void crash_with_abort() {
+    ::tc::crash::install(crash_path().c_str(), true);
+    TC_ABORT("disk full");
+    std::abort(); // only reached if TC_ABORT was overridden
+}
+
+void crash_with_segv() {
+    ::tc::crash::install(crash_path().c_str(), false);
+    std::raise(SIGSEGV);
+}
+
+// The main thread aborts; while its report's fatal handlers run, a second thread faults. The second thread must
+// wait for the report rather than end the process with SIGSEGV before it is complete.
+std::atomic<bool> second_may_crash{false};
+void let_second_thread_crash(const ::tc::fatal::context&, void*) {
+    second_may_crash = true;
+    ::usleep(200 * 1000);
+    const char done[] = "fatal handlers done\n";
+    (void)::write(2, done, sizeof(done) - 1);
+}
+
+[[noreturn]] void crash_on_two_threads() {
+    ::tc::crash::install(crash_path().c_str(), false, true);
+    ::tc::fatal::add_handler(&let_second_thread_crash);
+    std::thread([] {
+        ::tc::crash::enable_alt_stack_for_this_thread();
+        while (!second_may_crash)
+            std::this_thread::yield();
+        std::raise(SIGSEGV);
+    }).detach();
+    std::raise(SIGABRT);
+    std::abort();
+}
+
+// sigaltstack() fails with EPERM while the thread runs on its alternate stack, so install() fails from a handler
+// that runs there.
+bool install_result = true;
+int install_errno = 0;
+void install_on_alt_stack(int) {
+    install_result = ::tc::crash::install(nullptr, false);
+    install_errno = errno;
+}
+} // namespace
+
+TEST(CrashReporter, FailedInstallRestoresHandlersAndCanBeRetried) {
+    std::vector<char> stack(1 << 16);
+    stack_t ss{}, old_ss{};
+    ss.ss_sp = stack.data();
+    ss.ss_size = stack.size();
+    ASSERT_EQ(::sigaltstack(&ss, &old_ss), 0);
+    struct sigaction sa{}, old_usr1{}, before{}, after{};
+    sa.sa_handler = &install_on_alt_stack;
+    sa.sa_flags = SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    ASSERT_EQ(::sigaction(SIGUSR1, &sa, &old_usr1), 0);
+    ::sigaction(SIGSEGV, nullptr, &before);
+
+    std::raise(SIGUSR1);
+    EXPECT_FALSE(install_result);
+    EXPECT_EQ(install_errno, EPERM);
+    ::sigaction(SIGSEGV, nullptr, &after);
+    EXPECT_EQ(after.sa_handler, before.sa_handler);
+
+    ::sigaction(SIGUSR1, &old_usr1, nullptr);
+    ::sigaltstack(&old_ss, nullptr);
+    ASSERT_TRUE(::tc::crash::install(nullptr, false)); // not left half installed
+    ::sigaction(SIGSEGV, nullptr, &after);
+    EXPECT_NE(after.sa_handler, before.sa_handler);
+    ::tc::crash::uninstall();
+    ::sigaction(SIGSEGV, nullptr, &after);
+    EXPECT_EQ(after.sa_handler, before.sa_handler);
+}
+
+TEST(CrashReporterDeathTest, AbortWritesContextAndBacktrace) {
+    std::remove(crash_path().c_str());
+    EXPECT_EXIT(crash_with_abort(), testing::KilledBySignal(SIGABRT), "tc crash report");
+    const std::string report = read_file(crash_path());
+    EXPECT_NE(report.find("signal: 6 (SIGABRT)"), std::string::npos) << report;
+    EXPECT_NE(report.find("msg: disk full"), std::string::npos) << report;
+    EXPECT_NE(report.find("in crash_with_abort"), std::string::npos) << report;
+#if TC_HAVE_EXECINFO
+    EXPECT_NE(report.find("backtrace:\n  #0 0x"), std::string::npos) << report;
+#endif
+#if defined(__linux__)
+    EXPECT_NE(report.find("maps:\n"), std::string::npos);
+#endif
+}
+
+TEST(CrashReporterDeathTest, SecondCrashingThreadWaitsForTheReport) {
+    std::remove(crash_path().c_str());
+    EXPECT_EXIT(crash_on_two_threads(), testing::KilledBySignal(SIGABRT), "fatal handlers done");
+    const std::string report = read_file(crash_path());
+    EXPECT_NE(report.find("signal: 6 (SIGABRT)"), std::string::npos) << report;
+}
+
+TEST(CrashReporterDeathTest, SegvChainsToDefaultAction) {
+    std::remove(crash_path().c_str());
+    EXPECT_EXIT(crash_with_segv(), testing::KilledBySignal(SIGSEGV), "");
+    const std::string report = read_file(crash_path());
+    EXPECT_NE(report.find("signal: 11 (SIGSEGV)"), std::string::npos) << report;
+    EXPECT_EQ(report.find("abort:"), std::string::npos) << report;
+}
+#endif
@@ -0,0 +1,87 @@
+#include "../include/tc/try_catch.hpp"
+#include <cstdarg>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <string>
+
+namespace {
+struct LegacyError {
+    int code;
+};
+
+struct LastLine {
+    static std::string& text() {
+        static std::string s;
+        return s;
+    }
+    static void sink(::tc::detail::log_level, const char*, int, const char*, const char* fmt, va_list ap) {
+        char buf[256];
+        vsnprintf(buf, sizeof(buf), fmt, ap);
+        text() = buf;
+    }
+};
+
+struct CaptureErrors {
+    CaptureErrors() : prev_sink(::tc::log::get_sink()), prev_lvl(::tc::log::get_level()) {
+        ::tc::log::set_sink(&LastLine::sink);
+        ::tc::log::set_level(::tc::log::level::info);
+        LastLine::text().clear();
+    }
+    ~CaptureErrors() {
+        ::tc::log::set_sink(prev_sink);
+        ::tc::log::set_level(prev_lvl);
+    }
+    ::tc::log::sink_t prev_sink;
+    ::tc::log::level prev_lvl;
+};
+} // namespace
+
+#if TC_EXCEPTIONS_ENABLED && TC_HAVE_CXXABI
+TEST(ExceptionRegistry, CatchAllUsesRegisteredFormatter) {
+    CaptureErrors capture;
+    ASSERT_TRUE(::tc::register_exception_formatter<LegacyError>(
+        [](const LegacyError& e, char* buf, std::size_t n) { std::snprintf(buf, n, "LegacyError code=%d", e.code); }));
+
+    TC_TRY {
+        throw LegacyError{17};
+    }
+    TC_CATCH_ALL_ERROR()
+    EXPECT_EQ(LastLine::text(), "LegacyError code=17");
+
+    // Unregistered types fall back to their demangled name.
+    TC_TRY {
+        throw 3.5;
+    }
+    TC_CATCH_ALL_ERROR()
+    EXPECT_EQ(LastLine::text(), "unknown exception of type double");
+}
+
+TEST(ExceptionRegistry, FormattingLeavesTheHandledExceptionInPlace) {
+    ASSERT_TRUE(::tc::register_exception_formatter<LegacyError>(
+        [](const LegacyError& e, char* buf, std::size_t n) { std::snprintf(buf, n, "code=%d", e.code); }));
+    int rethrown = 0;
+    try {
+        try {
+            throw LegacyError{42};
+        } catch (...) {
+            char buf[32];
+            ASSERT_TRUE(::tc::format_current_exception(buf, sizeof(buf)));
+            EXPECT_STREQ(buf, "code=42");
+            throw;
+        }
+    } catch (const LegacyError& e) {
+        rethrown = e.code;
+    }
+    EXPECT_EQ(rethrown, 42);
+}
+
+TEST(ExceptionRegistry, FormatOutsideCatchReturnsFalse) {
+    char buf[32];
+    EXPECT_FALSE(::tc::format_current_exception(buf, sizeof(buf)));
+}
+#else
+TEST(ExceptionRegistryNoEx, RegistrationUnavailable) {
+    EXPECT_FALSE(::tc::register_exception_formatter<LegacyError>([](const LegacyError&, char*, std::size_t) {}));
+    EXPECT_STREQ(::tc::detail::describe_current_exception(), "unknown exception");
+}
+#endif
@@ -0,0 +1,77 @@
+#include <cstring>
+
+namespace {
+int hook_calls = 0;
+const char* hook_msg = nullptr;
+void on_noexcept_throw(const char* file, int line, const char* func, const char* msg) {
+    (void)file;
+    (void)line;
+    (void)func;
+    ++hook_calls;
+    hook_msg = msg;
+}
+} // namespace
+
+// Exercise the documented compile-time hook: TC_ABORT routes here instead of aborting.
+#define TC_ON_NOEXCEPT_THROW(file, line, func, msg) on_noexcept_throw(file, line, func, msg)
+#include "../include/tc/try_catch.hpp"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace {
+void say(const char* s) {
+    ::tc::detail::safe_write(2, s, std::strlen(s));
+}
+
+void low(const ::tc::fatal::context&, void*) {
+    say("low ");
+}
+void high(const ::tc::fatal::context& ctx, void* user) {
+    say(static_cast<const char*>(user));
+    say(ctx.why == ::tc::fatal::reason::noexcept_throw ? "throw " : "abort ");
+}
+
+[[noreturn]] void die(bool via_throw) {
+    ::tc::fatal::add_handler(&low, nullptr, -5);
+    ::tc::fatal::add_handler(&high, const_cast<char*>("high:"), 10);
+    const int removed = ::tc::fatal::add_handler(&low, nullptr, 100);
+    ::tc::fatal::remove_handler(removed);
+    (void)via_throw;
+#if !TC_EXCEPTIONS_ENABLED
+    if (via_throw)
+        ::tc::detail::default_abort_noexcept(__FILE__, __LINE__, __func__, ::tc::detail::noexcept_throw_msg);
+#endif
+    ::tc::detail::default_abort_noexcept(__FILE__, __LINE__, __func__, "boom");
+}
+} // namespace
+
+TEST(FatalHandlers, OnNoexceptThrowHookReplacesAbort) {
+    hook_calls = 0;
+    TC_ABORT("custom");
+    EXPECT_EQ(hook_calls, 1);
+    EXPECT_STREQ(hook_msg, "custom");
+#if !TC_EXCEPTIONS_ENABLED
+    TC_THROW(std::runtime_error("x"));
+    EXPECT_EQ(hook_calls, 2);
+    EXPECT_EQ(hook_msg, ::tc::detail::noexcept_throw_msg);
+#endif
+}
+
+TEST(FatalHandlers, AddRemoveReportsCapacity) {
+    int ids[TC_FATAL_HANDLERS_MAX];
+    int taken = 0;
+    for (int id; (id = ::tc::fatal::add_handler(&low)) != 0;)
+        ids[taken++] = id;
+    EXPECT_GT(taken, 0);
+    EXPECT_LE(taken, TC_FATAL_HANDLERS_MAX);
+    for (int i = 0; i < taken; ++i)
+        EXPECT_TRUE(::tc::fatal::remove_handler(ids[i]));
+    EXPECT_FALSE(::tc::fatal::remove_handler(ids[0]));
+}
+
+TEST(FatalHandlersDeathTest, RunInPriorityOrderBeforeAbort) {
+    EXPECT_DEATH(die(false), "high:abort low \\[tc\\] fatal");
+#if !TC_EXCEPTIONS_ENABLED
+    EXPECT_DEATH(die(true), "high:throw low \\[tc\\] fatal");
+#endif
+}
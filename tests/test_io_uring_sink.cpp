@@ -0,0 +1,149 @@
+#include "../include/tc/io_uring_sink.hpp"
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+namespace {
+std::string temp_path(const char* tag) {
+    return std::string(::testing::TempDir()) + "tc_uring_" + tag + "_" + std::to_string(::getpid()) + ".log";
+}
+
+std::vector<std::string> read_lines(const std::string& path) {
+    std::ifstream in(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(line);
+    return lines;
+}
+
+::tc::log::record make_record(::tc::log::level lvl, const std::string& payload) {
+    return {lvl, 7, "file.cpp", "fn", 0, 1, payload};
+}
+
+void write_numbered(::tc::uring::file_sink& sink, int count) {
+    for (int i = 0; i < count; ++i) {
+        const std::string payload = "record " + std::to_string(i);
+        const auto rec = make_record(::tc::log::level::info, payload);
+        sink.write(&rec, 1);
+    }
+}
+
+void check_numbered(const std::string& path, int count) {
+    const auto lines = read_lines(path);
+    ASSERT_EQ(lines.size(), static_cast<std::size_t>(count));
+    for (int i = 0; i < count; ++i)
+        ASSERT_EQ(lines[i], "[INFO] file.cpp:7 fn: record " + std::to_string(i));
+}
+} // namespace
+
+TEST(IoUringSink, WritesRecordsInOrder) {
+    const std::string path = temp_path("ring");
+    ::tc::uring::options opt;
+    opt.buffer_size = 4096; // small buffers so many writes are in flight at once
+    opt.buffers = 4;
+    opt.truncate = true;
+    {
+        ::tc::uring::file_sink sink(path.c_str(), opt);
+        ASSERT_TRUE(sink.ok());
+        write_numbered(sink, 5000);
+        sink.flush();
+        const auto st = sink.get_stats();
+        EXPECT_EQ(st.records, 5000u);
+        EXPECT_GT(st.submissions, 10u);
+        EXPECT_EQ(st.errors, 0u);
+    }
+    check_numbered(path, 5000);
+    std::remove(path.c_str());
+}
+
+TEST(IoUringSink, WritevFallback) {
+    const std::string path = temp_path("fallback");
+    ::tc::uring::options opt;
+    opt.buffer_size = 4096;
+    opt.buffers = 4;
+    opt.truncate = true;
+    opt.use_io_uring = false;
+    {
+        ::tc::uring::file_sink sink(path.c_str(), opt);
+        ASSERT_TRUE(sink.ok());
+        EXPECT_FALSE(sink.using_io_uring());
+        write_numbered(sink, 3000);
+    } // the destructor drains
+    check_numbered(path, 3000);
+    std::remove(path.c_str());
+}
+
+TEST(IoUringSink, BufferSizingCountsContextAndRepeatNote) {
+    const std::string path = temp_path("context");
+    ::tc::uring::options opt;
+    opt.buffer_size = 4096;
+    opt.buffers = 4;
+    opt.truncate = true;
+    const std::string payload(900, 'p');
+    const std::string context = "req=" + std::string(496, 'c');
+    {
+        ::tc::uring::file_sink sink(path.c_str(), opt);
+        ASSERT_TRUE(sink.ok());
+        for (int i = 0; i < 3; ++i) {
+            auto rec = make_record(::tc::log::level::info, payload);
+            rec.context = context;
+            rec.repeats = 1000000;
+            sink.write(&rec, 1);
+        }
+    }
+    const auto lines = read_lines(path);
+    ASSERT_EQ(lines.size(), 3u);
+    for (const auto& line : lines) {
+        EXPECT_EQ(line.rfind("[INFO] file.cpp:7 fn: " + payload + " (repeated 1000000 times in ", 0), 0u);
+        EXPECT_EQ(line.substr(line.size() - context.size() - 1), " " + context);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(IoUringSink, ErrorRecordsAreSubmittedImmediately) {
+    const std::string path = temp_path("urgent");
+    ::tc::uring::options opt;
+    opt.truncate = true;
+    ::tc::uring::file_sink sink(path.c_str(), opt);
+    const auto info = make_record(::tc::log::level::info, "queued");
+    const auto error = make_record(::tc::log::level::error, "boom");
+    sink.write(&info, 1);
+    EXPECT_EQ(sink.get_stats().submissions, 0u);
+    sink.write(&error, 1);
+    EXPECT_EQ(sink.get_stats().submissions, 1u);
+    sink.flush();
+    const std::vector<std::string> expected{"[INFO] file.cpp:7 fn: queued", "[ERROR] file.cpp:7 fn: boom"};
+    EXPECT_EQ(read_lines(path), expected);
+    std::remove(path.c_str());
+}
+
+TEST(IoUringSink, AsLogSinkFromManyThreads) {
+    const std::string path = temp_path("threads");
+    ::tc::uring::options opt;
+    opt.truncate = true;
+    auto prev_sink = ::tc::log::get_sink();
+    auto prev_level = ::tc::log::get_level();
+    ::tc::log::set_level(::tc::log::level::info);
+    {
+        ::tc::uring::file_sink file(path.c_str(), opt);
+        ::tc::log::set_record_sink(&::tc::uring::file_sink::sink, &file, 32);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([] {
+                for (int i = 0; i < 1000; ++i)
+                    TC_LOG_INFO("line %d", i);
+            }); // thread exit drains each thread's batch
+        }
+        for (auto& th : threads)
+            th.join();
+        ::tc::log::set_sink(prev_sink); // waits until no thread is still inside file_sink::sink
+    }
+    ::tc::log::set_level(prev_level);
+    EXPECT_EQ(read_lines(path).size(), 4000u);
+    std::remove(path.c_str());
+}
+#endif
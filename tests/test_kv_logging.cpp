@@ -0,0 +1,85 @@
+#include "../include/tc/try_catch.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+namespace {
+struct KvCapture {
+    static std::string& last() {
+        static std::string s;
+        return s;
+    }
+    static void sink(::tc::detail::log_level, const char* data, std::size_t len) {
+        last().assign(data, len);
+    }
+};
+
+struct KvScope {
+    KvScope(::tc::log::kv_format fmt) : prev_sink(::tc::log::get_kv_sink()), prev_fmt(::tc::log::get_kv_format()) {
+        prev_level = ::tc::log::get_level();
+        ::tc::log::set_level(::tc::log::level::trace);
+        ::tc::log::set_kv_sink(&KvCapture::sink);
+        ::tc::log::set_kv_format(fmt);
+        KvCapture::last().clear();
+    }
+    ~KvScope() {
+        ::tc::log::set_kv_sink(prev_sink);
+        ::tc::log::set_kv_format(prev_fmt);
+        ::tc::log::set_level(prev_level);
+    }
+    ::tc::log::kv_sink_t prev_sink;
+    ::tc::log::kv_format prev_fmt;
+    ::tc::log::level prev_level;
+};
+
+enum class color { red = 2 };
+} // namespace
+
+TEST(KvLogging, LogfmtTypedFields) {
+    KvScope scope(::tc::log::kv_format::logfmt);
+    const int line = __LINE__ + 1;
+    TC_LOG_INFO_KV("request done", "user", 42, "ok", true, "name", "a b", "ratio", 0.5, "c", color::red);
+    const std::string expected = "level=info msg=\"request done\" src=" + std::string(__FILE__) + ":" +
+                                 std::to_string(line) + " user=42 ok=true name=\"a b\" ratio=0.5 c=2\n";
+    EXPECT_EQ(KvCapture::last(), expected);
+}
+
+TEST(KvLogging, JsonEscaping) {
+    KvScope scope(::tc::log::kv_format::json);
+    TC_LOG_WARN_KV("quote\"d", "path", std::string("C:\\tmp\n"), "ctl", "\x01", "none", nullptr);
+    const std::string& out = KvCapture::last();
+    EXPECT_EQ(out.rfind("{\"level\":\"warn\",\"msg\":\"quote\\\"d\",\"src\":\"", 0), 0u) << out;
+    EXPECT_NE(out.find(",\"path\":\"C:\\\\tmp\\n\",\"ctl\":\"\\u0001\",\"none\":null}\n"), std::string::npos) << out;
+}
+
+TEST(KvLogging, OversizedRecordIsTruncated) {
+    KvScope scope(::tc::log::kv_format::logfmt);
+    const std::string big(TC_KV_BUFFER_SIZE, 'x');
+    TC_LOG_ERROR_KV("big", "small", 1, "blob", big, "after", 2);
+    const std::string& out = KvCapture::last();
+    EXPECT_LE(out.size(), static_cast<std::size_t>(TC_KV_BUFFER_SIZE));
+    EXPECT_NE(out.find(" small=1"), std::string::npos);
+    EXPECT_EQ(out.find("blob="), std::string::npos);
+    EXPECT_NE(out.find(" after=2 truncated=true\n"), std::string::npos) << out;
+}
+
+TEST(KvLogging, RespectsRuntimeLevel) {
+    KvScope scope(::tc::log::kv_format::logfmt);
+    ::tc::log::set_level(::tc::log::level::warn);
+    TC_LOG_DEBUG_KV("hidden", "k", 1);
+    EXPECT_TRUE(KvCapture::last().empty());
+    TC_LOG_ERROR_KV("shown");
+    EXPECT_EQ(KvCapture::last().rfind("level=error msg=shown ", 0), 0u);
+}
+
+TEST(KvLogging, AllFieldTypesShareOneThreadBuffer) {
+    static const char* seen[2];
+    static int calls;
+    calls = 0;
+    KvScope scope(::tc::log::kv_format::logfmt);
+    ::tc::log::set_kv_sink([](::tc::detail::log_level, const char* data, std::size_t) { seen[calls++ % 2] = data; });
+    TC_LOG_INFO_KV("a", "n", 1);
+    TC_LOG_INFO_KV("b", "s", "text", "d", 2.5);
+    ASSERT_EQ(calls, 2);
+    EXPECT_EQ(seen[0], seen[1]);
+    EXPECT_EQ(seen[0], ::tc::detail::kv_buffer());
+}
@@ -0,0 +1,149 @@
+#include "../include/tc/try_catch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::int64_t system_ns() {
+    using namespace std::chrono;
+    return static_cast<std::int64_t>(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+}
+
+// How far a converted timestamp may be from system_clock: the coarse clock only advances every few milliseconds.
+std::int64_t tolerance_ns() {
+    return std::string(::tc::log::get_clock_info().source) == "monotonic_coarse" ? 10000000 : 1000000;
+}
+
+std::int64_t converted_error_ns() {
+    const std::int64_t before = system_ns();
+    const std::uint64_t ticks = ::tc::detail::clock_ticks();
+    const std::int64_t after = system_ns();
+    const auto unix_ns = static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(ticks));
+    return unix_ns - (before + (after - before) / 2);
+}
+
+std::uint64_t captured_ts = 0;
+void capture_timestamp(void*, const ::tc::log::record* recs, std::size_t) {
+    captured_ts = recs[0].timestamp;
+}
+} // namespace
+
+TEST(LogClock, TicksAreMonotonicOnOneThread) {
+    std::uint64_t prev = ::tc::detail::clock_ticks();
+    for (int i = 0; i < 100000; ++i) {
+        const std::uint64_t now = ::tc::detail::clock_ticks();
+        ASSERT_GE(now, prev);
+        prev = now;
+    }
+}
+
+TEST(LogClock, ConvertedTimestampsMatchTheWallClock) {
+    const auto info = ::tc::log::get_clock_info();
+    ASSERT_NE(info.source, nullptr);
+    EXPECT_GT(::tc::log::timestamp_to_unix_ns(::tc::detail::clock_ticks()), 0u);
+    EXPECT_GT(::tc::log::get_clock_info().calibrations, 0u);
+    EXPECT_GT(::tc::log::get_clock_info().ns_per_tick, 0.0);
+    for (int i = 0; i < 10; ++i)
+        EXPECT_LT(std::llabs(converted_error_ns()), tolerance_ns());
+}
+
+namespace {
+// Back to the state before the first conversion, then convert from several threads at once: the ones that do not
+// calibrate must wait for the one that does (with the cycle counter it spins for 1 ms after startup), not convert
+// against the empty anchor. Runs in a child process, which has no other threads to disturb.
+void convert_before_first_calibration() {
+    auto& cal = ::tc::detail::this_process_calibration();
+    cal.seq.store(0);
+    cal.base_ticks.store(0);
+    cal.base_unix_ns.store(0);
+    cal.ns_per_tick.store(1.0);
+    cal.calibrations.store(0);
+    std::atomic<bool> go{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+        threads.emplace_back([&] {
+            while (!go.load())
+                std::this_thread::yield();
+            const std::uint64_t ticks = ::tc::detail::clock_ticks();
+            const auto unix_ns = static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(ticks));
+            if (std::llabs(unix_ns - system_ns()) > 1000000000)
+                bad.fetch_add(1);
+        });
+    go.store(true);
+    for (auto& t : threads)
+        t.join();
+    std::exit(bad.load() == 0 ? 0 : 1);
+}
+} // namespace
+
+TEST(LogClock, ConversionsRacingTheFirstCalibrationWaitForIt) {
+    EXPECT_EXIT(convert_before_first_calibration(), testing::ExitedWithCode(0), "");
+}
+
+TEST(LogClock, ElapsedTicksMatchElapsedTime) {
+    const std::uint64_t t0 = ::tc::detail::clock_ticks();
+    const auto s0 = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const std::uint64_t t1 = ::tc::detail::clock_ticks();
+    const auto s1 = std::chrono::steady_clock::now();
+    const auto measured = static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(t1)) -
+                          static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(t0));
+    const auto expected = std::chrono::duration_cast<std::chrono::nanoseconds>(s1 - s0).count();
+    EXPECT_LT(std::llabs(measured - expected), tolerance_ns());
+}
+
+// Spans more than one TC_CLOCK_RECALIBRATE_MS interval: conversion must stay on the wall clock throughout, and
+// re-anchoring must not make a record convert to a visibly different time than it did before.
+TEST(LogClock, NoDriftAcrossRecalibration) {
+    const std::uint64_t calibrations = ::tc::log::get_clock_info().calibrations;
+    const std::uint64_t early = ::tc::detail::clock_ticks();
+    const auto early_ns = static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(early));
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TC_CLOCK_RECALIBRATE_MS + 200);
+    long long worst = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+        worst = std::max(worst, std::llabs(converted_error_ns()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_LT(worst, tolerance_ns());
+    EXPECT_GT(::tc::log::get_clock_info().calibrations, calibrations);
+
+    const auto early_again = static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(early));
+    EXPECT_LT(std::llabs(early_again - early_ns), tolerance_ns());
+}
+
+TEST(LogClock, ForcedRecalibrationKeepsOrder) {
+    std::vector<std::uint64_t> ticks;
+    for (int i = 0; i < 1000; ++i)
+        ticks.push_back(::tc::detail::clock_ticks());
+    std::vector<std::int64_t> before;
+    for (auto t : ticks)
+        before.push_back(static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(t)));
+    ::tc::log::recalibrate_clock();
+    for (std::size_t i = 0; i < ticks.size(); ++i) {
+        const auto after = static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(ticks[i]));
+        EXPECT_LT(std::llabs(after - before[i]), tolerance_ns());
+        if (i > 0) {
+            EXPECT_GE(after, static_cast<std::int64_t>(::tc::log::timestamp_to_unix_ns(ticks[i - 1])));
+        }
+    }
+}
+
+TEST(LogClock, RecordsCarryRawTicks) {
+    const auto prev_sink = ::tc::log::get_sink();
+    const auto prev_level = ::tc::log::get_level();
+    ::tc::log::set_level(::tc::log::level::trace);
+    ::tc::log::set_record_sink(&capture_timestamp, nullptr);
+    const std::uint64_t before = ::tc::detail::clock_ticks();
+    ::tc::detail::logf(::tc::log::level::info, __FILE__, __LINE__, "test", "stamped");
+    const std::uint64_t after = ::tc::detail::clock_ticks();
+    ::tc::log::set_sink(prev_sink);
+    ::tc::log::set_level(prev_level);
+    EXPECT_GE(captured_ts, before);
+    EXPECT_LE(captured_ts, after);
+}
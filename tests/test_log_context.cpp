@@ -0,0 +1,139 @@
+#include "../include/tc/try_catch.hpp"
+#include "log_capture.hpp"
+#include <cstdarg>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::string legacy_line;
+void legacy_sink(::tc::log::level, const char*, int, const char*, const char* fmt, va_list ap) {
+    char buf[256];
+    std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    legacy_line = buf;
+    legacy_line += " | ";
+    legacy_line += ::tc::log::context();
+}
+
+std::string kv_line;
+void kv_sink(::tc::log::level, const char* data, std::size_t len) {
+    kv_line.assign(data, len);
+}
+
+struct LogContextTest : LogCaptureTest {};
+} // namespace
+
+TEST_F(LogContextTest, ScopedFieldsNestAndUnwind) {
+    TC_LOG_INFO("outside");
+    {
+        TC_LOG_SCOPE_FIELD("req", 42);
+        TC_LOG_INFO("one");
+        {
+            TC_LOG_SCOPE_FIELD("tenant", "acme corp");
+            TC_LOG_INFO("two");
+        }
+        TC_LOG_INFO("three");
+    }
+    TC_LOG_INFO("after");
+    ASSERT_EQ(cap.contexts.size(), 5u);
+    EXPECT_EQ(cap.contexts[0], "");
+    EXPECT_EQ(cap.contexts[1], "req=42");
+    EXPECT_EQ(cap.contexts[2], "req=42 tenant=\"acme corp\"");
+    EXPECT_EQ(cap.contexts[3], "req=42");
+    EXPECT_EQ(cap.contexts[4], "");
+    EXPECT_EQ(cap.payloads[2], "two");
+    EXPECT_TRUE(::tc::log::context().empty());
+}
+
+TEST_F(LogContextTest, LegacySinksReadTheContext) {
+    ::tc::log::set_sink(&legacy_sink);
+    TC_LOG_SCOPE_FIELD("req", 7);
+    TC_LOG_WARN("busy %d", 3);
+    EXPECT_EQ(legacy_line, "busy 3 | req=7");
+}
+
+TEST_F(LogContextTest, KvRecordsCarryTheFields) {
+    const auto prev_kv = ::tc::log::get_kv_sink();
+    const auto prev_fmt = ::tc::log::get_kv_format();
+    ::tc::log::set_kv_sink(&kv_sink);
+    TC_LOG_SCOPE_FIELD("req", 42);
+    TC_LOG_SCOPE_FIELD("user", std::string("bob"));
+
+    ::tc::log::set_kv_format(::tc::log::kv_format::logfmt);
+    TC_LOG_INFO_KV("done", "ms", 5);
+    EXPECT_NE(kv_line.find(" req=42 user=bob ms=5\n"), std::string::npos) << kv_line;
+
+    ::tc::log::set_kv_format(::tc::log::kv_format::json);
+    TC_LOG_INFO_KV("done", "ms", 5);
+    EXPECT_NE(kv_line.find(",\"req\":42,\"user\":\"bob\",\"ms\":5}\n"), std::string::npos) << kv_line;
+
+    ::tc::log::set_kv_sink(prev_kv);
+    ::tc::log::set_kv_format(prev_fmt);
+}
+
+TEST_F(LogContextTest, FieldsThatDoNotFitAreLeftOut) {
+    const std::string big(TC_LOG_CONTEXT_BYTES, 'x');
+    TC_LOG_SCOPE_FIELD("a", 1);
+    {
+        TC_LOG_SCOPE_FIELD("blob", big);
+        TC_LOG_SCOPE_FIELD("b", 2);
+        TC_LOG_INFO("msg");
+    }
+    TC_LOG_INFO("msg");
+    ASSERT_EQ(cap.contexts.size(), 2u);
+    EXPECT_EQ(cap.contexts[0], "a=1 b=2");
+    EXPECT_EQ(cap.contexts[1], "a=1");
+
+    std::vector<std::unique_ptr<::tc::detail::log_context_scope>> scopes;
+    for (int i = 0; i < TC_LOG_CONTEXT_FIELDS + 4; ++i)
+        scopes.push_back(std::make_unique<::tc::detail::log_context_scope>("k", i));
+    EXPECT_EQ(::tc::detail::this_thread_log_context().count, static_cast<std::size_t>(TC_LOG_CONTEXT_FIELDS));
+    while (!scopes.empty())
+        scopes.pop_back();
+    EXPECT_EQ(::tc::log::context(), "a=1");
+}
+
+TEST_F(LogContextTest, SnapshotMovesToAnotherThread) {
+    ::tc::log::context_snapshot snap = [] {
+        TC_LOG_SCOPE_FIELD("req", 99);
+        return ::tc::log::capture_context();
+    }();
+    EXPECT_EQ(snap.view(), "req=99");
+    EXPECT_TRUE(::tc::log::context().empty());
+
+    std::string worker_before, worker_during, worker_after;
+    std::thread worker([&] {
+        TC_LOG_SCOPE_FIELD("worker", 1);
+        worker_before = std::string(::tc::log::context());
+        {
+            ::tc::log::scoped_context use(snap);
+            TC_LOG_SCOPE_FIELD("step", "parse");
+            worker_during = std::string(::tc::log::context());
+            TC_LOG_INFO("on worker");
+        }
+        worker_after = std::string(::tc::log::context());
+    });
+    worker.join();
+    EXPECT_EQ(worker_before, "worker=1");
+    EXPECT_EQ(worker_during, "req=99 step=parse");
+    EXPECT_EQ(worker_after, "worker=1");
+    ASSERT_EQ(cap.contexts.size(), 1u);
+    EXPECT_EQ(cap.contexts[0], "req=99 step=parse");
+}
+
+TEST_F(LogContextTest, BatchedRecordsKeepTheirContext) {
+    ::tc::log::set_record_sink(&LogCapture::sink, &cap, 4);
+    for (int i = 0; i < 3; ++i) {
+        TC_LOG_SCOPE_FIELD("i", i);
+        TC_LOG_INFO("queued");
+    }
+    EXPECT_TRUE(cap.contexts.empty());
+    ::tc::log::flush();
+    ASSERT_EQ(cap.contexts.size(), 3u);
+    EXPECT_EQ(cap.contexts[0], "i=0");
+    EXPECT_EQ(cap.contexts[1], "i=1");
+    EXPECT_EQ(cap.contexts[2], "i=2");
+}
@@ -0,0 +1,125 @@
+#include "../include/tc/try_catch.hpp"
+#include "log_capture.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::vector<std::string> legacy_lines;
+void legacy_sink(::tc::log::level, const char*, int, const char*, const char* fmt, va_list ap) {
+    char buf[256];
+    std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    legacy_lines.emplace_back(buf);
+}
+
+void dedup_test_repeat(int times, const char* msg) {
+    for (int i = 0; i < times; ++i)
+        TC_LOG_ERROR("%s", msg);
+}
+
+struct LogDedupTest : LogCaptureTest {
+    LogDedupTest() {
+        ::tc::log::set_dedup(60000);
+    }
+    ~LogDedupTest() override {
+        ::tc::log::flush();
+        ::tc::log::set_dedup(0);
+    }
+};
+} // namespace
+
+TEST_F(LogDedupTest, RepeatsCollapseIntoOneSummary) {
+    const auto before = ::tc::log::get_dedup_stats();
+    dedup_test_repeat(100, "disk full");
+    ASSERT_EQ(cap.records.size(), 1u);
+    EXPECT_EQ(cap.records[0].repeats, 0u);
+    ::tc::log::flush();
+    ASSERT_EQ(cap.records.size(), 2u);
+    const CapturedRecord& sum = cap.records[1];
+    EXPECT_EQ(cap.payloads[1], "disk full");
+    EXPECT_EQ(sum.repeats, 99u);
+    EXPECT_EQ(sum.level, ::tc::log::level::error);
+    EXPECT_EQ(sum.line, cap.records[0].line);
+    EXPECT_EQ(sum.first_timestamp, cap.records[0].timestamp);
+    EXPECT_GE(sum.timestamp, sum.first_timestamp);
+    const auto after = ::tc::log::get_dedup_stats();
+    EXPECT_EQ(after.suppressed - before.suppressed, 99u);
+    EXPECT_EQ(after.summaries - before.summaries, 1u);
+}
+
+TEST_F(LogDedupTest, KeyedOnSiteMessageAndContext) {
+    for (int i = 0; i < 10; ++i)
+        TC_LOG_WARN("value %d", i % 2); // two runs from one site, interleaved
+    TC_LOG_WARN("value %d", 0);         // same message, another site
+    {
+        TC_LOG_SCOPE_FIELD("req", 7);
+        dedup_test_repeat(3, "ctx");
+    }
+    dedup_test_repeat(1, "ctx");
+    EXPECT_EQ(cap.payloads, (std::vector<std::string>{"value 0", "value 1", "value 0", "ctx", "ctx"}));
+    ::tc::log::flush();
+    ASSERT_EQ(cap.records.size(), 8u);
+    std::vector<std::uint32_t> repeats;
+    for (std::size_t i = 5; i < cap.records.size(); ++i)
+        repeats.push_back(cap.records[i].repeats);
+    std::sort(repeats.begin(), repeats.end());
+    EXPECT_EQ(repeats, (std::vector<std::uint32_t>{2, 4, 4}));
+}
+
+TEST_F(LogDedupTest, ACopyAfterTheWindowStartsANewRun) {
+    ::tc::log::set_dedup(20);
+    dedup_test_repeat(3, "slow");
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    dedup_test_repeat(1, "slow");
+    ASSERT_EQ(cap.records.size(), 3u);
+    EXPECT_EQ(cap.records[0].repeats, 0u);
+    EXPECT_EQ(cap.records[1].repeats, 2u);
+    EXPECT_EQ(cap.records[2].repeats, 0u);
+    ::tc::log::flush(); // the new run has no copies: nothing more to say
+    EXPECT_EQ(cap.records.size(), 3u);
+}
+
+TEST_F(LogDedupTest, TextSinksGetARepeatNote) {
+    ::tc::log::set_sink(&legacy_sink);
+    legacy_lines.clear();
+    dedup_test_repeat(3, "retrying");
+    ::tc::log::flush();
+    ASSERT_EQ(legacy_lines.size(), 2u);
+    EXPECT_EQ(legacy_lines[0], "retrying");
+    EXPECT_EQ(legacy_lines[1].rfind("retrying (repeated 2 times in ", 0), 0u) << legacy_lines[1];
+
+    char buf[512];
+    ::tc::detail::safe_buffer out{buf, sizeof(buf)};
+    ::tc::log::record r{::tc::log::level::error, 12, "a.cpp", "f", 0, 1, "boom"};
+    r.repeats = 5;
+    r.first_timestamp = r.timestamp;
+    ::tc::detail::append_record_line(out, r);
+    EXPECT_EQ(std::string(out.data, out.len), "[ERROR] a.cpp:12 f: boom (repeated 5 times in 0.000 s)\n");
+}
+
+#if TC_EXCEPTIONS_ENABLED
+TEST_F(LogDedupTest, CatchHelperStormsCollapse) {
+    for (int i = 0; i < 50; ++i) {
+        TC_TRY {
+            TC_THROW(std::runtime_error("connection reset"));
+        }
+        TC_CATCH_STD_ERROR()
+    }
+    ::tc::log::flush();
+    ASSERT_EQ(cap.records.size(), 2u);
+    EXPECT_EQ(cap.payloads[0], "std::runtime_error: connection reset");
+    EXPECT_EQ(cap.records[1].repeats, 49u);
+}
+#endif
+
+TEST_F(LogDedupTest, OffMeansEveryRecordGoesOut) {
+    ::tc::log::set_dedup(0);
+    dedup_test_repeat(5, "same");
+    EXPECT_EQ(cap.records.size(), 5u);
+}
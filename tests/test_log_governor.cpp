@@ -0,0 +1,152 @@
+#include "../include/tc/try_catch.hpp"
+#include "log_capture.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr std::uint64_t second = 1000000000;
+constexpr std::uint64_t t0 = 1000 * second; // synthetic steady clock for log_governor_admit_at
+
+// Offers `n` records at `lvl` at time `now`; returns how many the governor let through.
+int offer(::tc::log::level lvl, int n, std::uint64_t now) {
+    int passed = 0;
+    for (int i = 0; i < n; ++i)
+        passed += ::tc::detail::log_governor_admit_at(lvl, now) ? 1 : 0;
+    return passed;
+}
+
+std::size_t fake_depth = 0;
+std::size_t fake_queue_depth(void*) {
+    return fake_depth;
+}
+
+struct LogGovernorTest : LogCaptureTest {
+    ~LogGovernorTest() override {
+        ::tc::log::clear_governor();
+    }
+};
+} // namespace
+
+TEST_F(LogGovernorTest, RecordBudgetCapsAllButErrors) {
+    ::tc::log::governor_config c;
+    c.records_per_sec = 1;
+    c.window_ms = 10000; // 10 records per window
+    ::tc::log::set_governor(c);
+    const auto before = ::tc::log::get_governor_stats().dropped;
+    for (int i = 0; i < 30; ++i)
+        TC_LOG_INFO("info %d", i);
+    for (int i = 0; i < 5; ++i)
+        TC_LOG_ERROR("error %d", i);
+    EXPECT_EQ(cap.count(::tc::log::level::info), 10u);
+    EXPECT_EQ(cap.count(::tc::log::level::error), 5u);
+    EXPECT_EQ(cap.payloads[9], "info 9");
+    EXPECT_EQ(::tc::log::get_governor_stats().dropped - before, 20u);
+}
+
+TEST_F(LogGovernorTest, ByteBudgetCountsPayloads) {
+    ::tc::log::governor_config c;
+    c.bytes_per_sec = 100;
+    c.window_ms = 10000; // 1000 bytes per window
+    ::tc::log::set_governor(c);
+    const std::string line(100, 'x');
+    for (int i = 0; i < 20; ++i)
+        TC_LOG_WARN("%s", line.c_str());
+    EXPECT_EQ(cap.count(::tc::log::level::warn), 10u);
+}
+
+TEST_F(LogGovernorTest, FloorRisesToWhatFitsAndComesDownOneLevelPerWindow) {
+    ::tc::log::governor_config c;
+    c.records_per_sec = 100;
+    ::tc::log::set_governor(c);
+    offer(::tc::log::level::debug, 500, t0);
+    offer(::tc::log::level::info, 50, t0);
+    offer(::tc::log::level::warn, 10, t0);
+
+    // debug demand did not fit: the next window only takes info and above
+    EXPECT_EQ(offer(::tc::log::level::debug, 5, t0 + second), 0);
+    EXPECT_EQ(::tc::log::get_governor_stats().floor, ::tc::log::level::info);
+    EXPECT_EQ(offer(::tc::log::level::info, 5, t0 + second), 5);
+
+    EXPECT_EQ(offer(::tc::log::level::trace, 1, t0 + 2 * second), 0);
+    EXPECT_EQ(::tc::log::get_governor_stats().floor, ::tc::log::level::debug);
+    EXPECT_EQ(offer(::tc::log::level::debug, 1, t0 + 2 * second), 1);
+    EXPECT_EQ(offer(::tc::log::level::trace, 1, t0 + 3 * second), 1);
+    EXPECT_EQ(::tc::log::get_governor_stats().floor, ::tc::log::level::trace);
+}
+
+TEST_F(LogGovernorTest, SamplingKeepsOneInN) {
+    ::tc::log::governor_config c;
+    c.records_per_sec = 10;
+    c.sample_one_in = 4;
+    ::tc::log::set_governor(c);
+    offer(::tc::log::level::debug, 100, t0);
+    EXPECT_EQ(offer(::tc::log::level::debug, 100, t0 + second), 25);
+    EXPECT_EQ(offer(::tc::log::level::error, 3, t0 + second), 3);
+}
+
+TEST_F(LogGovernorTest, QueueDepthRaisesTheFloor) {
+    ::tc::log::governor_config c;
+    c.queue_depth = &fake_queue_depth;
+    c.max_queue_depth = 100;
+    ::tc::log::set_governor(c);
+    fake_depth = 1000;
+    offer(::tc::log::level::info, 1, t0); // each window end raises the floor one level
+    EXPECT_EQ(::tc::log::get_governor_stats().floor, ::tc::log::level::debug);
+    EXPECT_EQ(::tc::log::get_governor_stats().last_queue_depth, 1000u);
+    EXPECT_EQ(offer(::tc::log::level::info, 1, t0 + second), 1);
+    EXPECT_EQ(::tc::log::get_governor_stats().floor, ::tc::log::level::info);
+    EXPECT_EQ(offer(::tc::log::level::debug, 1, t0 + second), 0);
+
+    fake_depth = 60; // between half the limit and the limit: hold
+    offer(::tc::log::level::info, 1, t0 + 2 * second);
+    EXPECT_EQ(::tc::log::get_governor_stats().floor, ::tc::log::level::info);
+    fake_depth = 0;
+    offer(::tc::log::level::info, 1, t0 + 3 * second);
+    EXPECT_EQ(::tc::log::get_governor_stats().floor, ::tc::log::level::debug);
+}
+
+TEST_F(LogGovernorTest, DropsAreSummarizedPeriodically) {
+    ::tc::log::governor_config c;
+    c.records_per_sec = 5;
+    c.summary_ms = 3000;
+    ::tc::log::set_governor(c);
+    const auto summaries = ::tc::log::get_governor_stats().summaries;
+    offer(::tc::log::level::debug, 20, t0);         // opens the first window; 15 over budget
+    offer(::tc::log::level::info, 20, t0 + second); // floor info; 15 over budget
+    EXPECT_TRUE(cap.payloads.empty());
+    offer(::tc::log::level::warn, 1, t0 + 3 * second); // summary interval over; floor warn
+    ASSERT_EQ(cap.payloads.size(), 1u);
+    EXPECT_EQ(cap.records[0].level, ::tc::log::level::warn);
+    EXPECT_EQ(cap.payloads[0], "log governor: dropped 30 records in 3.0 s (trace 0, debug 15, info 15, warn 0), "
+                               "sampled 0; level floor WARN");
+    EXPECT_EQ(::tc::log::get_governor_stats().summaries, summaries + 1);
+
+    offer(::tc::log::level::info, 1, t0 + 7 * second); // nothing dropped since: no summary
+    EXPECT_EQ(cap.payloads.size(), 1u);
+}
+
+TEST_F(LogGovernorTest, KvRecordsAreGoverned) {
+    std::vector<std::string> lines;
+    static std::vector<std::string>* out;
+    out = &lines;
+    const auto prev_kv = ::tc::log::get_kv_sink();
+    ::tc::log::set_kv_sink([](::tc::log::level, const char* data, std::size_t len) { out->emplace_back(data, len); });
+    ::tc::log::governor_config c;
+    c.records_per_sec = 1;
+    c.window_ms = 10000;
+    ::tc::log::set_governor(c);
+    for (int i = 0; i < 15; ++i)
+        TC_LOG_INFO_KV("kv", "i", i);
+    TC_LOG_ERROR_KV("kv error");
+    ::tc::log::set_kv_sink(prev_kv);
+    EXPECT_EQ(lines.size(), 11u);
+}
+
+TEST_F(LogGovernorTest, OffByDefaultAndAfterClear) {
+    ::tc::log::clear_governor();
+    EXPECT_FALSE(::tc::log::get_governor_stats().active);
+    for (int i = 0; i < 50; ++i)
+        TC_LOG_DEBUG("debug %d", i);
+    EXPECT_EQ(cap.payloads.size(), 50u);
+}
@@ -0,0 +1,160 @@
+#define TC_LOG_SITES 1
+#include "../include/tc/try_catch.hpp"
+#include "log_capture.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+std::vector<std::string> kv_lines;
+void kv_sink(::tc::log::level, const char* data, std::size_t len) {
+    kv_lines.emplace_back(data, len);
+}
+
+// Never called: its site must be listed anyway.
+[[maybe_unused]] void sites_test_never_called() {
+    TC_LOG_DEBUG("never called");
+}
+
+int sites_test_line_a = 0, sites_test_line_b = 0;
+
+void sites_test_parse(int v) {
+    sites_test_line_a = __LINE__ + 1;
+    TC_LOG_DEBUG("parse %d", v);
+    sites_test_line_b = __LINE__ + 1;
+    TC_LOG_ERROR("parse failed %d", v);
+}
+
+void sites_test_send() {
+    TC_LOG_DEBUG("send");
+}
+
+constexpr int sites_test_constexpr(int v) {
+    if (v < 0)
+        TC_LOG_WARN("negative %d", v);
+    return v + 1;
+}
+static_assert(sites_test_constexpr(1) == 2, "a site declares nothing static");
+
+template <class T> void sites_test_template() {
+    TC_LOG_DEBUG("template %d", static_cast<int>(sizeof(T)));
+}
+
+[[maybe_unused]] void sites_test_instantiate() {
+    sites_test_template<int>();
+    sites_test_template<double>();
+}
+
+std::vector<::tc::log::site_info> sites_named(const char* prefix) {
+    std::vector<::tc::log::site_info> out;
+    ::tc::log::for_each_site([&](const ::tc::log::site_info& s) {
+        if (std::string(s.func).rfind(prefix, 0) == 0)
+            out.push_back(s);
+    });
+    return out;
+}
+
+struct LogSitesTest : LogCaptureTest {
+    LogSitesTest() : LogCaptureTest(::tc::log::level::info) {}
+    ~LogSitesTest() override {
+        ::tc::log::set_site_state(nullptr, nullptr, nullptr, ::tc::log::site_state::level);
+    }
+};
+} // namespace
+
+TEST_F(LogSitesTest, EverySiteIsListedBeforeItRuns) {
+    const auto never = sites_named("sites_test_never_called");
+    ASSERT_EQ(never.size(), 1u);
+    EXPECT_EQ(never[0].lvl, ::tc::log::level::debug);
+    EXPECT_EQ(never[0].state, ::tc::log::site_state::level);
+    EXPECT_NE(std::string(never[0].file).find("test_log_sites.cpp"), std::string::npos);
+    EXPECT_EQ(sites_named("sites_test_parse").size(), 2u);
+    EXPECT_EQ(sites_named("sites_test_template").size(), 2u); // one per instantiation
+}
+
+TEST_F(LogSitesTest, EnablingOneFunctionLeavesOthersFiltered) {
+    EXPECT_EQ(::tc::log::control_sites("func=sites_test_pars? +"), 2);
+    sites_test_parse(1);
+    sites_test_send();
+    EXPECT_EQ(cap.payloads, (std::vector<std::string>{"parse 1", "parse failed 1"}));
+
+    EXPECT_EQ(::tc::log::control_sites("func=sites_test_parse ="), 2);
+    sites_test_parse(2);
+    EXPECT_EQ(cap.payloads.back(), "parse failed 2");
+    EXPECT_EQ(cap.payloads.size(), 3u);
+}
+
+TEST_F(LogSitesTest, OffSilencesEvenErrors) {
+    const std::string line = std::to_string(sites_test_line_b);
+    EXPECT_EQ(::tc::log::set_site_state("test_log_sites.cpp", nullptr, line.c_str(), ::tc::log::site_state::off), 1u);
+    sites_test_parse(3);
+    EXPECT_TRUE(cap.payloads.empty());
+}
+
+TEST_F(LogSitesTest, MatchesByFileAndLine) {
+    const std::string range = std::to_string(sites_test_line_a) + "-" + std::to_string(sites_test_line_b);
+    EXPECT_EQ(::tc::log::control_sites(("file=*/test_log_sites.cpp line=" + range + " +").c_str()), 2);
+    EXPECT_EQ(::tc::log::control_sites("file=no_such_file.cpp +"), 0);
+    EXPECT_EQ(::tc::log::control_sites(("file=test_log_site?.cpp line=" + range + " -").c_str()), 2);
+    sites_test_parse(4);
+    EXPECT_TRUE(cap.payloads.empty());
+    const auto parse = sites_named("sites_test_parse");
+    for (const auto& s : parse)
+        EXPECT_EQ(s.state, ::tc::log::site_state::off);
+}
+
+TEST_F(LogSitesTest, MalformedSpecsAreRejected) {
+    EXPECT_EQ(::tc::log::control_sites("func=sites_test_parse"), -1); // no action
+    EXPECT_EQ(::tc::log::control_sites("function=x +"), -1);
+    EXPECT_EQ(::tc::log::control_sites("file= +"), -1);
+    EXPECT_EQ(::tc::log::control_sites("+ -"), -1);
+    for (const auto& s : sites_named("sites_test_"))
+        EXPECT_EQ(s.state, ::tc::log::site_state::level);
+}
+
+TEST_F(LogSitesTest, DisabledSitesDoNotEvaluateArguments) {
+    int evaluated = 0;
+    TC_LOG_DEBUG("value %d", ++evaluated);
+    EXPECT_EQ(evaluated, 0);
+    TC_LOG_INFO("value %d", ++evaluated);
+    EXPECT_EQ(evaluated, 1);
+    ASSERT_EQ(cap.payloads.size(), 1u);
+    EXPECT_EQ(cap.payloads[0], "value 1");
+}
+
+TEST_F(LogSitesTest, SitesWorkInConstexprFunctions) {
+    EXPECT_EQ(sites_test_constexpr(-3), -2);
+    ASSERT_EQ(cap.payloads.size(), 1u);
+    EXPECT_EQ(cap.payloads[0], "negative -3");
+    EXPECT_EQ(sites_named("sites_test_constexpr").size(), 1u);
+}
+
+TEST_F(LogSitesTest, KvSitesCanBeEnabled) {
+    const auto prev_kv = ::tc::log::get_kv_sink();
+    ::tc::log::set_kv_sink(&kv_sink);
+    kv_lines.clear();
+    const std::string enable = "file=test_log_sites.cpp line=" + std::to_string(__LINE__ + 2) + " +";
+    for (int i = 0; i < 2; ++i) {
+        TC_LOG_DEBUG_KV("kv debug", "i", i);
+        if (i == 0) {
+            EXPECT_EQ(::tc::log::control_sites(enable.c_str()), 1);
+        }
+    }
+    ::tc::log::set_kv_sink(prev_kv);
+    ASSERT_EQ(kv_lines.size(), 1u);
+    EXPECT_NE(kv_lines[0].find("i=1"), std::string::npos) << kv_lines[0];
+}
+
+TEST(LogSiteGlob, Patterns) {
+    EXPECT_TRUE(::tc::detail::glob_match("*", ""));
+    EXPECT_TRUE(::tc::detail::glob_match("a*c", "abbbc"));
+    EXPECT_TRUE(::tc::detail::glob_match("a?c", "abc"));
+    EXPECT_FALSE(::tc::detail::glob_match("a?c", "ac"));
+    EXPECT_TRUE(::tc::detail::glob_match("*.cpp", "src/net/conn.cpp"));
+    EXPECT_FALSE(::tc::detail::glob_match("*.cpp", "conn.hpp"));
+    EXPECT_TRUE(::tc::detail::site_file_matches("conn.cpp", "src/net/conn.cpp"));
+    EXPECT_TRUE(::tc::detail::site_line_matches("1*", 120));
+    EXPECT_TRUE(::tc::detail::site_line_matches("10-20", 15));
+    EXPECT_FALSE(::tc::detail::site_line_matches("10-20", 21));
+    EXPECT_FALSE(::tc::detail::site_line_matches("15", 150));
+}
@@ -41,6 +41,13 @@ struct MemSink {
         lines().push_back(level + ":" + buf);
     }
 };
+
+constexpr int logging_test_checked(int v) {
+    if (v < 0)
+        TC_LOG_WARN("negative %d", v);
+    return v * 2;
+}
+static_assert(logging_test_checked(2) == 4, "a log call on a path not taken keeps the function constexpr");
 } // namespace
 
 TEST(Logging, LevelFilterAndSink) {
@@ -63,3 +70,25 @@ TEST(Logging, LevelFilterAndSink) {
     ::tc::detail::set_log_sink(prev_sink);
     ::tc::detail::set_log_level(prev_lvl);
 }
+
+TEST(Logging, MacrosAreExpressions) {
+    auto prev_sink = ::tc::detail::get_log_sink();
+    auto prev_lvl = ::tc::detail::get_log_level();
+    ::tc::detail::set_log_sink(&MemSink::sink);
+    ::tc::detail::set_log_level(::tc::detail::log_level::info);
+
+    MemSink::lines().clear();
+    for (int i = 0; i < 2; ++i)
+        i == 1 ? TC_LOG_INFO("odd %d", i) : (void)0;
+    const int r = (TC_WARN("comma"), 7);
+    EXPECT_EQ(r, 7);
+    EXPECT_EQ(logging_test_checked(-1), -2);
+
+    ASSERT_EQ(MemSink::lines().size(), 3u);
+    EXPECT_EQ(MemSink::lines()[0], std::string("INFO:odd 1"));
+    EXPECT_EQ(MemSink::lines()[1], std::string("WARN:comma"));
+    EXPECT_EQ(MemSink::lines()[2], std::string("WARN:negative -1"));
+
+    ::tc::detail::set_log_sink(prev_sink);
+    ::tc::detail::set_log_level(prev_lvl);
+}
@@ -0,0 +1,196 @@
+#include "../include/tc/mmap_ring_sink.hpp"
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if TC_POSIX
+namespace {
+std::string temp_path(const char* tag) {
+    return std::string(::testing::TempDir()) + "tc_ring_" + tag + "_" + std::to_string(::getpid()) + ".tclog";
+}
+
+bool append_text(::tc::ring::mmap_sink& sink, const std::string& text) {
+    return sink.append(text.data(), text.size(), 1, 1, static_cast<std::uint8_t>(::tc::log::level::info));
+}
+
+// Drains the reader, skipping torn records the way tc_logtail does after a crash.
+std::vector<std::string> read_all(::tc::ring::reader& rd) {
+    std::vector<std::string> out;
+    ::tc::ring::reader::entry e{};
+    for (;;) {
+        const auto r = rd.next(e);
+        if (r == ::tc::ring::reader::result::caught_up)
+            break;
+        if (r == ::tc::ring::reader::result::pending)
+            rd.skip_torn();
+        else
+            out.emplace_back(e.text);
+    }
+    return out;
+}
+} // namespace
+
+TEST(MmapRingSink, RecordsAreReadableFromTheFile) {
+    const std::string path = temp_path("basic");
+    std::remove(path.c_str());
+    {
+        ::tc::ring::mmap_sink sink(path.c_str(), 64 * 1024);
+        ASSERT_TRUE(sink.ok());
+        const ::tc::log::record rec{::tc::log::level::warn, 12, "file.cpp", "fn", 0, 42, "disk almost full"};
+        sink.write(&rec, 1);
+        EXPECT_TRUE(append_text(sink, "second\n"));
+    }
+    // The producer is gone; what it wrote is still in the file.
+    ::tc::ring::reader rd(path.c_str());
+    ASSERT_TRUE(rd.ok());
+    ::tc::ring::reader::entry e{};
+    ASSERT_EQ(rd.next(e), ::tc::ring::reader::result::record);
+    EXPECT_EQ(e.text, "[WARN] file.cpp:12 fn: disk almost full\n");
+    EXPECT_EQ(e.level, ::tc::log::level::warn);
+    EXPECT_EQ(e.thread_id, 42u);
+    EXPECT_GT(e.timestamp, 0u);
+    ASSERT_EQ(rd.next(e), ::tc::ring::reader::result::record);
+    EXPECT_EQ(e.text, "second\n");
+    EXPECT_EQ(rd.next(e), ::tc::ring::reader::result::caught_up);
+    EXPECT_EQ(rd.lost(), 0u);
+    std::remove(path.c_str());
+}
+
+TEST(MmapRingSink, OldestRecordsAreOverwrittenAfterWrapping) {
+    const std::string path = temp_path("wrap");
+    std::remove(path.c_str());
+    ::tc::ring::mmap_sink sink(path.c_str(), 64 * 1024);
+    ASSERT_TRUE(sink.ok());
+    const int total = 10000; // ~64 bytes each, several laps of the ring
+    for (int i = 0; i < total; ++i)
+        ASSERT_TRUE(append_text(sink, "record " + std::to_string(i) + "\n"));
+
+    ::tc::ring::reader rd(path.c_str());
+    ASSERT_TRUE(rd.ok());
+    const auto lines = read_all(rd);
+    ASSERT_GT(lines.size(), 100u);
+    ASSERT_LT(lines.size(), static_cast<std::size_t>(total));
+    const int first = total - static_cast<int>(lines.size());
+    for (std::size_t i = 0; i < lines.size(); ++i)
+        ASSERT_EQ(lines[i], "record " + std::to_string(first + static_cast<int>(i)) + "\n");
+    EXPECT_EQ(rd.lost(), 0u); // seek_oldest() starts past what was overwritten
+    std::remove(path.c_str());
+}
+
+TEST(MmapRingSink, LappedReaderCountsLostBytes) {
+    const std::string path = temp_path("lap");
+    std::remove(path.c_str());
+    ::tc::ring::mmap_sink sink(path.c_str(), 64 * 1024);
+    ASSERT_TRUE(sink.ok());
+    ::tc::ring::reader rd(path.c_str());
+    ASSERT_TRUE(rd.ok());
+    ASSERT_TRUE(append_text(sink, "early\n"));
+    for (int i = 0; i < 5000; ++i)
+        ASSERT_TRUE(append_text(sink, "late " + std::to_string(i) + "\n"));
+
+    const auto lines = read_all(rd);
+    ASSERT_FALSE(lines.empty());
+    EXPECT_NE(lines.front(), "early\n");
+    EXPECT_EQ(lines.back(), "late 4999\n");
+    EXPECT_GT(rd.lost(), 0u);
+    std::remove(path.c_str());
+}
+
+TEST(MmapRingSink, ReopeningContinuesTheRingAndBumpsTheGeneration) {
+    const std::string path = temp_path("gen");
+    std::remove(path.c_str());
+    std::uint64_t gen;
+    {
+        ::tc::ring::mmap_sink sink(path.c_str(), 64 * 1024);
+        ASSERT_TRUE(sink.ok());
+        gen = sink.generation();
+        ASSERT_TRUE(append_text(sink, "before restart\n"));
+    }
+    ::tc::ring::mmap_sink sink(path.c_str(), 64 * 1024);
+    ASSERT_TRUE(sink.ok());
+    EXPECT_EQ(sink.generation(), gen + 1);
+    ASSERT_TRUE(append_text(sink, "after restart\n"));
+
+    ::tc::ring::reader rd(path.c_str());
+    ASSERT_TRUE(rd.ok());
+    EXPECT_EQ(rd.generation(), gen + 1);
+    const auto lines = read_all(rd);
+    ASSERT_EQ(lines.size(), 2u);
+    EXPECT_EQ(lines[0], "before restart\n");
+    EXPECT_EQ(lines[1], "after restart\n");
+    std::remove(path.c_str());
+}
+
+TEST(MmapRingSink, TornRecordIsSkipped) {
+    const std::string path = temp_path("torn");
+    std::remove(path.c_str());
+    ::tc::ring::mmap_sink sink(path.c_str(), 64 * 1024);
+    ASSERT_TRUE(sink.ok());
+    ASSERT_TRUE(append_text(sink, "intact\n"));
+
+    // Simulate a producer that died between reserving its slot and committing it.
+    {
+        int fd = ::open(path.c_str(), O_RDWR);
+        ASSERT_GE(fd, 0);
+        std::size_t len = 0;
+        char* base = static_cast<char*>(::tc::detail::ring_map_file(fd, true, &len));
+        ASSERT_NE(base, nullptr);
+        auto* h = reinterpret_cast<::tc::ring::file_header*>(base);
+        const std::uint64_t pos = h->write_cursor.fetch_add(64);
+        auto* r = reinterpret_cast<::tc::ring::record_header*>(base + ::tc::ring::file_header_size +
+                                                               (pos & (h->capacity - 1)));
+        r->pos.store(pos);
+        r->size = 64;
+        r->state.store(::tc::ring::writing);
+        ::munmap(base, len);
+        ::close(fd);
+    }
+    ASSERT_TRUE(append_text(sink, "after crash\n"));
+
+    ::tc::ring::reader rd(path.c_str());
+    ASSERT_TRUE(rd.ok());
+    ::tc::ring::reader::entry e{};
+    ASSERT_EQ(rd.next(e), ::tc::ring::reader::result::record);
+    EXPECT_EQ(e.text, "intact\n");
+    ASSERT_EQ(rd.next(e), ::tc::ring::reader::result::pending);
+    rd.skip_torn();
+    EXPECT_EQ(rd.lost(), 64u);
+    ASSERT_EQ(rd.next(e), ::tc::ring::reader::result::record);
+    EXPECT_EQ(e.text, "after crash\n");
+    std::remove(path.c_str());
+}
+
+TEST(MmapRingSink, ConcurrentProducersDoNotInterleave) {
+    const std::string path = temp_path("mt");
+    std::remove(path.c_str());
+    ::tc::ring::mmap_sink sink(path.c_str(), 1 << 20);
+    ASSERT_TRUE(sink.ok());
+    const int threads = 4, per_thread = 2000;
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            for (int i = 0; i < per_thread; ++i)
+                append_text(sink, "t" + std::to_string(t) + " " + std::to_string(i) + "\n");
+        });
+    }
+    for (auto& th : pool)
+        th.join();
+
+    ::tc::ring::reader rd(path.c_str());
+    ASSERT_TRUE(rd.ok());
+    const auto lines = read_all(rd);
+    ASSERT_EQ(lines.size(), static_cast<std::size_t>(threads * per_thread));
+    std::vector<int> next(threads, 0);
+    for (const auto& line : lines) {
+        int t = -1, i = -1;
+        ASSERT_EQ(std::sscanf(line.c_str(), "t%d %d", &t, &i), 2) << line;
+        ASSERT_GE(t, 0);
+        ASSERT_LT(t, threads);
+        EXPECT_EQ(i, next[t]++); // each producer's records stay in order
+    }
+    EXPECT_EQ(rd.lost(), 0u);
+    std::remove(path.c_str());
+}
+#endif
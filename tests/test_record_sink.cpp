@@ -0,0 +1,78 @@
+#include "../include/tc/try_catch.hpp"
+#include "log_capture.hpp"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+struct RecordSinkTest : LogCaptureTest {};
+} // namespace
+
+TEST_F(RecordSinkTest, DeliversFormattedRecords) {
+    ::tc::log::set_record_sink(&LogCapture::sink, &cap);
+    EXPECT_EQ(::tc::log::get_sink(), nullptr);
+    const int line = __LINE__ + 1;
+    TC_LOG_INFO("answer=%d %s", 42, "ok");
+    ASSERT_EQ(cap.records.size(), 1u);
+    EXPECT_EQ(cap.records[0].level, ::tc::log::level::info);
+    EXPECT_EQ(cap.records[0].line, line);
+    EXPECT_EQ(cap.records[0].payload, "answer=42 ok");
+    EXPECT_NE(cap.records[0].thread_id, 0u);
+
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+    const auto unix_ns = static_cast<long long>(::tc::log::timestamp_to_unix_ns(cap.records[0].timestamp));
+    EXPECT_LT(std::llabs(now - unix_ns), 5'000'000'000LL);
+}
+
+TEST_F(RecordSinkTest, BatchesPerThread) {
+    ::tc::log::set_record_sink(&LogCapture::sink, &cap, 4);
+    for (int i = 0; i < 3; ++i)
+        TC_LOG_INFO("r%d", i);
+    EXPECT_TRUE(cap.calls.empty());
+    TC_LOG_INFO("r3");
+    ASSERT_EQ(cap.calls.size(), 1u);
+    EXPECT_EQ(cap.calls[0], 4u);
+    EXPECT_EQ(cap.records[3].payload, "r3");
+
+    TC_LOG_DEBUG("pending");
+    ::tc::log::flush();
+    ASSERT_EQ(cap.calls.size(), 2u);
+    EXPECT_EQ(cap.records.back().payload, "pending");
+
+    TC_LOG_WARN("queued");
+    TC_LOG_ERROR("urgent"); // errors drain the queue immediately
+    ASSERT_EQ(cap.calls.size(), 3u);
+    EXPECT_EQ(cap.calls[2], 2u);
+    EXPECT_EQ(cap.records.back().payload, "urgent");
+}
+
+TEST_F(RecordSinkTest, TruncatesLongMessages) {
+    ::tc::log::set_record_sink(&LogCapture::sink, &cap);
+    const std::string big(TC_LOG_MESSAGE_MAX * 2, 'x');
+    TC_LOG_INFO("%s", big.c_str());
+    ASSERT_EQ(cap.records.size(), 1u);
+    EXPECT_EQ(cap.records[0].payload.size(), static_cast<std::size_t>(TC_LOG_MESSAGE_MAX - 1));
+}
+
+TEST_F(RecordSinkTest, LegacySinkStillWorks) {
+    ::tc::log::set_record_sink(&LogCapture::sink, &cap);
+    ::tc::log::set_sink(prev_sink);
+    EXPECT_EQ(::tc::log::get_sink(), prev_sink);
+    TC_LOG_TRACE("to legacy");
+    EXPECT_TRUE(cap.records.empty());
+}
+
+TEST_F(RecordSinkTest, StderrRecordSinkWritesBatch) {
+    ::tc::log::set_record_sink(&::tc::log::stderr_record_sink, nullptr, 8);
+    ::testing::internal::CaptureStderr();
+    TC_LOG_INFO("first");
+    TC_LOG_INFO("second");
+    ::tc::log::flush();
+    const std::string out = ::testing::internal::GetCapturedStderr();
+    EXPECT_NE(out.find("[INFO] "), std::string::npos);
+    EXPECT_NE(out.find(": first\n"), std::string::npos) << out;
+    EXPECT_NE(out.find(": second\n"), std::string::npos) << out;
+}
@@ -0,0 +1,283 @@
+#include "../include/tc/rotating_file_sink.hpp"
+#include <fstream>
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+#if TC_POSIX
+namespace {
+// A fresh directory per test, so segments from other tests are never counted.
+struct RotatingFileTest : ::testing::Test {
+    RotatingFileTest() {
+        const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        dir = std::string(::testing::TempDir()) + "tc_rotate_" + info->name() + "_" + std::to_string(::getpid());
+        remove_all();
+        ::mkdir(dir.c_str(), 0755);
+        path = dir + "/app.log";
+    }
+    ~RotatingFileTest() override {
+        remove_all();
+    }
+
+    std::vector<std::string> files() const {
+        std::vector<std::string> out;
+        if (DIR* d = ::opendir(dir.c_str())) {
+            while (const dirent* e = ::readdir(d))
+                if (e->d_name[0] != '.')
+                    out.push_back(dir + "/" + e->d_name);
+            ::closedir(d);
+        }
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    void remove_all() const {
+        for (const auto& f : files())
+            ::unlink(f.c_str());
+        ::rmdir(dir.c_str());
+    }
+
+    static std::vector<std::string> read_lines(const std::string& file) {
+        std::ifstream in(file);
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(in, line);)
+            lines.push_back(line);
+        return lines;
+    }
+
+    static std::uint64_t size_of(const std::string& file) {
+        struct stat st;
+        return ::stat(file.c_str(), &st) == 0 ? static_cast<std::uint64_t>(st.st_size) : 0;
+    }
+
+    std::string dir, path;
+};
+
+void write(::tc::rotate::file_sink& sink, const std::string& payload) {
+    const ::tc::log::record rec{::tc::log::level::info, 7, "file.cpp", "fn", 0, 1, payload};
+    ::tc::rotate::file_sink::sink(&sink, &rec, 1);
+}
+
+bool have_gzip() {
+    return std::system("command -v gzip >/dev/null 2>&1") == 0;
+}
+} // namespace
+
+TEST_F(RotatingFileTest, ConcurrentWritersLoseAndDuplicateNothing) {
+    constexpr int threads = 4, per_thread = 5000;
+    ::tc::rotate::options opt;
+    opt.max_bytes = 16 * 1024;
+    opt.max_files = 0;
+    std::vector<std::string> segments;
+    {
+        ::tc::rotate::file_sink sink(path.c_str(), opt);
+        ASSERT_TRUE(sink.ok());
+        const auto prev_sink = ::tc::log::get_sink();
+        ::tc::log::set_record_sink(&::tc::rotate::file_sink::sink, &sink);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+            workers.emplace_back([t] {
+                for (int i = 0; i < per_thread; ++i)
+                    TC_LOG_WARN("writer %d line %d", t, i);
+            });
+        for (auto& w : workers)
+            w.join();
+        ::tc::log::set_sink(prev_sink);
+        sink.flush();
+        const auto st = sink.get_stats();
+        EXPECT_EQ(st.records, static_cast<std::uint64_t>(threads * per_thread));
+        EXPECT_GT(st.rotations, 10u);
+        EXPECT_EQ(st.errors, 0u);
+        segments = sink.segments();
+        EXPECT_EQ(segments.size(), st.rotations);
+    }
+    std::set<std::string> seen;
+    std::size_t lines = 0;
+    for (const auto& f : files()) {
+        EXPECT_LE(size_of(f), opt.max_bytes) << f;
+        for (const auto& line : read_lines(f)) {
+            ++lines;
+            const std::size_t at = line.find("writer ");
+            ASSERT_NE(at, std::string::npos) << line;
+            EXPECT_TRUE(seen.insert(line.substr(at)).second) << "duplicate: " << line;
+        }
+    }
+    EXPECT_EQ(lines, static_cast<std::size_t>(threads * per_thread));
+    EXPECT_EQ(seen.size(), static_cast<std::size_t>(threads * per_thread));
+    EXPECT_EQ(files().size(), segments.size() + 1);
+}
+
+TEST_F(RotatingFileTest, KeepsAtMostMaxFilesSegments) {
+    ::tc::rotate::options opt;
+    opt.max_bytes = 1024;
+    opt.max_files = 3;
+    {
+        ::tc::rotate::file_sink sink(path.c_str(), opt);
+        for (int i = 0; i < 500; ++i)
+            write(sink, "record " + std::to_string(i));
+        sink.flush();
+        EXPECT_EQ(sink.segments().size(), 3u);
+        EXPECT_GT(sink.get_stats().deleted, 0u);
+    }
+    EXPECT_EQ(files().size(), 4u);
+    // The newest records are in the current file, the ones before them in the newest segment.
+    const auto current = read_lines(path);
+    ASSERT_FALSE(current.empty());
+    EXPECT_EQ(current.back(), "[INFO] file.cpp:7 fn: record 499");
+
+    // A new sink counts the segments already on disk against max_files.
+    opt.max_files = 1;
+    {
+        ::tc::rotate::file_sink sink(path.c_str(), opt);
+        EXPECT_EQ(sink.segments().size(), 1u);
+    }
+    EXPECT_EQ(files().size(), 2u);
+}
+
+TEST_F(RotatingFileTest, OnlyExactSegmentNamesAreCountedOrDeleted) {
+    const std::vector<std::string> segments = {path + ".20240101-000000", path + ".20240101-000000-001.gz",
+                                               path + ".20240101-000000-002"};
+    const std::vector<std::string> others = {path + ".20240101-000000.bak", path + ".2024-notes",
+                                             path + ".20240101-000000-1000", path + ".20240101-0000001",
+                                             dir + "/app.logx.20240101-000000"};
+    for (const auto& f : segments)
+        std::ofstream(f) << "old\n";
+    for (const auto& f : others)
+        std::ofstream(f) << "keep\n";
+    ::tc::rotate::options opt;
+    opt.max_files = 2;
+    {
+        ::tc::rotate::file_sink sink(path.c_str(), opt);
+        const std::vector<std::string> kept = {path + ".20240101-000000-001", path + ".20240101-000000-002"};
+        EXPECT_EQ(sink.segments(), kept);
+        EXPECT_EQ(sink.get_stats().deleted, 1u);
+    }
+    EXPECT_NE(::access(segments[0].c_str(), F_OK), 0) << "the oldest segment is deleted";
+    for (const auto& f : others)
+        EXPECT_EQ(read_lines(f), std::vector<std::string>{"keep"}) << f;
+}
+
+TEST_F(RotatingFileTest, RotatesByAge) {
+    ::tc::rotate::options opt;
+    opt.max_bytes = 0;
+    opt.interval_ms = 50;
+    ::tc::rotate::file_sink sink(path.c_str(), opt);
+    write(sink, "first");
+    sink.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    write(sink, "second");
+    sink.flush();
+    ASSERT_EQ(sink.segments().size(), 1u);
+    EXPECT_EQ(read_lines(sink.segments()[0]), std::vector<std::string>{"[INFO] file.cpp:7 fn: first"});
+    EXPECT_EQ(read_lines(path), std::vector<std::string>{"[INFO] file.cpp:7 fn: second"});
+
+    // An interval without records leaves no empty segment behind.
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    write(sink, "third");
+    sink.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    write(sink, "fourth");
+    sink.flush();
+    EXPECT_EQ(sink.get_stats().rotations, 3u);
+}
+
+// Uses up every free descriptor for the lifetime of the object, so the next open() fails with EMFILE.
+struct DescriptorsExhausted {
+    DescriptorsExhausted() {
+        ::getrlimit(RLIMIT_NOFILE, &saved);
+        rlimit low = saved;
+        low.rlim_cur = std::min<rlim_t>(saved.rlim_cur, 1024);
+        ::setrlimit(RLIMIT_NOFILE, &low);
+        for (int fd; (fd = ::dup(0)) >= 0;)
+            fds.push_back(fd);
+    }
+    ~DescriptorsExhausted() {
+        for (const int fd : fds)
+            ::close(fd);
+        ::setrlimit(RLIMIT_NOFILE, &saved);
+    }
+    rlimit saved{};
+    std::vector<int> fds;
+};
+
+TEST_F(RotatingFileTest, FailedReopenIsRetriedAtTheNextRotation) {
+    ::tc::rotate::options opt;
+    opt.max_bytes = 0;
+    opt.interval_ms = 50;
+    ::tc::rotate::file_sink sink(path.c_str(), opt);
+    write(sink, "first");
+    sink.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    {
+        DescriptorsExhausted no_fds;
+        write(sink, "second"); // the file is renamed, but a new one cannot be opened
+        sink.flush();
+    }
+    EXPECT_EQ(sink.get_stats().errors, 1u);
+    EXPECT_EQ(sink.get_stats().rotations, 0u);
+    EXPECT_NE(::access(path.c_str(), F_OK), 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    write(sink, "third");
+    sink.flush();
+    EXPECT_EQ(sink.get_stats().errors, 1u);
+    ASSERT_EQ(sink.segments().size(), 1u);
+    const std::vector<std::string> renamed = {"[INFO] file.cpp:7 fn: first", "[INFO] file.cpp:7 fn: second"};
+    EXPECT_EQ(read_lines(sink.segments()[0]), renamed);
+    EXPECT_EQ(read_lines(path), std::vector<std::string>{"[INFO] file.cpp:7 fn: third"});
+}
+
+TEST_F(RotatingFileTest, CompressesRotatedSegments) {
+    if (!have_gzip())
+        GTEST_SKIP() << "gzip is not installed";
+    ::tc::rotate::options opt;
+    opt.max_bytes = 4096;
+    opt.max_files = 2;
+    opt.compress = true;
+    {
+        ::tc::rotate::file_sink sink(path.c_str(), opt);
+        for (int i = 0; i < 400; ++i)
+            write(sink, "record " + std::to_string(i));
+        sink.flush();
+        EXPECT_GT(sink.get_stats().rotations, 2u);
+    } // waits for the compressors, then deletes what is over max_files
+    const auto on_disk = files();
+    ASSERT_EQ(on_disk.size(), 3u);
+    EXPECT_EQ(on_disk[0], path);
+    for (std::size_t i = 1; i < on_disk.size(); ++i) {
+        EXPECT_EQ(on_disk[i].substr(on_disk[i].size() - 3), ".gz") << on_disk[i];
+        EXPECT_GT(size_of(on_disk[i]), 0u);
+    }
+}
+
+TEST_F(RotatingFileTest, LongestLogRecordIsWrittenWhole) {
+    const std::string longest(TC_LOG_MESSAGE_MAX - 1, 'm');
+    {
+        ::tc::rotate::file_sink sink(path.c_str());
+        write(sink, longest);
+        write(sink, std::string(TC_ASYNC_RECORD_BYTES + 10, 'x'));
+    }
+    const auto lines = read_lines(path);
+    ASSERT_EQ(lines.size(), 2u);
+    EXPECT_EQ(lines[0], "[INFO] file.cpp:7 fn: " + longest);
+    EXPECT_EQ(lines[1].substr(lines[1].size() - 11), "[truncated]");
+}
+
+TEST_F(RotatingFileTest, MissingCompressorIsCounted) {
+    ::tc::rotate::options opt;
+    opt.max_bytes = 256;
+    opt.compress = true;
+    opt.compressor = "tc-no-such-compressor";
+    ::tc::rotate::file_sink sink(path.c_str(), opt);
+    for (int i = 0; i < 20; ++i)
+        write(sink, "record " + std::to_string(i));
+    sink.flush();
+    EXPECT_GT(sink.get_stats().rotations, 0u);
+    EXPECT_GT(sink.get_stats().errors, 0u);
+    EXPECT_EQ(sink.get_stats().compressions, 0u);
+    EXPECT_EQ(read_lines(path).back(), "[INFO] file.cpp:7 fn: record 19");
+}
+#endif
@@ -0,0 +1,229 @@
+#include "../include/tc/shm_sink.hpp"
+#include <atomic>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+#if TC_POSIX
+namespace {
+std::string segment_name(const char* tag) {
+    return "/tc_shm_" + std::string(tag) + "_" + std::to_string(::getpid());
+}
+
+::tc::log::record make_record(const std::string& payload, std::uint64_t tid = 1) {
+    return {::tc::log::level::info, 7, "file.cpp", "fn", ::tc::detail::log_timestamp(), tid, payload};
+}
+
+// Drains the segment, skipping records torn by a dead producer the way tc_logcollector does.
+std::vector<std::string> drain(::tc::shm::consumer& c) {
+    std::vector<std::string> out;
+    ::tc::shm::consumer::entry e{};
+    for (;;) {
+        const auto r = c.next(e);
+        if (r == ::tc::shm::consumer::result::record)
+            out.emplace_back(e.payload);
+        else if (r == ::tc::shm::consumer::result::pending && !c.producer_alive())
+            c.skip_torn();
+        else
+            break;
+    }
+    return out;
+}
+} // namespace
+
+TEST(ShmSink, RecordsReachTheConsumerIntact) {
+    const std::string name = segment_name("basic");
+    ::tc::shm::producer p(name.c_str(), 64 * 1024);
+    ASSERT_TRUE(p.ok());
+    ::tc::shm::consumer c(name.c_str());
+    ASSERT_TRUE(c.ok());
+
+    const ::tc::log::record rec{::tc::log::level::error, 42, "src/a.cpp", "handler", ::tc::detail::log_timestamp(),
+                                99, "disk full"};
+    ASSERT_TRUE(p.push(rec));
+    ::tc::shm::consumer::entry e{};
+    ASSERT_EQ(c.next(e), ::tc::shm::consumer::result::record);
+    EXPECT_EQ(e.level, ::tc::log::level::error);
+    EXPECT_EQ(e.line, 42);
+    EXPECT_STREQ(e.file, "src/a.cpp");
+    EXPECT_STREQ(e.func, "handler");
+    EXPECT_EQ(e.payload, "disk full");
+    EXPECT_EQ(e.thread_id, 99u);
+    EXPECT_EQ(e.timestamp, ::tc::log::timestamp_to_unix_ns(rec.timestamp));
+    EXPECT_EQ(c.next(e), ::tc::shm::consumer::result::empty);
+    ::shm_unlink(name.c_str());
+}
+
+TEST(ShmSink, FullSegmentDropsInsteadOfBlocking) {
+    const std::string name = segment_name("full");
+    ::tc::shm::producer p(name.c_str(), 64 * 1024);
+    ASSERT_TRUE(p.ok());
+    ::tc::shm::consumer c(name.c_str());
+    ASSERT_TRUE(c.ok());
+
+    const std::string payload(100, 'x');
+    int accepted = 0;
+    while (p.push(make_record(payload)))
+        ++accepted;
+    EXPECT_GT(accepted, 100);
+    EXPECT_EQ(p.dropped(), 1u);
+    EXPECT_EQ(drain(c).size(), static_cast<std::size_t>(accepted));
+    EXPECT_TRUE(p.push(make_record(payload))); // space is released as the consumer reads
+    ::shm_unlink(name.c_str());
+}
+
+TEST(ShmSink, RecordsStayInOrderAcrossWraps) {
+    const std::string name = segment_name("wrap");
+    ::tc::shm::producer p(name.c_str(), 64 * 1024);
+    ASSERT_TRUE(p.ok());
+    ::tc::shm::consumer c(name.c_str());
+    ASSERT_TRUE(c.ok());
+
+    int next = 0;
+    for (int round = 0; round < 50; ++round) {
+        for (int i = 0; i < 200; ++i) {
+            const int n = round * 200 + i;
+            ASSERT_TRUE(p.push(make_record("record " + std::to_string(n) + std::string(n % 97, '.'))));
+        }
+        for (const auto& payload : drain(c)) {
+            ASSERT_EQ(payload, "record " + std::to_string(next) + std::string(next % 97, '.'));
+            ++next;
+        }
+    }
+    EXPECT_EQ(next, 50 * 200);
+    EXPECT_EQ(p.dropped(), 0u);
+    ::shm_unlink(name.c_str());
+}
+
+TEST(ShmSink, RecordsSurviveProducerCrash) {
+    const std::string name = segment_name("crash");
+    const pid_t child = ::fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        auto* p = new ::tc::shm::producer(name.c_str(), 64 * 1024); // never destroyed
+        for (int i = 0; i < 100; ++i)
+            p->push(make_record("before crash " + std::to_string(i)));
+        ::abort();
+    }
+    int status = 0;
+    ASSERT_EQ(::waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFSIGNALED(status));
+
+    ::tc::shm::consumer c(name.c_str());
+    ASSERT_TRUE(c.ok());
+    EXPECT_FALSE(c.producer_alive());
+    const auto lines = drain(c);
+    ASSERT_EQ(lines.size(), 100u);
+    EXPECT_EQ(lines.front(), "before crash 0");
+    EXPECT_EQ(lines.back(), "before crash 99");
+    ::shm_unlink(name.c_str());
+}
+
+TEST(ShmSink, TornRecordOfDeadProducerIsSkipped) {
+    const std::string name = segment_name("torn");
+    ::tc::shm::producer p(name.c_str(), 64 * 1024);
+    ASSERT_TRUE(p.ok());
+    ASSERT_TRUE(p.push(make_record("intact")));
+
+    // Reserve a slot and stamp it, as a producer that died before committing would have.
+    const int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    std::size_t len = 0;
+    char* base = static_cast<char*>(::tc::detail::ring_map_file(fd, true, &len));
+    ASSERT_NE(base, nullptr);
+    auto* h = reinterpret_cast<::tc::shm::segment_header*>(base);
+    const std::uint64_t pos = h->write_cursor.fetch_add(96);
+    auto* r = reinterpret_cast<::tc::shm::record_header*>(base + ::tc::shm::segment_header_size +
+                                                          (pos & (h->capacity - 1)));
+    r->pos.store(pos);
+    r->size = 96;
+    ASSERT_TRUE(p.push(make_record("after crash")));
+
+    ::tc::shm::consumer c(name.c_str());
+    ASSERT_TRUE(c.ok());
+    ::tc::shm::consumer::entry e{};
+    ASSERT_EQ(c.next(e), ::tc::shm::consumer::result::record);
+    ASSERT_EQ(c.next(e), ::tc::shm::consumer::result::pending);
+    EXPECT_TRUE(c.producer_alive()); // this process: the collector must keep waiting
+
+    const pid_t child = ::fork();
+    ASSERT_GE(child, 0);
+    if (child == 0)
+        ::_exit(0);
+    ASSERT_EQ(::waitpid(child, nullptr, 0), child);
+    h->producer_pid.store(child); // now a producer that is gone
+    EXPECT_FALSE(c.producer_alive());
+    c.skip_torn();
+    EXPECT_EQ(c.lost(), 96u);
+    ASSERT_EQ(c.next(e), ::tc::shm::consumer::result::record);
+    EXPECT_EQ(e.payload, "after crash");
+    ::munmap(base, len);
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+}
+
+TEST(ShmSink, ConcurrentProducersWithLiveConsumer) {
+    const std::string name = segment_name("mpsc");
+    ::tc::shm::producer p(name.c_str(), 64 * 1024);
+    ASSERT_TRUE(p.ok());
+    ::tc::shm::consumer c(name.c_str());
+    ASSERT_TRUE(c.ok());
+
+    const int threads = 4, per_thread = 5000;
+    std::atomic<int> accepted{0};
+    std::atomic<bool> done{false};
+    std::vector<std::string> got;
+    std::thread collector([&] {
+        for (;;) {
+            const bool last = done.load();
+            for (auto& s : drain(c))
+                got.push_back(std::move(s));
+            if (last)
+                break;
+            std::this_thread::yield();
+        }
+    });
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            for (int i = 0; i < per_thread; ++i) {
+                if (p.push(make_record("t" + std::to_string(t) + " " + std::to_string(i), t)))
+                    accepted.fetch_add(1);
+            }
+        });
+    }
+    for (auto& th : pool)
+        th.join();
+    done.store(true);
+    collector.join();
+
+    EXPECT_EQ(got.size(), static_cast<std::size_t>(accepted.load()));
+    EXPECT_EQ(static_cast<std::uint64_t>(accepted.load()) + p.dropped(), std::uint64_t(threads) * per_thread);
+    std::vector<int> last(threads, -1);
+    for (const auto& s : got) {
+        int t = -1, i = -1;
+        ASSERT_EQ(std::sscanf(s.c_str(), "t%d %d", &t, &i), 2) << s;
+        ASSERT_GE(t, 0);
+        ASSERT_LT(t, threads);
+        EXPECT_GT(i, last[t]); // drops leave gaps but never reorder
+        last[t] = i;
+    }
+    ::shm_unlink(name.c_str());
+}
+
+#if defined(__linux__)
+TEST(ShmSink, AnonymousSegmentIsSharedThroughItsDescriptor) {
+    ::tc::shm::producer p(::tc::shm::producer::anonymous, 64 * 1024);
+    ASSERT_TRUE(p.ok());
+    ::tc::shm::consumer c(::dup(p.fd()));
+    ASSERT_TRUE(c.ok());
+    ASSERT_TRUE(p.push(make_record("over memfd")));
+    const auto lines = drain(c);
+    ASSERT_EQ(lines.size(), 1u);
+    EXPECT_EQ(lines[0], "over memfd");
+}
+#endif
+#endif
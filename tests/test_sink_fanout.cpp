@@ -0,0 +1,102 @@
+#include "../include/tc/try_catch.hpp"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+struct Collect {
+    std::vector<std::string> lines;
+    static void sink(void* ctx, const ::tc::log::record* recs, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+            static_cast<Collect*>(ctx)->lines.emplace_back(recs[i].payload);
+    }
+};
+
+std::atomic<int> counted{0};
+void count_sink(void*, const ::tc::log::record*, std::size_t n) {
+    counted.fetch_add(static_cast<int>(n), std::memory_order_relaxed);
+}
+
+struct SinkFanout : ::testing::Test {
+    SinkFanout() : prev_sink(::tc::log::get_sink()), prev_level(::tc::log::get_level()) {
+        ::tc::log::set_level(::tc::log::level::trace);
+        ::tc::log::set_sink(nullptr);
+    }
+    ~SinkFanout() override {
+        ::tc::log::set_sink(prev_sink);
+        ::tc::log::set_level(prev_level);
+    }
+    ::tc::log::sink_t prev_sink;
+    ::tc::log::level prev_level;
+};
+} // namespace
+
+TEST_F(SinkFanout, RoutesByPerSinkLevel) {
+    Collect all, errors;
+    const int a = ::tc::log::add_sink(&Collect::sink, &all);
+    const int e = ::tc::log::add_sink(&Collect::sink, &errors, ::tc::log::level::error);
+    ASSERT_NE(a, 0);
+    ASSERT_NE(e, 0);
+    TC_LOG_INFO("info %d", 1);
+    TC_LOG_ERROR("error %d", 2);
+    EXPECT_EQ(all.lines, (std::vector<std::string>{"info 1", "error 2"}));
+    EXPECT_EQ(errors.lines, (std::vector<std::string>{"error 2"}));
+
+    EXPECT_TRUE(::tc::log::set_sink_level(e, ::tc::log::level::info));
+    EXPECT_TRUE(::tc::log::remove_sink(a));
+    EXPECT_FALSE(::tc::log::remove_sink(a));
+    TC_LOG_INFO("info %d", 3);
+    EXPECT_EQ(all.lines.size(), 2u);
+    EXPECT_EQ(errors.lines.back(), "info 3");
+}
+
+TEST_F(SinkFanout, ThresholdIsUnionOfSinkLevels) {
+    Collect warn, debug;
+    const int w = ::tc::log::add_sink(&Collect::sink, &warn, ::tc::log::level::warn);
+    EXPECT_EQ(::tc::detail::log_dispatch_threshold().load(), static_cast<int>(::tc::log::level::warn));
+    const int d = ::tc::log::add_sink(&Collect::sink, &debug, ::tc::log::level::debug);
+    EXPECT_EQ(::tc::detail::log_dispatch_threshold().load(), static_cast<int>(::tc::log::level::debug));
+    ::tc::log::set_level(::tc::log::level::error); // the global level still caps everything
+    EXPECT_EQ(::tc::detail::log_dispatch_threshold().load(), static_cast<int>(::tc::log::level::error));
+    ::tc::log::remove_sink(w);
+    ::tc::log::remove_sink(d);
+    EXPECT_EQ(::tc::detail::log_dispatch_threshold().load(), static_cast<int>(::tc::log::level::off));
+}
+
+TEST_F(SinkFanout, TableHasFixedCapacity) {
+    Collect c;
+    std::vector<int> ids;
+    for (int i = 0; i < TC_LOG_SINKS_MAX; ++i)
+        ids.push_back(::tc::log::add_sink(&Collect::sink, &c));
+    EXPECT_EQ(::tc::log::add_sink(&Collect::sink, &c), 0);
+    TC_LOG_INFO("x");
+    EXPECT_EQ(c.lines.size(), static_cast<std::size_t>(TC_LOG_SINKS_MAX));
+    for (int id : ids)
+        EXPECT_TRUE(::tc::log::remove_sink(id));
+}
+
+TEST_F(SinkFanout, ConcurrentRegistrationWhileLogging) {
+    counted = 0;
+    const int keep = ::tc::log::add_sink(&count_sink);
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> loggers;
+    for (int t = 0; t < 4; ++t) {
+        loggers.emplace_back([&] {
+            int n = 0;
+            while (!stop.load(std::memory_order_relaxed) || n < 1000) {
+                TC_LOG_INFO("msg %d", n++);
+            }
+        });
+    }
+    for (int i = 0; i < 2000; ++i) {
+        const int id = ::tc::log::add_sink(&count_sink, nullptr, ::tc::log::level::info, 1 + i % 4);
+        ::tc::log::remove_sink(id);
+    }
+    stop = true;
+    for (auto& th : loggers)
+        th.join();
+    EXPECT_GE(counted.load(), 4000);
+    ::tc::log::remove_sink(keep);
+}
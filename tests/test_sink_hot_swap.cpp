@@ -0,0 +1,76 @@
+#include "../include/tc/try_catch.hpp"
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace {
+struct SlowSink {
+    std::atomic<bool> inside{false};
+    std::atomic<bool> destroyed{false};
+    std::atomic<int> used_after_destroy{0};
+
+    static void sink(void* ctx, const ::tc::log::record*, std::size_t) {
+        auto* self = static_cast<SlowSink*>(ctx);
+        self->inside = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        if (self->destroyed)
+            self->used_after_destroy.fetch_add(1);
+        self->inside = false;
+    }
+};
+
+void null_sink(void*, const ::tc::log::record*, std::size_t) {}
+
+int self_removing_id = 0;
+void self_removing_sink(void*, const ::tc::log::record*, std::size_t) {
+    ::tc::log::remove_sink(self_removing_id); // must neither deadlock nor free the table being walked
+}
+
+struct HotSwap : ::testing::Test {
+    HotSwap() : prev_sink(::tc::log::get_sink()), prev_level(::tc::log::get_level()) {
+        ::tc::log::set_level(::tc::log::level::info);
+        ::tc::log::set_sink(nullptr);
+    }
+    ~HotSwap() override {
+        ::tc::log::set_sink(prev_sink);
+        ::tc::log::set_level(prev_level);
+    }
+    ::tc::log::sink_t prev_sink;
+    ::tc::log::level prev_level;
+};
+} // namespace
+
+TEST_F(HotSwap, ReplaceWaitsForInFlightCalls) {
+    SlowSink slow;
+    const int id = ::tc::log::add_sink(&SlowSink::sink, &slow);
+    ASSERT_NE(id, 0);
+    std::atomic<bool> stop{false};
+    std::thread logger([&] {
+        while (!stop)
+            TC_LOG_INFO("tick");
+    });
+    while (!slow.inside)
+        std::this_thread::yield();
+
+    EXPECT_TRUE(::tc::log::replace_sink(id, &null_sink));
+    EXPECT_FALSE(slow.inside); // the call that was running has finished
+    slow.destroyed = true;     // stands in for tearing down the sink's state
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    stop = true;
+    logger.join();
+    EXPECT_EQ(slow.used_after_destroy.load(), 0);
+}
+
+TEST_F(HotSwap, ReplaceReturnsPreviousLegacySink) {
+    EXPECT_EQ(::tc::log::replace_sink(prev_sink), nullptr);
+    EXPECT_EQ(::tc::log::replace_sink(nullptr), prev_sink);
+}
+
+TEST_F(HotSwap, SinkMayUnregisterItself) {
+    self_removing_id = ::tc::log::add_sink(&self_removing_sink);
+    TC_LOG_INFO("once");
+    EXPECT_FALSE(::tc::log::remove_sink(self_removing_id));
+    TC_LOG_INFO("no sinks left"); // the retired table is reclaimed by the next writer
+    ::tc::log::set_sink(nullptr);
+}
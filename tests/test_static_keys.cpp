@@ -0,0 +1,127 @@
+#define TC_LOG_STATIC_KEYS 1
+#include "../include/tc/try_catch.hpp"
+#include "log_capture.hpp"
+#include <atomic>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+void keys_test_debug(int v) {
+    TC_LOG_DEBUG("debug %d", v);
+}
+
+void keys_test_trace(int v) {
+    TC_LOG_TRACE("trace %d", v);
+}
+
+// Every patched instruction agrees with what its site wants.
+void expect_keys_consistent() {
+#if TC_LOG_STATIC_KEYS_SUPPORTED
+    ::tc::detail::log_jump_patch_guard g;
+    const auto& t = ::tc::detail::log_jump_tables_registry();
+    for (int i = 0; i < t.count; ++i) {
+        for (const auto* e = t.begin[i]; e != t.end[i]; ++e)
+            EXPECT_EQ(::tc::detail::log_jump_is_on(*e), ::tc::detail::log_site_key_wanted(*e->site))
+                << e->site->file << ":" << e->site->line;
+    }
+#endif
+}
+
+struct StaticKeysTest : LogCaptureTest {
+    StaticKeysTest() : LogCaptureTest(::tc::log::level::warn) {}
+    ~StaticKeysTest() override {
+        ::tc::log::set_site_state(nullptr, nullptr, nullptr, ::tc::log::site_state::level);
+    }
+};
+} // namespace
+
+TEST_F(StaticKeysTest, EveryKeyedSiteIsPatchable) {
+    const auto keys = ::tc::log::get_static_key_stats();
+#if TC_LOG_STATIC_KEYS_SUPPORTED
+    EXPECT_GE(keys.entries, 2u);
+#endif
+    EXPECT_EQ(keys.failed, 0u);
+    expect_keys_consistent();
+}
+
+TEST_F(StaticKeysTest, SetLevelPatchesSitesInAndOut) {
+    keys_test_debug(1);
+    ::tc::log::set_level(::tc::log::level::debug);
+    expect_keys_consistent();
+    keys_test_debug(2);
+    keys_test_trace(2);
+    ::tc::log::set_level(::tc::log::level::warn);
+    expect_keys_consistent();
+    keys_test_debug(3);
+    EXPECT_EQ(cap.payloads, std::vector<std::string>{"debug 2"});
+}
+
+TEST_F(StaticKeysTest, SiteControlPatchesOneSite) {
+    EXPECT_EQ(::tc::log::control_sites("func=keys_test_trace +"), 1);
+    expect_keys_consistent();
+    keys_test_trace(1);
+    keys_test_debug(1);
+    EXPECT_EQ(::tc::log::control_sites("func=keys_test_trace ="), 1);
+    expect_keys_consistent();
+    keys_test_trace(2);
+    EXPECT_EQ(cap.payloads, std::vector<std::string>{"trace 1"});
+}
+
+TEST_F(StaticKeysTest, PatchingWhileAnotherThreadRunsTheSite) {
+    std::atomic<bool> stop{false};
+    std::thread runner([&] {
+        while (!stop.load(std::memory_order_relaxed))
+            keys_test_trace(0);
+    });
+    for (int i = 0; i < 200; ++i) {
+        ::tc::log::set_level(::tc::log::level::debug);
+        ::tc::log::set_level(::tc::log::level::warn);
+    }
+    stop.store(true);
+    runner.join();
+    expect_keys_consistent();
+    EXPECT_TRUE(cap.payloads.empty());
+}
+
+#if TC_LOG_STATIC_KEYS_SUPPORTED
+// Patching gives a code page back the protection it had, rather than assuming read+execute.
+TEST_F(StaticKeysTest, PatchingRestoresPageProtection) {
+    std::uintptr_t code = 0;
+    {
+        ::tc::detail::log_jump_patch_guard g;
+        const auto& t = ::tc::detail::log_jump_tables_registry();
+        for (int i = 0; i < t.count && code == 0; ++i) {
+            for (const auto* e = t.begin[i]; e != t.end[i]; ++e)
+                if (std::strcmp(e->site->func, "keys_test_trace") == 0)
+                    code = e->code;
+        }
+    }
+    ASSERT_NE(code, 0u);
+    const auto page_size = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+    void* page = reinterpret_cast<void*>(code & ~(page_size - 1));
+    const int rwx = PROT_READ | PROT_WRITE | PROT_EXEC;
+    ASSERT_EQ(::mprotect(page, page_size, rwx), 0);
+    ::tc::log::set_level(::tc::log::level::trace);
+    ::tc::log::set_level(::tc::log::level::warn);
+    EXPECT_EQ(::tc::detail::log_jump_page_protection(code), rwx);
+    ::mprotect(page, page_size, PROT_READ | PROT_EXEC);
+    EXPECT_EQ(::tc::detail::log_jump_page_protection(code), PROT_READ | PROT_EXEC);
+    EXPECT_EQ(::tc::log::get_static_key_stats().failed, 0u);
+    expect_keys_consistent();
+}
+#endif
+
+TEST_F(StaticKeysTest, ThreadOverridesStillApplyToOneThread) {
+    {
+        ::tc::log::scoped_thread_level debug(::tc::log::level::debug);
+        expect_keys_consistent();
+        keys_test_debug(1);
+        std::thread other([] { keys_test_debug(2); });
+        other.join();
+    }
+    keys_test_debug(3);
+    EXPECT_EQ(cap.payloads, std::vector<std::string>{"debug 1"});
+}
@@ -0,0 +1,45 @@
+#include "../include/tc/try_catch.hpp"
+#include <cstring>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+
+#if TC_POSIX && defined(__linux__)
+#include <pthread.h>
+#endif
+
+namespace {
+void flushed(const ::tc::fatal::context& ctx, void*) {
+    const char* s = ctx.why == ::tc::fatal::reason::terminate ? "[flushed]\n" : "[wrong reason]\n";
+    ::tc::detail::safe_write(2, s, std::strlen(s));
+}
+
+[[noreturn]] void terminate_from_worker() {
+    ::tc::install_terminate_handler();
+    ::tc::fatal::add_handler(&flushed);
+    std::thread worker([] {
+#if TC_POSIX && defined(__linux__)
+        pthread_setname_np(pthread_self(), "tc-worker");
+#endif
+#if TC_EXCEPTIONS_ENABLED
+        throw std::out_of_range("slot 9");
+#else
+        std::terminate();
+#endif
+    });
+    worker.join();
+    std::abort();
+}
+} // namespace
+
+TEST(TerminateHandlerDeathTest, LogsInFlightExceptionWithThread) {
+#if TC_EXCEPTIONS_ENABLED && TC_HAVE_CXXABI
+    const char* expected = "ERROR.*terminate on thread [0-9]+ \\(tc-worker\\): uncaught std::out_of_range: slot 9"
+                           ".*\\[flushed\\]";
+#elif TC_EXCEPTIONS_ENABLED
+    const char* expected = "terminate on thread [0-9]+ .*: uncaught .*: slot 9.*\\[flushed\\]";
+#else
+    const char* expected = "terminate on thread [0-9]+ .*: called without an active exception.*\\[flushed\\]";
+#endif
+    EXPECT_DEATH(terminate_from_worker(), expected);
+}
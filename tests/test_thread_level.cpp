@@ -0,0 +1,86 @@
+#include "../include/tc/try_catch.hpp"
+#include "log_capture.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::vector<std::string> kv_lines;
+void kv_sink(::tc::log::level, const char* data, std::size_t len) {
+    kv_lines.emplace_back(data, len);
+}
+
+struct ThreadLevelTest : LogCaptureTest {
+    ThreadLevelTest() : LogCaptureTest(::tc::log::level::info) {}
+};
+} // namespace
+
+TEST_F(ThreadLevelTest, OverrideAppliesToTheCallingThreadOnly) {
+    std::thread other([] {
+        TC_LOG_DEBUG("other thread debug");
+        TC_LOG_INFO("other thread info");
+    });
+    other.join();
+    {
+        ::tc::log::scoped_thread_level debug(::tc::log::level::debug);
+        EXPECT_EQ(::tc::log::effective_level(), ::tc::log::level::debug);
+        EXPECT_EQ(::tc::log::get_level(), ::tc::log::level::info);
+        TC_LOG_DEBUG("this thread debug");
+        TC_LOG_TRACE("this thread trace");
+        std::thread during([] { TC_LOG_DEBUG("other thread debug during override"); });
+        during.join();
+    }
+    TC_LOG_DEBUG("this thread debug after");
+    EXPECT_EQ(::tc::log::effective_level(), ::tc::log::level::info);
+    EXPECT_EQ(cap.payloads, (std::vector<std::string>{"other thread info", "this thread debug"}));
+}
+
+TEST_F(ThreadLevelTest, OverrideCanSilenceAThread) {
+    ::tc::log::scoped_thread_level quiet(::tc::log::level::error);
+    TC_LOG_WARN("dropped");
+    TC_LOG_ERROR("kept");
+    EXPECT_EQ(cap.payloads, std::vector<std::string>{"kept"});
+}
+
+TEST_F(ThreadLevelTest, ScopesNest) {
+    ::tc::log::scoped_thread_level outer(::tc::log::level::debug);
+    {
+        ::tc::log::scoped_thread_level inner(::tc::log::level::trace);
+        EXPECT_EQ(::tc::log::effective_level(), ::tc::log::level::trace);
+        TC_LOG_TRACE("inner trace");
+    }
+    EXPECT_EQ(::tc::log::effective_level(), ::tc::log::level::debug);
+    TC_LOG_TRACE("outer trace");
+    TC_LOG_DEBUG("outer debug");
+    EXPECT_EQ(cap.payloads, (std::vector<std::string>{"inner trace", "outer debug"}));
+}
+
+TEST_F(ThreadLevelTest, SinkLevelsStillApply) {
+    LogCapture warn_only;
+    const int id = ::tc::log::add_sink(&LogCapture::sink, &warn_only, ::tc::log::level::warn);
+    ASSERT_NE(id, 0);
+    {
+        ::tc::log::scoped_thread_level debug(::tc::log::level::debug);
+        TC_LOG_DEBUG("debug");
+        TC_LOG_WARN("warn");
+    }
+    ::tc::log::remove_sink(id);
+    EXPECT_EQ(cap.payloads, (std::vector<std::string>{"debug", "warn"}));
+    EXPECT_EQ(warn_only.payloads, std::vector<std::string>{"warn"});
+}
+
+TEST_F(ThreadLevelTest, KvRecordsFollowTheOverride) {
+    const auto prev_kv = ::tc::log::get_kv_sink();
+    ::tc::log::set_kv_sink(&kv_sink);
+    kv_lines.clear();
+    TC_LOG_DEBUG_KV("before");
+    {
+        ::tc::log::scoped_thread_level debug(::tc::log::level::debug);
+        TC_LOG_DEBUG_KV("during");
+    }
+    TC_LOG_DEBUG_KV("after");
+    ::tc::log::set_kv_sink(prev_kv);
+    ASSERT_EQ(kv_lines.size(), 1u);
+    EXPECT_NE(kv_lines[0].find("during"), std::string::npos);
+}
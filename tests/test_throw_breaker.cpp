@@ -0,0 +1,67 @@
+#include "../include/tc/try_catch.hpp"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+void null_sink(::tc::detail::log_level, const char*, int, const char*, const char*, va_list) {}
+
+int parse(int x) {
+    if (x < 0) {
+        TC_THROW_OR_RETURN(std::invalid_argument("negative"), -1);
+    }
+    return x;
+}
+
+struct BreakerConfig {
+    BreakerConfig() : prev_sink(::tc::log::get_sink()) {
+        ::tc::log::set_sink(&null_sink);
+        ::tc::breaker::set_threshold(3, 60000);
+        ::tc::breaker::set_cooldown(50);
+    }
+    ~BreakerConfig() {
+        ::tc::breaker::set_threshold(1000, 1000);
+        ::tc::breaker::set_cooldown(5000);
+        ::tc::log::set_sink(prev_sink);
+    }
+    ::tc::log::sink_t prev_sink;
+};
+} // namespace
+
+#if TC_EXCEPTIONS_ENABLED
+TEST(ThrowBreaker, TripsThenRecoversAfterCooldown) {
+    BreakerConfig cfg;
+    const auto before = ::tc::breaker::stats();
+    int thrown = 0;
+    for (int i = 0; i < 3; ++i) {
+        TC_TRY {
+            parse(-1);
+        }
+        TC_CATCH(const std::invalid_argument&, e) {
+            (void)e;
+            ++thrown;
+        }
+    }
+    EXPECT_EQ(thrown, 3);
+
+    // Over the threshold: the site returns the error value instead of throwing.
+    EXPECT_EQ(parse(-1), -1);
+    EXPECT_EQ(parse(-1), -1);
+    EXPECT_EQ(parse(7), 7);
+    const auto after = ::tc::breaker::stats();
+    EXPECT_EQ(after.trips - before.trips, 1u);
+    EXPECT_EQ(after.suppressed - before.suppressed, 2u);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    EXPECT_THROW(parse(-1), std::invalid_argument);
+}
+#else
+TEST(ThrowBreakerNoEx, AlwaysReturnsErrorValue) {
+    BreakerConfig cfg;
+    const auto before = ::tc::breaker::stats();
+    EXPECT_EQ(parse(-1), -1);
+    EXPECT_EQ(parse(5), 5);
+    EXPECT_EQ(::tc::breaker::stats().suppressed - before.suppressed, 1u);
+}
+#endif
@@ -0,0 +1,117 @@
+#include "../include/tc/try_catch.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+void null_sink(::tc::detail::log_level, const char*, int, const char*, const char*, va_list) {}
+
+std::string export_json(std::size_t* count) {
+    std::FILE* f = std::tmpfile();
+    *count = ::tc::trace::write_chrome_json(f);
+    std::string out(static_cast<std::size_t>(std::ftell(f)), '\0');
+    std::rewind(f);
+    out.resize(std::fread(&out[0], 1, out.size(), f));
+    std::fclose(f);
+    return out;
+}
+
+int guarded(int x) {
+#if TC_EXCEPTIONS_ENABLED
+    if (x < 0)
+        TC_THROW(std::runtime_error("neg"));
+#endif
+    return x;
+}
+} // namespace
+
+#if TC_ENABLE_TRACING
+TEST(Trace, RecordsThrowCatchGuardLogAndScopes) {
+    auto prev_sink = ::tc::log::get_sink();
+    ::tc::log::set_sink(&null_sink);
+    ::tc::trace::clear();
+    ::tc::trace::start();
+    {
+        TC_TRACE_SCOPE("request");
+        TC_LOG_ERROR("boom %d", 1);
+        EXPECT_TRUE(TC_GUARD(guarded(1)));
+#if TC_EXCEPTIONS_ENABLED
+        TC_TRY {
+            TC_THROW(std::runtime_error("x"));
+        }
+        TC_CATCH_STD_ERROR()
+#endif
+    }
+    ::tc::trace::stop();
+    TC_LOG_ERROR("not recorded");
+    ::tc::log::set_sink(prev_sink);
+
+    std::size_t n = 0;
+    const std::string json = export_json(&n);
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0), 0u);
+    EXPECT_NE(json.find("\"name\":\"request\",\"cat\":\"tc.scope\",\"ph\":\"B\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"request\",\"cat\":\"tc.scope\",\"ph\":\"E\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"boom %d\",\"cat\":\"tc.log\",\"ph\":\"i\""), std::string::npos);
+    EXPECT_NE(json.find("\"cat\":\"tc.guard\",\"ph\":\"E\""), std::string::npos);
+    EXPECT_NE(json.find("\"ok\":true"), std::string::npos);
+    EXPECT_EQ(json.find("not recorded"), std::string::npos);
+#if TC_EXCEPTIONS_ENABLED
+    EXPECT_EQ(n, 8u); // + throw, catch and the catch helper's log record
+#if TC_HAVE_CXXABI
+    EXPECT_NE(json.find("\"name\":\"std::runtime_error\",\"cat\":\"tc.throw\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"std::runtime_error\",\"cat\":\"tc.catch\""), std::string::npos);
+#endif
+#else
+    EXPECT_EQ(n, 5u);
+#endif
+}
+
+TEST(Trace, ClearHidesEarlierEvents) {
+    ::tc::trace::start();
+    { TC_TRACE_SCOPE("old"); }
+    ::tc::trace::stop();
+    ::tc::trace::clear();
+    std::size_t n = 0;
+    const std::string json = export_json(&n);
+    EXPECT_EQ(n, 0u);
+    EXPECT_EQ(json.find("\"old\""), std::string::npos);
+}
+
+// Every exported event must be one the recorder actually wrote, never a mix of a lapped slot's old and new fields.
+TEST(Trace, ExportWhileRecordingYieldsWholeEvents) {
+    std::atomic<bool> done{false};
+    std::atomic<int> a_line{0}, b_line{0};
+    ::tc::trace::clear();
+    ::tc::trace::start();
+    std::thread recorder([&] {
+        while (!done.load(std::memory_order_relaxed)) {
+            { TC_TRACE_SCOPE("lap_a"); a_line.store(__LINE__, std::memory_order_relaxed); }
+            { TC_TRACE_SCOPE("lap_b"); b_line.store(__LINE__, std::memory_order_relaxed); }
+        }
+    });
+    while (b_line.load(std::memory_order_relaxed) == 0)
+        std::this_thread::yield();
+    for (int round = 0; round < 20; ++round) {
+        std::size_t n = 0;
+        const std::string json = export_json(&n);
+        EXPECT_LE(n, static_cast<std::size_t>(TC_TRACE_BUFFER_EVENTS));
+        for (const char* name : {"\"name\":\"lap_a\"", "\"name\":\"lap_b\""}) {
+            const int want = name[12] == 'a' ? a_line.load() : b_line.load();
+            for (std::size_t at = json.find(name); at != std::string::npos; at = json.find(name, at + 1)) {
+                const std::size_t line = json.find("\"line\":", at);
+                ASSERT_NE(line, std::string::npos);
+                EXPECT_EQ(std::atoi(json.c_str() + line + 7), want);
+            }
+        }
+        std::this_thread::yield();
+    }
+    done = true;
+    recorder.join();
+    ::tc::trace::stop();
+    ::tc::trace::clear();
+}
+#endif
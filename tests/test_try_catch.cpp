@@ -33,6 +33,37 @@ TEST(TryCatch, CatchAll) {
     }
     EXPECT_EQ(caught, 1);
 }
+
+namespace {
+int checked(bool ok) {
+    return ok ? 1 : TC_THROW(std::runtime_error("not ok"));
+}
+
+int rethrow_unless(bool ok) {
+    TC_TRY {
+        throw 7;
+    }
+    TC_CATCH_ALL() {
+        return ok ? 0 : TC_RETHROW();
+    }
+    return -1;
+}
+} // namespace
+
+TEST(TryCatch, ThrowMacrosAreThrowExpressions) {
+    EXPECT_EQ(checked(true), 1);
+    EXPECT_THROW(checked(false), std::runtime_error);
+    EXPECT_EQ(rethrow_unless(true), 0);
+    int rethrown = 0;
+    try {
+        rethrow_unless(false);
+    } catch (int v) {
+        rethrown = v;
+    }
+    EXPECT_EQ(rethrown, 7);
+    std::runtime_error lvalue("lvalue");
+    EXPECT_THROW(TC_THROW(lvalue), std::runtime_error);
+}
 #else
 TEST(TryCatchNoEx, TryRunsCatchSkipped) {
     int try_ran = 0;
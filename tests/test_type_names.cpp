@@ -0,0 +1,57 @@
+#include "../include/tc/try_catch.hpp"
+#include <cstdarg>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+
+namespace {
+struct ErrorLines {
+    static std::string& last() {
+        static std::string s;
+        return s;
+    }
+    static void sink(::tc::detail::log_level, const char*, int, const char*, const char* fmt, va_list ap) {
+        char buf[256];
+        vsnprintf(buf, sizeof(buf), fmt, ap);
+        last() = buf;
+    }
+};
+} // namespace
+
+#if TC_HAVE_CXXABI
+TEST(TypeNames, DemanglesOncePerType) {
+    const char* a = ::tc::type_name(typeid(std::out_of_range));
+    EXPECT_STREQ(a, "std::out_of_range");
+    // Cached: the same pointer comes back on later lookups.
+    EXPECT_EQ(::tc::type_name(typeid(std::out_of_range)), a);
+    EXPECT_STREQ(::tc::type_name(typeid(int)), "int");
+}
+#endif
+
+TEST(TypeNames, NoCurrentException) {
+    EXPECT_STREQ(::tc::current_exception_type_name(), "(none)");
+}
+
+#if TC_EXCEPTIONS_ENABLED && TC_HAVE_CXXABI
+TEST(TypeNames, StdCatchHelpersLogDynamicType) {
+    auto prev_sink = ::tc::log::get_sink();
+    ::tc::log::set_sink(&ErrorLines::sink);
+
+    TC_TRY {
+        TC_THROW(std::out_of_range("idx 7"));
+    }
+    TC_CATCH_STD_ERROR()
+    EXPECT_EQ(ErrorLines::last(), "std::out_of_range: idx 7");
+
+    std::string seen;
+    TC_TRY {
+        TC_THROW(std::invalid_argument("bad"));
+    }
+    TC_CATCH_STD_ERROR_AS(e, { seen = ::tc::current_exception_type_name(); })
+    EXPECT_EQ(ErrorLines::last(), "std::invalid_argument: bad");
+    EXPECT_EQ(seen, "std::invalid_argument");
+
+    ::tc::log::set_sink(prev_sink);
+}
+#endif
@@ -0,0 +1,80 @@
+#include "../include/tc/try_catch.hpp"
+#include <gtest/gtest.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#if TC_ENABLE_USDT
+#include <elf.h>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace {
+// Reads the .note.stapsdt section of the running executable and returns "provider:name" -> argument format.
+std::multimap<std::string, std::string> read_stapsdt_notes() {
+    std::ifstream in("/proc/self/exe", std::ios::binary);
+    std::vector<char> img((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::multimap<std::string, std::string> probes;
+    if (img.size() < sizeof(Elf64_Ehdr))
+        return probes;
+    const auto* eh = reinterpret_cast<const Elf64_Ehdr*>(img.data());
+    const auto* sh = reinterpret_cast<const Elf64_Shdr*>(img.data() + eh->e_shoff);
+    const char* shstr = img.data() + sh[eh->e_shstrndx].sh_offset;
+    for (int i = 0; i < eh->e_shnum; ++i) {
+        if (sh[i].sh_type != SHT_NOTE || std::string(shstr + sh[i].sh_name) != ".note.stapsdt")
+            continue;
+        std::size_t off = sh[i].sh_offset;
+        const std::size_t end = off + sh[i].sh_size;
+        while (off + sizeof(Elf64_Nhdr) <= end) {
+            const auto* nh = reinterpret_cast<const Elf64_Nhdr*>(img.data() + off);
+            const char* name = img.data() + off + sizeof(Elf64_Nhdr);
+            const char* desc = name + ((nh->n_namesz + 3) & ~3u);
+            if (nh->n_type == 3 && std::string(name) == "stapsdt") {
+                const char* provider = desc + 3 * 8; // pc, base, semaphore
+                const char* probe = provider + std::string(provider).size() + 1;
+                const char* args = probe + std::string(probe).size() + 1;
+                probes.emplace(std::string(provider) + ":" + probe, args);
+            }
+            off = static_cast<std::size_t>(desc - img.data()) + ((nh->n_descsz + 3) & ~3u);
+        }
+    }
+    return probes;
+}
+
+#if TC_EXCEPTIONS_ENABLED
+int checked(int x) {
+    if (x < 0)
+        TC_THROW(std::runtime_error("neg"));
+    return x;
+}
+#endif
+} // namespace
+
+TEST(Usdt, ProbesArePresentInNoteSection) {
+#if TC_EXCEPTIONS_ENABLED
+    // Reference each probe site so the probes are emitted into this binary.
+    TC_TRY {
+        TC_TRY {
+            checked(-1);
+        }
+        TC_CATCH(const std::exception&, e) {
+            (void)e;
+            TC_RETHROW();
+        }
+    }
+    TC_CATCH_STD_WARN()
+    EXPECT_FALSE(TC_GUARD(checked(-1)));
+#endif
+    const auto probes = read_stapsdt_notes();
+    ASSERT_FALSE(probes.empty());
+    ASSERT_EQ(probes.count("tc:log"), 1u);
+    // level is a signed 32-bit int; file, line and fmt follow.
+    EXPECT_EQ(probes.find("tc:log")->second.rfind("-4@", 0), 0u);
+#if TC_EXCEPTIONS_ENABLED
+    for (const char* name : {"tc:throw", "tc:rethrow", "tc:catch", "tc:guard_fail"})
+        EXPECT_GE(probes.count(name), 1u) << name;
+    EXPECT_EQ(probes.find("tc:throw")->second.rfind("8@", 0), 0u);
+#endif
+}
+#endif
@@ -0,0 +1,171 @@
+// tc_logcollector: drains a tc::shm::producer segment, formats the records and writes them out.
+//
+//   tc_logcollector [-o FILE] [-t] [-e] [-u] SEGMENT
+//   tc_logcollector [-o FILE] [-t] [-e] -d FD
+//
+//   SEGMENT  "/name" for a shm_open object, or a path (e.g. /proc/PID/fd/N for a producer's memfd)
+//   -d FD    use an inherited descriptor instead of opening SEGMENT
+//   -o FILE  append to FILE instead of writing to stdout
+//   -t       prefix every record with its UTC timestamp
+//   -e       exit once the producer has exited and the segment is drained
+//   -u       shm_unlink SEGMENT on exit
+//
+// SIGINT/SIGTERM drain what is already in the segment, then exit. A record the producer died in the middle of
+// writing is skipped and reported on stderr.
+
+#include "../include/tc/shm_sink.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_signal(int) {
+    stop_requested = 1;
+}
+
+void usage() {
+    std::fprintf(stderr, "usage: tc_logcollector [-o FILE] [-t] [-e] [-u] SEGMENT | -d FD\n");
+}
+
+// Formats into a large buffer and writes it with one write(2) when it fills up or the segment runs dry.
+class output {
+  public:
+    explicit output(int fd) : fd_(fd) {}
+
+    void add(const tc::shm::consumer::entry& e, bool stamps) {
+        if (sizeof(buf_) - len_ < 2 * TC_LOG_MESSAGE_MAX + 1024)
+            flush();
+        tc::detail::safe_buffer out{buf_ + len_, sizeof(buf_) - len_};
+        if (stamps) {
+            const std::time_t secs = static_cast<std::time_t>(e.timestamp / 1000000000u);
+            std::tm tm{};
+            ::gmtime_r(&secs, &tm);
+            char stamp[32];
+            const std::size_t n = std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S.", &tm);
+            out.mem(stamp, n);
+            char frac[8];
+            std::snprintf(frac, sizeof(frac), "%06u", static_cast<unsigned>(e.timestamp % 1000000000u / 1000u));
+            out.str(frac).str("Z ");
+        }
+        tc::detail::append_record_line(out, e.to_record());
+        len_ += out.len;
+    }
+
+    void flush() {
+        std::size_t done = 0;
+        while (done < len_) {
+            const ssize_t n = ::write(fd_, buf_ + done, len_ - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            done += static_cast<std::size_t>(n);
+        }
+        len_ = 0;
+    }
+
+  private:
+    int fd_;
+    std::size_t len_ = 0;
+    char buf_[256 * 1024];
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* out_path = nullptr;
+    bool stamps = false, exit_when_done = false, unlink_on_exit = false;
+    int in_fd = -1;
+    int opt;
+    while ((opt = ::getopt(argc, argv, "o:teud:")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_path = optarg;
+            break;
+        case 't':
+            stamps = true;
+            break;
+        case 'e':
+            exit_when_done = true;
+            break;
+        case 'u':
+            unlink_on_exit = true;
+            break;
+        case 'd':
+            in_fd = std::atoi(optarg);
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    const char* name = optind < argc ? argv[optind] : nullptr;
+    if ((name == nullptr) == (in_fd < 0)) {
+        usage();
+        return 2;
+    }
+
+    auto shm = name ? std::make_unique<tc::shm::consumer>(name) : std::make_unique<tc::shm::consumer>(in_fd);
+    if (!shm->ok()) {
+        std::fprintf(stderr, "tc_logcollector: %s is not a tc log segment\n", name ? name : "descriptor");
+        return 1;
+    }
+    int out_fd = STDOUT_FILENO;
+    if (out_path != nullptr) {
+        out_fd = ::open(out_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (out_fd < 0) {
+            std::perror(out_path);
+            return 1;
+        }
+    }
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    auto out = std::make_unique<output>(out_fd);
+    tc::shm::consumer::entry e{};
+    std::uint64_t dropped = shm->dropped();
+    unsigned idle = 0;
+    for (;;) {
+        const auto r = shm->next(e);
+        if (r == tc::shm::consumer::result::record) {
+            out->add(e, stamps);
+            idle = 0;
+            continue;
+        }
+        const bool alive = shm->producer_alive();
+        if (r == tc::shm::consumer::result::pending && !alive) {
+            shm->skip_torn();
+            std::fprintf(stderr, "tc_logcollector: skipped a record torn by the producer's exit\n");
+            continue;
+        }
+        if (stop_requested || (exit_when_done && !alive))
+            break;
+        out->flush();
+        if (shm->dropped() != dropped) {
+            std::fprintf(stderr, "tc_logcollector: producer dropped %llu records (segment full)\n",
+                         static_cast<unsigned long long>(shm->dropped() - dropped));
+            dropped = shm->dropped();
+        }
+        // Stay responsive during bursts, then back off to a cheap poll.
+        if (++idle < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(idle < 1024 ? 1 : 10));
+    }
+    // Records committed between the last empty read and the exit check.
+    while (shm->next(e) == tc::shm::consumer::result::record)
+        out->add(e, stamps);
+    out->flush();
+    if (unlink_on_exit && name != nullptr)
+        ::shm_unlink(name);
+    return 0;
+}
@@ -0,0 +1,139 @@
+// tc_logtail: prints the records of a tc::ring::mmap_sink file.
+//
+//   tc_logtail [-f] [-n N] [-t] FILE
+//
+//   -f    keep following the file as producers append to it (like tail -f)
+//   -n N  start with the last N records instead of the oldest one still in the ring
+//   -t    prefix every record with its UTC timestamp
+//
+// Without -f, the file is read once: this is how a log is recovered after a crash. Records a crashed producer
+// left half written are skipped and reported on stderr.
+
+#include "../include/tc/mmap_ring_sink.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+void usage() {
+    std::fprintf(stderr, "usage: tc_logtail [-f] [-n N] [-t] FILE\n");
+}
+
+void print(const tc::ring::reader::entry& e, bool stamps) {
+    if (stamps) {
+        const std::time_t secs = static_cast<std::time_t>(e.timestamp / 1000000000u);
+        std::tm tm{};
+        ::gmtime_r(&secs, &tm);
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+        std::printf("%s.%06uZ ", buf, static_cast<unsigned>(e.timestamp % 1000000000u / 1000u));
+    }
+    std::fwrite(e.text.data(), 1, e.text.size(), stdout);
+    if (e.text.empty() || e.text.back() != '\n')
+        std::fputc('\n', stdout);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool follow = false, stamps = false;
+    long last = -1;
+    int opt;
+    while ((opt = ::getopt(argc, argv, "fn:t")) != -1) {
+        switch (opt) {
+        case 'f':
+            follow = true;
+            break;
+        case 'n':
+            last = std::strtol(optarg, nullptr, 10);
+            break;
+        case 't':
+            stamps = true;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage();
+        return 2;
+    }
+
+    tc::ring::reader rd(argv[optind]);
+    if (!rd.ok()) {
+        std::fprintf(stderr, "tc_logtail: %s is not a tc ring log\n", argv[optind]);
+        return 1;
+    }
+
+    // A live producer finishes a pending record within microseconds; one still pending after this long belongs
+    // to a producer that died mid-write.
+    constexpr auto torn_after = std::chrono::milliseconds(500);
+    constexpr auto poll = std::chrono::milliseconds(20);
+    std::deque<std::pair<std::uint64_t, std::string>> tail; // timestamp, text
+    bool backlog = true; // still reading what was in the file at startup
+    std::uint64_t generation = rd.generation();
+    auto pending_since = std::chrono::steady_clock::time_point{};
+    tc::ring::reader::entry e{};
+
+    for (;;) {
+        const auto r = rd.next(e);
+        if (r == tc::ring::reader::result::record) {
+            pending_since = {};
+            if (backlog && last >= 0) {
+                tail.emplace_back(e.timestamp, std::string(e.text));
+                if (static_cast<long>(tail.size()) > last)
+                    tail.pop_front();
+                continue;
+            }
+            print(e, stamps);
+            continue;
+        }
+        if (r == tc::ring::reader::result::pending) {
+            const auto now = std::chrono::steady_clock::now();
+            if (pending_since == std::chrono::steady_clock::time_point{})
+                pending_since = now;
+            if (follow && now - pending_since < torn_after) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            const std::uint64_t at = rd.position();
+            rd.skip_torn();
+            std::fprintf(stderr, "tc_logtail: skipped torn record at %llu\n", static_cast<unsigned long long>(at));
+            pending_since = {};
+            continue;
+        }
+        // caught_up
+        if (backlog) {
+            for (const auto& kept : tail) {
+                tc::ring::reader::entry t{};
+                t.timestamp = kept.first;
+                t.text = kept.second;
+                print(t, stamps);
+            }
+            tail.clear();
+            backlog = false;
+        }
+        std::fflush(stdout);
+        if (!follow)
+            break;
+        if (rd.generation() != generation) {
+            generation = rd.generation();
+            std::fprintf(stderr, "tc_logtail: producer attached (generation %llu)\n",
+                         static_cast<unsigned long long>(generation));
+        }
+        std::this_thread::sleep_for(poll);
+    }
+    if (rd.lost() != 0)
+        std::fprintf(stderr, "tc_logtail: %llu bytes overwritten or torn before they could be read\n",
+                     static_cast<unsigned long long>(rd.lost()));
+    return 0;
+}